@@ -0,0 +1,89 @@
+#include "arbiter.h"
+
+/**
+ * @param arbiter
+ */
+void arbiterInit(PumpArbiter &arbiter)
+{
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    arbiter.grantedAt[zone] = 0;
+  }
+  arbiter.lastTurnOn = 0;
+  arbiter.granted = 0;
+  arbiter.next = 0;
+}
+
+/**
+ * @param mask
+ * @return number of set bits
+ */
+static uint8_t arbiterCount(ZoneMask mask)
+{
+  uint8_t count = 0;
+  for (; mask; mask &= mask - 1) {
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Take back the pump that has run the longest once it used up its slice
+ * @param arbiter
+ * @param now ms
+ */
+static void arbiterPreempt(PumpArbiter &arbiter, uint32_t now)
+{
+  uint8_t oldest = ZONE_COUNT;
+  uint32_t longest = 0;
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    uint32_t running = now - arbiter.grantedAt[zone];
+    if ((arbiter.granted & ((ZoneMask)1 << zone)) && running >= longest) {
+      oldest = zone;
+      longest = running;
+    }
+  }
+  if (oldest < ZONE_COUNT && longest >= PUMP_SLICE_MS) {
+    arbiter.granted &= ~((ZoneMask)1 << oldest);
+  }
+}
+
+/**
+ * Decide which of the requested pumps may run now. At most one pump is switched on per
+ * call, and none within PUMP_STAGGER_MS of the previous turn-on.
+ * @param arbiter
+ * @param requests zones that want their pump on
+ * @param now ms
+ * @return zones whose pump runs
+ */
+ZoneMask arbiterUpdate(PumpArbiter &arbiter, ZoneMask requests, uint32_t now)
+{
+  arbiter.granted &= requests;
+
+  ZoneMask waiting = requests & ~arbiter.granted;
+  if (!waiting) {
+    return arbiter.granted;
+  }
+
+  if (arbiterCount(arbiter.granted) >= PUMP_MAX_ACTIVE) {
+    arbiterPreempt(arbiter, now);
+    if (arbiterCount(arbiter.granted) >= PUMP_MAX_ACTIVE) {
+      return arbiter.granted;
+    }
+  }
+  if (now - arbiter.lastTurnOn < PUMP_STAGGER_MS) {
+    return arbiter.granted;
+  }
+
+  for (uint8_t i = 0; i < ZONE_COUNT; i++) {
+    uint8_t zone = (arbiter.next + i) % ZONE_COUNT;
+    if (waiting & ((ZoneMask)1 << zone)) {
+      arbiter.granted |= (ZoneMask)1 << zone;
+      arbiter.grantedAt[zone] = now;
+      arbiter.lastTurnOn = now;
+      arbiter.next = (zone + 1) % ZONE_COUNT;
+      break;
+    }
+  }
+  return arbiter.granted;
+}
@@ -0,0 +1,29 @@
+/**
+  Pump arbiter: the pumps share one supply (2 x AA in the reference build), so zones
+  only request water and the arbiter grants at most PUMP_MAX_ACTIVE pumps at a time.
+  Turn-on edges are spaced PUMP_STAGGER_MS apart so inrush currents never add up, and
+  waiting zones are served round robin; a pump that ran PUMP_SLICE_MS yields to a
+  waiting zone. Releasing a pump is immediate.
+
+  Call arbiterUpdate() with the current requests after the control pass and from the
+  wait loops, so staggered grants do not wait for the next loop.
+  Plain C++ with no Arduino dependency, so the host simulator runs the same code.
+*/
+
+#ifndef ARBITER_H
+#define ARBITER_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct PumpArbiter {
+  uint32_t grantedAt[ZONE_COUNT]; // ms
+  uint32_t lastTurnOn;            // ms
+  ZoneMask granted;
+  uint8_t next;                   // first zone the round robin looks at
+};
+
+void arbiterInit(PumpArbiter &arbiter);
+ZoneMask arbiterUpdate(PumpArbiter &arbiter, ZoneMask requests, uint32_t now);
+
+#endif
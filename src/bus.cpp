@@ -0,0 +1,292 @@
+#include "bus.h"
+
+enum BusRxState {
+  BUS_RX_SOF,
+  BUS_RX_ADDRESS,
+  BUS_RX_TYPE,
+  BUS_RX_LENGTH,
+  BUS_RX_PAYLOAD,
+  BUS_RX_CRC
+};
+
+/**
+ * CRC-8/MAXIM (polynomial 0x31 reflected), bitwise to stay out of SRAM and flash
+ * @param crc
+ * @param data
+ * @return
+ */
+static uint8_t busCrc8(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = crc & 1 ? (crc >> 1) ^ 0x8C : crc >> 1;
+  }
+  return crc;
+}
+
+/**
+ * Wait for the start of the next frame
+ * @param parser
+ */
+void busParserReset(BusParser &parser)
+{
+  parser.state = BUS_RX_SOF;
+}
+
+/**
+ * Feed one received byte to the frame parser
+ * @param parser
+ * @param c
+ * @return true when a complete frame with a valid CRC is in parser.address/type/payload
+ */
+bool busParse(BusParser &parser, uint8_t c)
+{
+  switch (parser.state) {
+    case BUS_RX_SOF:
+      if (c == BUS_SOF) {
+        parser.crc = 0;
+        parser.state = BUS_RX_ADDRESS;
+      }
+      return false;
+    case BUS_RX_ADDRESS:
+      parser.address = c;
+      parser.state = BUS_RX_TYPE;
+      break;
+    case BUS_RX_TYPE:
+      parser.type = c;
+      parser.state = BUS_RX_LENGTH;
+      break;
+    case BUS_RX_LENGTH:
+      if (c > BUS_MAX_PAYLOAD) {
+        parser.state = BUS_RX_SOF;
+        return false;
+      }
+      parser.length = c;
+      parser.count = 0;
+      parser.state = c ? BUS_RX_PAYLOAD : BUS_RX_CRC;
+      break;
+    case BUS_RX_PAYLOAD:
+      parser.payload[parser.count++] = c;
+      if (parser.count == parser.length) {
+        parser.state = BUS_RX_CRC;
+      }
+      break;
+    case BUS_RX_CRC:
+      parser.state = BUS_RX_SOF;
+      return c == parser.crc;
+  }
+
+  parser.crc = busCrc8(parser.crc, c);
+  return false;
+}
+
+/**
+ * Build a frame
+ * @param frame BUS_MAX_FRAME bytes
+ * @param address
+ * @param type
+ * @param payload
+ * @param length
+ * @return bytes in the frame
+ */
+uint8_t busFrame(uint8_t *frame, uint8_t address, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+  uint8_t count = 0;
+  uint8_t crc = 0;
+
+  frame[count++] = BUS_SOF;
+  frame[count++] = address;
+  frame[count++] = type;
+  frame[count++] = length;
+  for (uint8_t i = 0; i < length; i++) {
+    frame[count++] = payload[i];
+  }
+  for (uint8_t i = 1; i < count; i++) {
+    crc = busCrc8(crc, frame[i]);
+  }
+  frame[count++] = crc;
+
+  return count;
+}
+
+/**
+ * Encode a sensor frame
+ * @param payload BUS_MAX_PAYLOAD bytes
+ * @param frame
+ * @return bytes in the payload
+ */
+uint8_t busSensorPayload(uint8_t *payload, const BusSensorFrame &frame)
+{
+  uint8_t length = 0;
+
+  payload[length++] = frame.zoneCount;
+  for (uint8_t zone = 0; zone < frame.zoneCount; zone++) {
+    payload[length++] = (uint8_t)frame.readings[zone];
+    payload[length++] = (uint8_t)(frame.readings[zone] >> 8);
+  }
+  payload[length++] = (uint8_t)frame.pumps;
+  payload[length++] = (uint8_t)(frame.pumps >> 8);
+  payload[length++] = (uint8_t)frame.faults;
+  payload[length++] = (uint8_t)(frame.faults >> 8);
+
+  return length;
+}
+
+/**
+ * Decode the sensor frame the parser just completed
+ * @param parser
+ * @param frame
+ * @return false when the payload is malformed
+ */
+bool busDecodeSensorFrame(const BusParser &parser, BusSensorFrame &frame)
+{
+  frame.zoneCount = parser.payload[0];
+  if (frame.zoneCount > BUS_MAX_ZONES || parser.length != 1 + 2 * frame.zoneCount + 4) {
+    return false;
+  }
+
+  const uint8_t *p = parser.payload + 1;
+  for (uint8_t zone = 0; zone < frame.zoneCount; zone++, p += 2) {
+    frame.readings[zone] = p[0] | p[1] << 8;
+  }
+  frame.pumps = p[0] | p[1] << 8;
+  frame.faults = p[2] | p[3] << 8;
+
+  return true;
+}
+
+#if defined(ARDUINO) && BUS_ROLE != BUS_ROLE_NONE
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include "fastgpio.h"
+#include "relays.h"
+#include "pumpmonitor.h"
+
+static SoftwareSerial bus(BUS_RX_PIN, BUS_TX_PIN);
+static BusParser rx;
+
+#if BUS_ROLE == BUS_ROLE_SLAVE
+static_assert(ZONE_COUNT <= BUS_MAX_ZONES, "a bus frame carries at most 16 zones");
+static const float *busSensorValues;
+#endif
+
+/**
+ * Transmit one frame with the driver enabled, then hand the bus back
+ * @param address
+ * @param type
+ * @param payload
+ * @param length
+ */
+static void busSend(uint8_t address, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+  uint8_t frame[BUS_MAX_FRAME];
+  uint8_t count = busFrame(frame, address, type, payload, length);
+
+  FastPin<BUS_DE_PIN>::high();
+  bus.write(frame, count);
+  // SoftwareSerial returns after the stop bit, the line can be released right away
+  FastPin<BUS_DE_PIN>::low();
+}
+
+/**
+ * Open the bus in receive mode
+ * @param sensorValues latest readings a slave reports, unused on the gateway
+ */
+void busBegin(const float *sensorValues)
+{
+  FastPin<BUS_DE_PIN>::low();
+  FastPin<BUS_DE_PIN>::output();
+  bus.begin(BUS_BAUD);
+  bus.listen();
+  busParserReset(rx);
+
+#if BUS_ROLE == BUS_ROLE_SLAVE
+  busSensorValues = sensorValues;
+#endif
+}
+
+#if BUS_ROLE == BUS_ROLE_SLAVE
+
+/**
+ * Answer a poll addressed to this board with its sensor frame. Call from every wait loop.
+ */
+void busService()
+{
+  while (bus.available()) {
+    if (!busParse(rx, bus.read()) || rx.address != BUS_ADDRESS || rx.type != BUS_TYPE_POLL) {
+      continue;
+    }
+
+    BusSensorFrame frame;
+    frame.zoneCount = ZONE_COUNT;
+    for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+      frame.readings[zone] = busSensorValues[zone] * 16;
+    }
+    frame.pumps = relaysState();
+    frame.faults = pumpFaults();
+
+    uint8_t payload[BUS_MAX_PAYLOAD];
+    busSend(BUS_ADDRESS, BUS_TYPE_DATA, payload, busSensorPayload(payload, frame));
+  }
+}
+
+uint8_t busPollCycle(BusNodeHandler onNode)
+{
+  return 0;
+}
+
+#else
+
+void busService()
+{
+}
+
+/**
+ * Poll the next BUS_NODES_PER_CYCLE slaves, round robin, and hand every answer to onNode.
+ * No new poll starts after BUS_CYCLE_BUDGET_MS, the rest wait for the next cycle.
+ * A slave that does not answer inside BUS_RESPONSE_TIMEOUT is skipped until next round.
+ * @param onNode
+ * @return number of slaves that answered
+ */
+uint8_t busPollCycle(BusNodeHandler onNode)
+{
+  static uint8_t nextAddress = 1;
+  uint8_t answered = 0;
+  unsigned long cycleStart = millis();
+
+  for (uint8_t i = 0; i < BUS_NODES_PER_CYCLE && i < BUS_NODE_COUNT && millis() - cycleStart < BUS_CYCLE_BUDGET_MS; i++) {
+    uint8_t address = nextAddress;
+    nextAddress = nextAddress % BUS_NODE_COUNT + 1;
+
+    bus.listen(); // onNode may have switched SoftwareSerial to the ESP port
+    while (bus.available()) {
+      bus.read();
+    }
+    busParserReset(rx);
+    busSend(address, BUS_TYPE_POLL, NULL, 0);
+
+    BusSensorFrame frame;
+    unsigned long start = millis();
+    boolean received = false;
+    while (!received && millis() - start < BUS_RESPONSE_TIMEOUT) {
+      while (bus.available()) {
+        if (busParse(rx, bus.read()) && rx.address == address && rx.type == BUS_TYPE_DATA) {
+          received = busDecodeSensorFrame(rx, frame);
+          break;
+        }
+      }
+    }
+
+    if (received) {
+      answered++;
+      onNode(address, frame);
+    }
+  }
+
+  return answered;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+/**
+  RS-485 multi-drop bus between one gateway (master) and up to 32 controllers (slaves).
+  Only the master ever starts a transmission: it polls each address in turn and the
+  addressed slave answers inside a fixed response window, so the bus never collides.
+  Frames are 0x7E <address> <type> <length> <payload> <crc8 of address..payload>.
+  A sensor frame carries the zone count, every reading in 1/16 ADC counts, and the pump
+  and fault masks: 5 + 1 + 2 * zones + 4 bytes, 18 bytes for a 4-zone board.
+  Framing and parsing are plain C++ so the host tools can run a whole bus of them.
+*/
+
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define BUS_MAX_ZONES 16 // keeps a frame inside SoftwareSerial's 64 byte RX buffer
+
+#define BUS_SOF         0x7E
+#define BUS_TYPE_POLL   0x01
+#define BUS_TYPE_DATA   0x02
+#define BUS_MAX_PAYLOAD (1 + 2 * BUS_MAX_ZONES + 4)
+#define BUS_MAX_FRAME   (5 + BUS_MAX_PAYLOAD)
+
+// Longest a slave may take to start answering, it only services the bus between tasks
+#define BUS_RESPONSE_TIMEOUT 40 // ms
+// Nodes polled per control cycle, and no new poll once the cycle has taken the budget:
+// forwarding a 16-zone node to the ESP takes 400 ms, eight of them would bring the
+// gateway's loop pass to within 0.6 s of the watchdog period (tools/bus_sim)
+#define BUS_NODES_PER_CYCLE  8
+#define BUS_CYCLE_BUDGET_MS  1000
+
+struct BusSensorFrame {
+  uint8_t zoneCount;
+  uint16_t readings[BUS_MAX_ZONES]; // ADC counts x 16
+  uint16_t pumps;
+  uint16_t faults;
+};
+
+struct BusParser {
+  uint8_t state;
+  uint8_t address;
+  uint8_t type;
+  uint8_t length;
+  uint8_t count;
+  uint8_t crc;
+  uint8_t payload[BUS_MAX_PAYLOAD];
+};
+
+void busParserReset(BusParser &parser);
+bool busParse(BusParser &parser, uint8_t c);
+uint8_t busFrame(uint8_t *frame, uint8_t address, uint8_t type, const uint8_t *payload, uint8_t length);
+uint8_t busSensorPayload(uint8_t *payload, const BusSensorFrame &frame);
+bool busDecodeSensorFrame(const BusParser &parser, BusSensorFrame &frame);
+
+#if defined(ARDUINO)
+typedef void (*BusNodeHandler)(uint8_t address, const BusSensorFrame &frame);
+
+void busBegin(const float *sensorValues);
+void busService();
+uint8_t busPollCycle(BusNodeHandler onNode);
+#endif
+
+#endif
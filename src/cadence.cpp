@@ -0,0 +1,57 @@
+#include "cadence.h"
+
+/**
+ * @param cadence
+ * @param longest ms between samples of a stable zone, at least SAMPLE_MIN_MS
+ */
+void cadenceInit(ZoneCadence &cadence, uint32_t longest)
+{
+  cadence.sampledAt = 0;
+  cadence.interval = 0;
+  cadence.longest = longest;
+  cadence.last = -1;
+}
+
+/**
+ * @param cadence
+ * @param now ms
+ * @return true when the zone must be read
+ */
+bool cadenceDue(const ZoneCadence &cadence, uint32_t now)
+{
+  return cadence.last < 0 || now - cadence.sampledAt >= cadence.interval;
+}
+
+/**
+ * Pick the interval to the next sample from the one just taken
+ * @param cadence
+ * @param reading sensor counts, higher is drier
+ * @param active the zone's pump is requested or running
+ * @param now ms
+ */
+void cadenceUpdate(ZoneCadence &cadence, int reading, bool active, uint32_t now)
+{
+  uint32_t elapsed = now - cadence.sampledAt;
+  int16_t moved = cadence.last < 0 ? 0 : reading - cadence.last;
+
+  int16_t headroom = MOISTURE_THRESHOLD - SAMPLE_NEAR - reading;
+
+  if (cadence.last < 0 || active || moved >= SAMPLE_STEEP || -moved >= SAMPLE_STEEP || headroom <= 0) {
+    cadence.interval = SAMPLE_MIN_MS;
+  } else if (cadence.interval < cadence.longest / 2) {
+    cadence.interval *= 2;
+  } else {
+    cadence.interval = cadence.longest;
+  }
+
+  // Drying towards the threshold: sample again about when the reading gets near it
+  if (moved > 0 && headroom > 0) {
+    uint32_t reach = elapsed * (uint32_t)headroom / (uint32_t)moved;
+    if (reach < cadence.interval) {
+      cadence.interval = reach > SAMPLE_MIN_MS ? reach : SAMPLE_MIN_MS;
+    }
+  }
+
+  cadence.sampledAt = now;
+  cadence.last = reading;
+}
@@ -0,0 +1,31 @@
+/**
+  Adaptive sampling: every zone is read at its own cadence. A zone whose pump is wanted
+  or running, or whose reading moved by SAMPLE_STEEP counts since the last sample, is
+  read every SAMPLE_MIN_MS, and so is a zone within SAMPLE_NEAR counts of
+  MOISTURE_THRESHOLD, where sensor noise decides when a reading first shows it dry.
+  A stable zone backs off exponentially up to a cap (SAMPLE_MAX_MS, or the predictor's
+  sample period when it needs its samples), but never for longer than
+  the drying rate of the last interval needs to bring it near the threshold.
+
+  Plain C++ with no Arduino dependency, so the host simulator runs the same code.
+  One ZoneCadence is 14 bytes.
+*/
+
+#ifndef CADENCE_H
+#define CADENCE_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct ZoneCadence {
+  uint32_t sampledAt; // ms
+  uint32_t interval;  // ms until the next sample
+  uint32_t longest;   // ms, the cap of the back-off
+  int16_t last;       // reading at sampledAt, -1 before the first sample
+};
+
+void cadenceInit(ZoneCadence &cadence, uint32_t longest);
+bool cadenceDue(const ZoneCadence &cadence, uint32_t now);
+void cadenceUpdate(ZoneCadence &cadence, int reading, bool active, uint32_t now);
+
+#endif
@@ -0,0 +1,267 @@
+/**
+  Build-time configuration shared by every module of the irrigation firmware
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+// Number of plants (moisture sensor + relay pairs) handled by this board, up to 32. RELAY_PINS
+// and SENSOR_PINS list four, more zones need the 74HC595 relays and the multiplexed sensors.
+#ifndef ZONE_COUNT
+#define ZONE_COUNT 4
+#endif
+
+// Relay outputs, all relays are active LOW (see relays.h)
+#define RELAY_BACKEND_GPIO 0 // one pin per zone, RELAY_PINS
+#define RELAY_BACKEND_595  1 // daisy-chained 74HC595 on hardware SPI (D11 data, D13 clock)
+#ifndef RELAY_BACKEND
+#define RELAY_BACKEND RELAY_BACKEND_GPIO
+#endif
+
+#define RELAY_PINS { 4, 5, 6, 7 }
+#define RELAY_595_LATCH_PIN 10 // RCLK of every 74HC595 in the chain
+
+// ESP8266 link (SoftwareSerial). D2 and D3 stay free for the interrupt driven features
+// (ADS1115 RDY, flow meters); pins.h rejects any two features sharing a pin.
+#define ESP_RX_PIN 8 // ESP TX
+#define ESP_TX_PIN 9 // ESP RX
+
+// A zone needs water while its reading is above this (the sensor reads higher when drier)
+#define MOISTURE_THRESHOLD 450
+
+// Bit mask with one bit per zone
+#if ZONE_COUNT <= 8
+typedef uint8_t ZoneMask;
+#elif ZONE_COUNT <= 16
+typedef uint16_t ZoneMask;
+#else
+typedef uint32_t ZoneMask;
+#endif
+
+// Moisture sensor acquisition (see sensors.h)
+#define SENSOR_BACKEND_DIRECT  0 // one analog pin per zone, SENSOR_PINS
+#define SENSOR_BACKEND_MUX     1 // CD74HC4067 / CD4051 analog multiplexers, up to two of them
+#define SENSOR_BACKEND_ADS1115 2 // ADS1115 16-bit I2C ADC, one zone per input (up to 4)
+#ifndef SENSOR_BACKEND
+#define SENSOR_BACKEND SENSOR_BACKEND_DIRECT
+#endif
+
+#define SENSOR_PINS { A0, A1, A2, A3 }
+
+#define MUX_CHANNELS     16             // 16 for a CD74HC4067, 8 for a CD4051
+#define MUX_SELECT_PINS  { 4, 5, 6, 7 } // S0..S3, shared by both multiplexers (the mux needs the 74HC595 relays)
+#define MUX_SIGNAL_PINS  { A0, A1 }     // common output of multiplexer 0 and 1
+#define MUX_SETTLE_US    10             // select change to stable output, incl. sensor RC
+
+#define ADS1115_ADDRESS   0x48 // ADDR pin to GND
+#define ADS1115_RDY_PIN   2    // ALERT/RDY, must be an external interrupt pin (2 or 3, INT0/INT1)
+#define ADS1115_DATA_RATE 4    // DR field: 0 = 8 SPS ... 4 = 128 SPS ... 7 = 860 SPS
+
+// Timer1 paced sampling for the direct and mux backends: a compare-match interrupt starts
+// one zone's conversion per tick, so every zone is sampled once per period at exact times
+// whatever the loop is busy with, and the readings are averaged up to each scan
+#ifndef SAMPLE_TIMER_ENABLED
+#define SAMPLE_TIMER_ENABLED false
+#endif
+#define SAMPLE_TIMER_PERIOD_MS 1000UL // every zone once per period, at least 2 ms per zone
+
+#if SAMPLE_TIMER_ENABLED && SENSOR_BACKEND == SENSOR_BACKEND_ADS1115
+#error "the ADS1115 paces its own conversions, SAMPLE_TIMER_ENABLED is for the direct and mux backends"
+#endif
+
+// Adaptive sampling: each zone is read at its own cadence, every loop while it is watered
+// or its reading moves and backing off while it is stable (see cadence.h)
+#ifndef ADAPTIVE_SAMPLING
+#define ADAPTIVE_SAMPLING false
+#endif
+#define SAMPLE_MIN_MS 2000UL   // one pass of the loop
+#define SAMPLE_MAX_MS 120000UL // 2 minutes
+#define SAMPLE_STEEP  8        // counts between two samples that mean the soil is changing, above sensor noise
+#define SAMPLE_NEAR   10       // counts around MOISTURE_THRESHOLD sampled every loop
+
+// Bytes of ESP output held between SoftwareSerial and the log, a power of two
+#define ESP_RX_BUFFER_SIZE 64
+
+// Bytes per log line when DEBUG echoes a telemetry frame, at most LOG_TX_BUFFER_SIZE - 2
+#define FRAME_ECHO_PIECE 64
+
+// Telemetry carries at most this many zones per JSON frame (up to 8)
+#define TELEMETRY_ZONES_PER_FRAME 4
+
+// Zones in every frame; a last frame the zones do not fill repeats zones of the one before
+#if ZONE_COUNT < TELEMETRY_ZONES_PER_FRAME
+#define TELEMETRY_FRAME_ZONES ZONE_COUNT
+#else
+#define TELEMETRY_FRAME_ZONES TELEMETRY_ZONES_PER_FRAME
+#endif
+
+// Report-by-exception: send a zone only when its filtered reading moved more than its
+// deadband or its pump switched, plus every frame as a heartbeat (see report.h)
+#ifndef REPORT_BY_EXCEPTION
+#define REPORT_BY_EXCEPTION false
+#endif
+#define REPORT_DEADBAND     6        // counts, for every zone unless REPORT_DEADBANDS is set
+// #define REPORT_DEADBANDS { 4, 4, 10, 10 } // counts per zone, for probes noisier than others
+#define REPORT_HEARTBEAT_MS 900000UL // 15 minutes
+
+// RS-485 multi-drop bus (MAX485) so many boards share one ESP gateway (see bus.h)
+#define BUS_ROLE_NONE   0 // this board talks to its own ESP
+#define BUS_ROLE_SLAVE  1 // answers polls from the gateway, no ESP fitted
+#define BUS_ROLE_MASTER 2 // gateway: polls the slaves and forwards their frames to its ESP
+#ifndef BUS_ROLE
+#define BUS_ROLE BUS_ROLE_NONE
+#endif
+
+#define BUS_ADDRESS    1     // slave address, 1..BUS_NODE_COUNT
+#define BUS_NODE_COUNT 32    // slaves the gateway polls
+#define BUS_RX_PIN     10    // MAX485 RO (D10..D12 are SPI with the 74HC595 relays: a slave has no ESP, use D8/D9 and D2)
+#define BUS_TX_PIN     11    // MAX485 DI
+#define BUS_DE_PIN     12    // MAX485 DE and /RE tied together
+#define BUS_BAUD       19200
+
+// Set to false for field builds: DEBUG-level log calls are then compiled out
+#define DEBUG true
+
+// Highest log level compiled in (see log.h), can be overridden from build_flags
+#ifndef LOG_LEVEL
+  #if DEBUG
+    #define LOG_LEVEL LOG_LEVEL_DEBUG
+  #else
+    #define LOG_LEVEL LOG_LEVEL_INFO
+  #endif
+#endif
+
+// Stream a compact binary event trace on Serial (decode with tools/trace_decode.py).
+// Shares the port with the text log, so field builds usually pair it with LOG_LEVEL_NONE.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED false
+#endif
+
+// The pumps share one supply: at most PUMP_MAX_ACTIVE run at once and their turn-on
+// edges are spaced so the inrush currents do not add up (see arbiter.h)
+#define PUMP_MAX_ACTIVE 1       // the reference 2 x AA holder browns out with two pumps
+#define PUMP_STAGGER_MS 250UL   // a mini submersible pump's inrush is over well within this
+#define PUMP_SLICE_MS   90000UL // a running pump yields to a waiting zone after this
+
+// Nominal flow of the mini submersible pumps, used to estimate water delivered
+#define PUMP_FLOW_ML_PER_MIN 1500
+
+// Hall-effect flow meters (YF-S201 class) measure the water delivered instead of
+// estimating it from run time, and catch a pump running dry (see flow.h)
+#ifndef FLOW_METERS_ENABLED
+#define FLOW_METERS_ENABLED false
+#endif
+// External interrupt pins (2 or 3, SoftwareSerial owns the pin change interrupts): one meter
+// on the shared supply line, or one per zone. D3 is free in the default pin plan, D2 is
+// ADS1115_RDY_PIN with that backend (pins.h rejects the overlap).
+#define FLOW_METER_PINS       { 3 }
+#define FLOW_PULSES_PER_LITRE 450     // YF-S201: 7.5 Hz per L/min
+#define FLOW_WINDOW_MS        1000UL  // the rate is the pulses of the last FLOW_WINDOWS windows
+#define FLOW_WINDOWS          4
+#define FLOW_MIN_ML_PER_MIN   300     // a running pump moving less than this has no water
+#define FLOW_FAULT_MS         8000UL  // run time before the rate is judged: priming, pipe fill, a full rate span
+
+// Pump current sensing (ACS712 or a shunt amplifier into a spare analog input): a burst of
+// samples right after turn-on and one sample every PUMP_CURRENT_PERIOD_MS while it runs
+// tell a working pump from one running dry or stalled (see pumpcurrent.h)
+#ifndef PUMP_CURRENT_ENABLED
+#define PUMP_CURRENT_ENABLED false
+#endif
+// One sensor on the shared supply line, or one per zone. A4/A5 are the I2C bus of the
+// ADS1115 backend; a Nano has A6 and A7 spare.
+#define PUMP_CURRENT_PINS          { A4 }
+#define PUMP_CURRENT_UA_PER_COUNT  26400UL // ACS712-05B: 185 mV/A at 4.9 mV per count, coarse for pumps this small
+#define PUMP_CURRENT_NOMINAL_MA    220     // a mini submersible pump moving water
+#define PUMP_CURRENT_DRY_PCT       70      // below this share of nominal the pump moves no water
+#define PUMP_CURRENT_RIPPLE_PCT    25      // or it sputters: swings this wide below nominal
+#define PUMP_CURRENT_STALL_PCT     200     // above this it is jammed, near locked-rotor current
+#define PUMP_CURRENT_BURST_SAMPLES 64
+#define PUMP_CURRENT_BURST_US      1000    // at least this between burst samples: relay bounce plus inrush in ~70 ms
+#define PUMP_CURRENT_PERIOD_MS     100UL
+#define PUMP_CURRENT_AVERAGE       8       // readings back to back per running sample
+#define PUMP_CURRENT_CONFIRM       5       // samples in a row before a running pump is faulted
+
+#if PUMP_CURRENT_ENABLED && SAMPLE_TIMER_ENABLED
+#error "SAMPLE_TIMER_ENABLED keeps the ADC to itself, pump current sensing needs it between samples"
+#endif
+
+// Reservoir level: every pump is interlocked off while the reservoir is low, and telemetry
+// reports the water left and the hours until it runs low at the recent use (see reservoir.h)
+#define RESERVOIR_SENSOR_NONE   0
+#define RESERVOIR_SENSOR_FLOAT  1 // float switch at the low mark, closed to GND while above it
+#define RESERVOIR_SENSOR_ANALOG 2 // level sensor with an analog output (pressure, eTape, ultrasonic)
+#ifndef RESERVOIR_SENSOR
+#define RESERVOIR_SENSOR RESERVOIR_SENSOR_NONE
+#endif
+#define RESERVOIR_PIN          A5      // also SCL: move it when the ADS1115 backend is in use
+#define RESERVOIR_CAPACITY_ML  20000UL
+#define RESERVOIR_EMPTY_COUNTS 102     // analog reading with the water at the pump intakes
+#define RESERVOIR_FULL_COUNTS  921     // analog reading at RESERVOIR_CAPACITY_ML
+#define RESERVOIR_LOW_ML       2000UL  // interlock below this, the intakes must stay covered
+#define RESERVOIR_RESUME_ML    3000UL  // release above this once refilled
+#define RESERVOIR_DEBOUNCE_MS  2000UL  // a low or refilled level must hold this long: slosh, a bobbing float
+#define RESERVOIR_SAMPLE_MS    100UL
+#define RESERVOIR_USE_WINDOW_MS 10800000UL // water use per 3 h window, averaged over about a day
+
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_ANALOG && SAMPLE_TIMER_ENABLED
+#error "SAMPLE_TIMER_ENABLED keeps the ADC to itself, an analog reservoir sensor needs it between samples"
+#endif
+
+// Pump counters are checkpointed to EEPROM at most this often (EEPROM endures ~100k writes)
+#define PUMP_CHECKPOINT_INTERVAL 3600000UL // 1 hour
+#define EEPROM_PUMP_STATS_ADDR 0
+
+// A pump must pull the (filtered) moisture reading down by at least this many counts
+// within a window of run time, added up over its stops, otherwise the reservoir is dry
+// or the pump failed and it is locked out (see pumpmonitor.h)
+#define PUMP_RESPONSE_WINDOW   60000UL    // 1 minute of run time
+#define PUMP_RESPONSE_MIN_DROP 20
+#define PUMP_LOCKOUT_RETRY     21600000UL // 6 hours, then the zone gets another try
+// The watering cycle, and with it the window, ends once the zone has not asked for water
+// this long: a dry zone at the threshold drops out for a reading or two between runs
+#define PUMP_RESPONSE_SETTLE   300000UL   // 5 minutes
+// Once the window's run time is used up the pump stays off this long, so the water still
+// on its way to the probe gets judged too: pump start to probe takes up to 40 s, the
+// filter needs another 20 s
+#define PUMP_RESPONSE_LAG      60000UL    // 1 minute
+
+// One pass of the control loop: sample, water, report (up to about 1 s with the ESP
+// replies), then wait LOOP_WAIT_MS running the background work
+#define LOOP_WAIT_MS   2000UL
+#define LOOP_PERIOD_MS (LOOP_WAIT_MS + 1000UL)
+
+// The window adds up run time across slices, but a zone alone on the supply should
+// still be judged within its first slice
+static_assert(PUMP_SLICE_MS > PUMP_RESPONSE_WINDOW + LOOP_PERIOD_MS,
+              "a pump slice must cover a response window plus the loop pass that judges it");
+
+// Predictive pulse watering instead of the plain threshold (see predict.h)
+#ifndef PREDICTIVE_ENABLED
+#define PREDICTIVE_ENABLED false
+#endif
+#define PREDICT_SAMPLE_PERIOD  60000UL // ms between drying-rate samples
+#define PREDICT_FORGETTING     62259   // RLS forgetting factor 0.95, Q16 (~20 min memory)
+#define PREDICT_GUARD          5       // pulse once the prediction is this close, covers sensor noise
+#define PREDICT_TARGET_MARGIN  15      // water down to this many counts below the threshold
+#define PREDICT_DEFAULT_GAIN   128     // counts per second of pumping, Q8 (0.5), until learned
+#define PREDICT_DEFAULT_LAG    20      // seconds, until learned
+#define PREDICT_MIN_PULSE      2000UL  // ms
+#define PREDICT_MAX_PULSE      30000UL // ms
+
+// Pulse-and-soak watering: short bursts with soak pauses instead of running the pump
+// until the probe registers the water (see pulsesoak.h)
+#ifndef PULSE_SOAK_ENABLED
+#define PULSE_SOAK_ENABLED false
+#endif
+#define PULSE_BURST_MS   10000UL  // pump on per burst
+#define PULSE_SOAK_MS    60000UL  // pump off before the zone is judged again, above the diffusion lag
+#define PULSE_MAX_BURSTS 12       // per watering, then the zone rests
+#define PULSE_REST_MS    900000UL // 15 minutes
+
+#if PREDICTIVE_ENABLED && PULSE_SOAK_ENABLED
+#error "PREDICTIVE_ENABLED already waters in pulses, enable only one of the two"
+#endif
+
+#endif
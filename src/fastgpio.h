@@ -0,0 +1,114 @@
+/**
+  Direct port-register GPIO for the ATmega328P (Arduino Uno).
+  Pin numbers are resolved to their PORTx register and bit at compile time, so
+  FastPin<2>::low() is a single cbi instruction instead of a digitalWrite() table walk.
+  FastPortBatch collects several pin levels and applies them with one write per port.
+*/
+
+#ifndef FASTGPIO_H
+#define FASTGPIO_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#define FAST_PORT_D 0 // digital 0..7
+#define FAST_PORT_B 1 // digital 8..13
+#define FAST_PORT_C 2 // A0..A5 (14..19)
+#define FAST_PORT_COUNT 3
+
+constexpr uint8_t fastPinPort(uint8_t pin)
+{
+  return pin < 8 ? FAST_PORT_D : (pin < 14 ? FAST_PORT_B : FAST_PORT_C);
+}
+
+constexpr uint8_t fastPinMask(uint8_t pin)
+{
+  return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+
+inline volatile uint8_t &fastPortRegister(uint8_t port)
+{
+  return port == FAST_PORT_D ? PORTD : (port == FAST_PORT_B ? PORTB : PORTC);
+}
+
+inline volatile uint8_t &fastDdrRegister(uint8_t port)
+{
+  return port == FAST_PORT_D ? DDRD : (port == FAST_PORT_B ? DDRB : DDRC);
+}
+
+inline volatile uint8_t &fastPinRegister(uint8_t port)
+{
+  return port == FAST_PORT_D ? PIND : (port == FAST_PORT_B ? PINB : PINC);
+}
+
+template <uint8_t Pin>
+struct FastPin {
+  static_assert(Pin < 20, "the Uno has digital pins 0..19");
+
+  static const uint8_t port = fastPinPort(Pin);
+  static const uint8_t mask = fastPinMask(Pin);
+
+  // Single bit set/clear on I/O registers is atomic (sbi/cbi), no need to disable interrupts
+  static void high() { fastPortRegister(port) |= mask; }
+  static void low() { fastPortRegister(port) &= ~mask; }
+  static void write(boolean level) { if (level) high(); else low(); }
+  static boolean read() { return fastPinRegister(port) & mask; }
+  static void output() { fastDdrRegister(port) |= mask; }
+  static void input() { fastDdrRegister(port) &= ~mask; }
+};
+
+struct FastPortBatch {
+  uint8_t mask[FAST_PORT_COUNT];
+  uint8_t value[FAST_PORT_COUNT];
+
+  FastPortBatch()
+  {
+    for (uint8_t port = 0; port < FAST_PORT_COUNT; port++) {
+      mask[port] = 0;
+      value[port] = 0;
+    }
+  }
+
+  /**
+   * Queue a pin level
+   * @param pin
+   * @param level
+   */
+  void set(uint8_t pin, boolean level)
+  {
+    mask[fastPinPort(pin)] |= fastPinMask(pin);
+    if (level) {
+      value[fastPinPort(pin)] |= fastPinMask(pin);
+    } else {
+      value[fastPinPort(pin)] &= ~fastPinMask(pin);
+    }
+  }
+
+  /**
+   * One read-modify-write per port that has queued pins, untouched ports are skipped.
+   * Interrupts are held off so an ISR driving another pin of the same port is not undone.
+   */
+  void apply()
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      for (uint8_t port = 0; port < FAST_PORT_COUNT; port++) {
+        if (mask[port]) {
+          volatile uint8_t &reg = fastPortRegister(port);
+          reg = (reg & ~mask[port]) | value[port];
+        }
+      }
+    }
+  }
+
+  /**
+   * Make every queued pin an output
+   */
+  void output()
+  {
+    for (uint8_t port = 0; port < FAST_PORT_COUNT; port++) {
+      fastDdrRegister(port) |= mask[port];
+    }
+  }
+};
+
+#endif
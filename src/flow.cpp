@@ -0,0 +1,197 @@
+#include "flow.h"
+
+static_assert(FLOW_FAULT_MS >= (FLOW_WINDOWS + 1) * FLOW_WINDOW_MS,
+              "FLOW_FAULT_MS must span the rate windows, or a pump is judged on the one before it");
+
+/**
+ * @param meter
+ * @param count current interrupt counter
+ * @param now ms
+ */
+void flowMeterInit(FlowMeter &meter, uint16_t count, uint32_t now)
+{
+  meter.counted = count;
+  meter.current = 0;
+  for (uint8_t i = 0; i < FLOW_WINDOWS; i++) {
+    meter.windows[i] = 0;
+  }
+  meter.index = 0;
+  meter.windowStart = now;
+  meter.updated = now;
+}
+
+/**
+ * Take the pulses counted since the previous update and close the windows that ended.
+ * The counter may wrap between updates, not twice.
+ * @param meter
+ * @param count current interrupt counter
+ * @param now ms
+ * @return new pulses
+ */
+uint16_t flowMeterUpdate(FlowMeter &meter, uint16_t count, uint32_t now)
+{
+  uint16_t pulses = count - meter.counted;
+  meter.counted = count;
+
+  uint32_t elapsed = now - meter.windowStart;
+  if (elapsed >= FLOW_WINDOWS * FLOW_WINDOW_MS) {
+    // Not updated for a whole span: everything counted lands in the newest window
+    for (uint8_t i = 0; i < FLOW_WINDOWS; i++) {
+      meter.windows[i] = 0;
+    }
+    meter.windows[meter.index] = meter.current + pulses;
+    meter.index = (meter.index + 1) % FLOW_WINDOWS;
+    meter.current = 0;
+    meter.windowStart = now - elapsed % FLOW_WINDOW_MS;
+    meter.updated = now;
+    return pulses;
+  }
+
+  // The pulses came in evenly since the previous update: a window that closed in between
+  // gets the share from before its end, not a whole stalled loop's worth
+  uint16_t left = pulses;
+  uint32_t from = meter.updated;
+  while (now - meter.windowStart >= FLOW_WINDOW_MS) {
+    uint32_t end = meter.windowStart + FLOW_WINDOW_MS;
+    uint16_t share = (uint32_t)left * (end - from) / (now - from);
+    meter.windows[meter.index] = meter.current + share;
+    meter.index = (meter.index + 1) % FLOW_WINDOWS;
+    meter.current = 0;
+    meter.windowStart = end;
+    left -= share;
+    from = end;
+  }
+  meter.current += left;
+  meter.updated = now;
+  return pulses;
+}
+
+/**
+ * @param meter
+ * @return mL/min over the closed windows
+ */
+uint32_t flowMeterRate(const FlowMeter &meter)
+{
+  uint32_t pulses = 0;
+  for (uint8_t i = 0; i < FLOW_WINDOWS; i++) {
+    pulses += meter.windows[i];
+  }
+  return pulses * (60000.0f * 1000.0f / ((float)FLOW_PULSES_PER_LITRE * FLOW_WINDOWS * FLOW_WINDOW_MS));
+}
+
+/**
+ * @param pulses
+ * @return the water they stand for
+ */
+uint32_t flowMillilitres(uint32_t pulses)
+{
+  // Split litres and the rest so years of pulses cannot overflow 32 bits
+  return pulses / FLOW_PULSES_PER_LITRE * 1000 + pulses % FLOW_PULSES_PER_LITRE * 1000 / FLOW_PULSES_PER_LITRE;
+}
+
+#if defined(ARDUINO) && FLOW_METERS_ENABLED
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "pumps.h"
+#include "pumpmonitor.h"
+#include "log.h"
+#include "trace.h"
+
+static const uint8_t flowPins[] = FLOW_METER_PINS;
+
+#define FLOW_METER_COUNT (sizeof(flowPins) / sizeof(flowPins[0]))
+#define FLOW_SHARED      (FLOW_METER_COUNT != ZONE_COUNT)
+
+static_assert(FLOW_METER_COUNT <= 2, "the Uno has two external interrupts");
+static_assert(FLOW_METER_COUNT == ZONE_COUNT || (FLOW_METER_COUNT == 1 && PUMP_MAX_ACTIVE == 1),
+              "one meter per zone, or one shared meter with a single pump running at a time");
+
+static volatile uint16_t flowPulses[2]; // written by the interrupts only
+static FlowMeter meters[FLOW_METER_COUNT];
+static ZoneMask flowRunning = 0;
+static uint32_t flowRunningSince[ZONE_COUNT];
+
+static void flowPulse0()
+{
+  flowPulses[0]++;
+}
+
+static void flowPulse1()
+{
+  flowPulses[1]++;
+}
+
+/**
+ * Attach the counters; the meters' open-collector outputs need the pull-ups
+ */
+void flowBegin()
+{
+  static void (*const handlers[2])() = { flowPulse0, flowPulse1 };
+
+  for (uint8_t meter = 0; meter < FLOW_METER_COUNT; meter++) {
+    pinMode(flowPins[meter], INPUT_PULLUP);
+    flowMeterInit(meters[meter], 0, millis());
+    attachInterrupt(digitalPinToInterrupt(flowPins[meter]), handlers[meter], FALLING);
+  }
+}
+
+/**
+ * Credit the new pulses to the pumps that ran since the previous call and lock out a pump
+ * that runs without flow. Call often (from every wait loop) with the pump states.
+ * @param running bit n set while pump n runs
+ */
+void flowUpdate(ZoneMask running)
+{
+  uint32_t now = millis();
+
+  for (uint8_t meter = 0; meter < FLOW_METER_COUNT; meter++) {
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      count = flowPulses[meter];
+    }
+    uint16_t pulses = flowMeterUpdate(meters[meter], count, now);
+
+    // A shared meter's pulses belong to the one pump that ran, none while all were off
+    ZoneMask served = FLOW_SHARED ? flowRunning : (flowRunning & bit(meter));
+    for (uint8_t zone = 0; zone < ZONE_COUNT && pulses; zone++) {
+      if (bitRead(served, zone)) {
+        pumpsFlow(zone, pulses);
+        pulses = 0;
+      }
+    }
+  }
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(running, zone)) {
+      continue;
+    }
+    if (!bitRead(flowRunning, zone)) {
+      flowRunningSince[zone] = now;
+      continue;
+    }
+    if (now - flowRunningSince[zone] < FLOW_FAULT_MS || pumpLockedOut(zone)) {
+      continue;
+    }
+
+    uint32_t rate = flowRate(zone);
+    if (rate < FLOW_MIN_ML_PER_MIN) {
+      pumpLockOut(zone);
+      LOG_WARN("Plant %d - no flow (%lu mL/min), pump locked out", zone + 1, (unsigned long)rate);
+      TRACE(TRACE_EVENT_PUMP_FAULT, zone << 8 | PUMP_FAULT_NO_FLOW);
+    }
+  }
+  flowRunning = running;
+}
+
+/**
+ * @param zone
+ * @return mL/min through the zone's pump, 0 while a shared meter serves another zone
+ */
+uint32_t flowRate(uint8_t zone)
+{
+  if (FLOW_SHARED) {
+    return bitRead(flowRunning, zone) ? flowMeterRate(meters[0]) : 0;
+  }
+  return flowMeterRate(meters[zone]);
+}
+#endif
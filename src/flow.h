@@ -0,0 +1,43 @@
+/**
+  Hall-effect flow meters (YF-S201 class): every pulse is 1/FLOW_PULSES_PER_LITRE of a
+  litre. An external interrupt counts the pulses; flowUpdate() takes the new ones from
+  loop(), credits them to the zone whose pump moved them (the totalizers are part of the
+  pump counters, see pumps.h) and keeps the rate over the last FLOW_WINDOWS windows of
+  FLOW_WINDOW_MS. A pump that has run FLOW_FAULT_MS and moves less than
+  FLOW_MIN_ML_PER_MIN has no water (dry reservoir, failed pump, blocked line) and is
+  locked out like a pump whose zone does not respond (see pumpmonitor.h).
+
+  One meter on the supply line serves every zone when only one pump runs at a time
+  (PUMP_MAX_ACTIVE 1), otherwise each zone needs its own. The Uno has two external
+  interrupts (pins 2 and 3); pin-change interrupts are not an option because
+  SoftwareSerial defines every PCINT vector.
+  The windowed rate is plain C++ so the host tools can feed it simulated pulse trains.
+*/
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct FlowMeter {
+  uint16_t counted;               // interrupt counter at the previous update
+  uint16_t current;               // pulses in the open window
+  uint16_t windows[FLOW_WINDOWS]; // closed windows, the oldest is overwritten next
+  uint8_t index;
+  uint32_t windowStart;
+  uint32_t updated;               // ms of the previous update
+};
+
+void flowMeterInit(FlowMeter &meter, uint16_t count, uint32_t now);
+uint16_t flowMeterUpdate(FlowMeter &meter, uint16_t count, uint32_t now);
+uint32_t flowMeterRate(const FlowMeter &meter);
+uint32_t flowMillilitres(uint32_t pulses);
+
+#if defined(ARDUINO) && FLOW_METERS_ENABLED
+void flowBegin();
+void flowUpdate(ZoneMask running);
+uint32_t flowRate(uint8_t zone);
+#endif
+
+#endif
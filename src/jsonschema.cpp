@@ -0,0 +1,32 @@
+#include "jsonschema.h"
+
+/**
+ * Copy a skeleton from flash, formatting the next value at every placeholder
+ * @param out at least jsonMaxLength(skeleton) bytes
+ * @param skeleton PROGMEM
+ * @param values one per placeholder, in order
+ * @return the terminating NUL written to out, to append another skeleton
+ */
+char *jsonFill(char *out, const char *skeleton, const JsonValue *values)
+{
+  for (char c; (c = pgm_read_byte(skeleton)); skeleton++) {
+    switch (c) {
+      case JSON_TYPE_UINT:
+        ultoa(values->u, out, 10);
+        break;
+      case JSON_TYPE_INT:
+        ltoa(values->i, out, 10);
+        break;
+      case JSON_TYPE_FLOAT:
+        dtostrf(values->f, 1, 2, out);
+        break;
+      default:
+        *out++ = c;
+        continue;
+    }
+    values++;
+    out += strlen(out);
+  }
+  *out = '\0';
+  return out;
+}
@@ -0,0 +1,77 @@
+/**
+  Schema-driven JSON encoder: a frame is a flash string holding the whole JSON skeleton
+  (keys, separators, brackets) with a one-byte placeholder per value, all assembled at
+  compile time by string literal concatenation. At runtime jsonFill() copies the skeleton
+  and formats only the values into place; no document tree, no key building.
+
+  Placeholders are typed (JSON_UINT, JSON_INT, JSON_FLOAT) and must stay separate
+  literals so a following hex digit is never read as part of the escape. Field count and
+  worst-case length are constexpr, so value arrays and output buffers are sized at
+  compile time:
+
+    static constexpr char frame[] PROGMEM = "{\"a\":" JSON_UINT ",\"b\":\"" JSON_FLOAT "\"}";
+    JsonValue values[jsonFieldCount(frame)];
+    char out[jsonMaxLength(frame)];
+*/
+
+#ifndef JSONSCHEMA_H
+#define JSONSCHEMA_H
+
+#include <Arduino.h>
+
+#define JSON_TYPE_UINT  1 // uint32_t, decimal
+#define JSON_TYPE_INT   2 // int32_t, decimal
+#define JSON_TYPE_FLOAT 3 // float with two decimals like String(float), |value| < 1e7
+
+#define JSON_UINT  "\x01"
+#define JSON_INT   "\x02"
+#define JSON_FLOAT "\x03"
+
+// item repeated count times with sep in between, count a literal or a macro expanding to one
+#define JSON_REPEAT(count, item, sep) JSON_REPEAT_EXPAND(count, item, sep)
+#define JSON_REPEAT_EXPAND(count, item, sep) JSON_REPEAT_##count(item, sep)
+#define JSON_REPEAT_1(item, sep) item
+#define JSON_REPEAT_2(item, sep) JSON_REPEAT_1(item, sep) sep item
+#define JSON_REPEAT_3(item, sep) JSON_REPEAT_2(item, sep) sep item
+#define JSON_REPEAT_4(item, sep) JSON_REPEAT_3(item, sep) sep item
+#define JSON_REPEAT_5(item, sep) JSON_REPEAT_4(item, sep) sep item
+#define JSON_REPEAT_6(item, sep) JSON_REPEAT_5(item, sep) sep item
+#define JSON_REPEAT_7(item, sep) JSON_REPEAT_6(item, sep) sep item
+#define JSON_REPEAT_8(item, sep) JSON_REPEAT_7(item, sep) sep item
+
+union JsonValue {
+  uint32_t u;
+  int32_t i;
+  float f;
+};
+
+/**
+ * @param c skeleton character
+ * @return most characters it can expand to
+ */
+constexpr uint8_t jsonWidth(char c)
+{
+  return c == JSON_TYPE_UINT ? 10 : (c == JSON_TYPE_INT ? 11 : (c == JSON_TYPE_FLOAT ? 11 : 1));
+}
+
+/**
+ * @param skeleton
+ * @return number of placeholders
+ */
+constexpr uint8_t jsonFieldCount(const char *skeleton)
+{
+  return *skeleton ? (jsonWidth(*skeleton) > 1) + jsonFieldCount(skeleton + 1) : 0;
+}
+
+/**
+ * @param skeleton
+ * @return buffer size that holds any fill of the skeleton, terminator included
+ */
+constexpr size_t jsonMaxLength(const char *skeleton)
+{
+  return *skeleton ? jsonWidth(*skeleton) + jsonMaxLength(skeleton + 1) : 1;
+}
+
+char *jsonFill(char *out, const char *skeleton, const JsonValue *values);
+
+#endif
@@ -0,0 +1,97 @@
+#include "log.h"
+#include <stdio.h>
+
+#define LOG_TX_BUFFER_MASK (LOG_TX_BUFFER_SIZE - 1)
+
+static char txBuffer[LOG_TX_BUFFER_SIZE];
+static uint16_t txHead = 0; // free-running write index, only masked on access
+static uint16_t txTail = 0; // free-running read index
+static bool txOverflow = false;
+static unsigned int txDropped = 0;
+
+static FILE logStream;
+
+/**
+ * stdio put hook: append one character to the TX ring, flag the message if it does not fit
+ * @param c
+ * @param stream
+ * @return
+ */
+static int logPutChar(char c, FILE *stream)
+{
+  if ((uint16_t)(txHead - txTail) >= LOG_TX_BUFFER_SIZE) {
+    txOverflow = true;
+    return 0;
+  }
+
+  txBuffer[txHead & LOG_TX_BUFFER_MASK] = c;
+  txHead++;
+
+  return 0;
+}
+
+/**
+ * Open the serial port and attach the formatter to the TX ring
+ * @param baud
+ */
+void logBegin(unsigned long baud)
+{
+  Serial.begin(baud);
+  fdev_setup_stream(&logStream, logPutChar, NULL, _FDEV_SETUP_WRITE);
+}
+
+/**
+ * Format one line from a PROGMEM format string into the TX ring.
+ * A line that does not fit is dropped whole rather than truncated.
+ * @param format
+ */
+void logPrintf_P(const char *format, ...)
+{
+  uint16_t start = txHead;
+  txOverflow = false;
+
+  va_list args;
+  va_start(args, format);
+  vfprintf_P(&logStream, format, args);
+  va_end(args);
+
+  logPutChar('\r', &logStream);
+  logPutChar('\n', &logStream);
+
+  if (txOverflow) {
+    txHead = start;
+    txDropped++;
+  }
+
+  logFlush();
+}
+
+/**
+ * Move as many bytes from the TX ring to the UART as it can take without blocking
+ */
+void logFlush()
+{
+  int room = Serial.availableForWrite();
+
+  while (room > 0 && txTail != txHead) {
+    Serial.write(txBuffer[txTail & LOG_TX_BUFFER_MASK]);
+    txTail++;
+    room--;
+  }
+}
+
+/**
+ * @return bytes a line can take in the TX ring right now, its CR LF included
+ */
+unsigned int logRoom()
+{
+  return LOG_TX_BUFFER_SIZE - (uint16_t)(txHead - txTail);
+}
+
+/**
+ * @return number of lines dropped because the TX ring was full
+ */
+unsigned int logDroppedCount()
+{
+  return txDropped;
+}
@@ -0,0 +1,67 @@
+/**
+  Leveled logging with flash-resident format strings.
+  Messages are formatted into a RAM ring buffer and drained to Serial only as fast
+  as the hardware UART can take them, so a log call never blocks the control loop.
+  Levels above LOG_LEVEL expand to nothing: their arguments are not even evaluated.
+*/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// TX ring size in bytes, must be a power of two no larger than 256, and hold the longest
+// line. Each line also moves on into the UART's own 64 B buffer at once, so a field
+// cycle's ~130 B of INFO lines fit 64 B. A DEBUG telemetry frame (~200 B) fits neither,
+// main.cpp echoes it in pieces as the log drains.
+#ifndef LOG_TX_BUFFER_SIZE
+  #if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    #define LOG_TX_BUFFER_SIZE 128
+  #else
+    #define LOG_TX_BUFFER_SIZE 64
+  #endif
+#endif
+
+// The frame echo logs at DEBUG only, each piece must fit the ring with its "\r\n"
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+static_assert(FRAME_ECHO_PIECE <= LOG_TX_BUFFER_SIZE - 2, "FRAME_ECHO_PIECE must fit LOG_TX_BUFFER_SIZE with the line end");
+#endif
+
+void logBegin(unsigned long baud);
+void logPrintf_P(const char *format, ...);
+void logFlush();
+unsigned int logRoom();
+unsigned int logDroppedCount();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_ERROR(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_WARN(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_WARN(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_INFO(format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_DEBUG(format, ...) do {} while (0)
+#endif
+
+#endif
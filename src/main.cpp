@@ -5,176 +5,516 @@
 */
 
 #include <Arduino.h>
-#include <ArduinoJson.h> // https://github.com/bblanchon/ArduinoJson (use v6.xx)
 #include <SoftwareSerial.h>
-
-#define DEBUG true
-
-// ESP TX => Uno Pin 2
-// ESP RX => Uno Pin 3
-SoftwareSerial wifi(2, 3);
+#include "config.h"
+#include "log.h"
+#include "trace.h"
+#include "watchdog.h"
+#include "pumps.h"
+#include "pumpmonitor.h"
+#include "sensors.h"
+#include "relays.h"
+#include "bus.h"
+#include "predict.h"
+#include "pulsesoak.h"
+#include "arbiter.h"
+#include "telemetry.h"
+#include "report.h"
+#include "cadence.h"
+#include "uptime.h"
+#include "timerwheel.h"
+#include "ring.h"
+#include "flow.h"
+#include "pumpcurrent.h"
+#include "reservoir.h"
+#include "pins.h"
+
+// ESP TX => Uno Pin 8 (ESP_RX_PIN)
+// ESP RX => Uno Pin 9 (ESP_TX_PIN), see config.h
+SoftwareSerial wifi(ESP_RX_PIN, ESP_TX_PIN);
 
 // **************
-String sendDataToWiFiBoard(String command, const int timeout, boolean debug);
-String prepareDataForWiFi(float sensor1Value, float sensor2Value, float sensor3Value, float sensor4Value);
+void sendDataToWiFiBoard(String command, const int timeout, boolean debug, boolean echo = false);
+uint16_t echoFrame(const String &frame, uint16_t echoed, boolean whenRoom);
+uint16_t receiveFromWiFiBoard(boolean debug);
+void logWiFiOutput(boolean debug);
+void setPump(uint8_t zone, boolean on);
+boolean pumpHeld(uint8_t zone);
+void waterPlant(uint8_t zone, float moisture);
+void applyPumpGrants();
+void serviceBackground();
+void endPumpBursts();
+ZoneMask zonesToSample();
+void sendTelemetry(const float *values);
+void reportTelemetry();
+void forwardNodeToWiFi(uint8_t address, const BusSensorFrame &frame);
 void setup();
 void loop();
 // **************
 
-int IN1 = 2;
-int IN2 = 3;
-int IN3 = 4;
-int IN4 = 5;
+float sensorValues[ZONE_COUNT];
 
-int Pin1 = A0;
-int Pin2 = A1;
-int Pin3 = A2;
-int Pin4 = A3;
+#if PREDICTIVE_ENABLED
+ZonePredictor predictors[ZONE_COUNT];
+#endif
 
-float sensor1Value = 0;
-float sensor2Value = 0;
-float sensor3Value = 0;
-float sensor4Value = 0;
+#if PULSE_SOAK_ENABLED
+PulseSoak pulseSoak[ZONE_COUNT];
+#endif
 
-/**
- * Build and return a JSON document from the sensor data
- * @param sensor1Value
- * @param sensor2Value
- * @param sensor3Value
- * @param sensor4Value
- * @return
- */
-String prepareDataForWiFi(float sensor1Value, float sensor2Value, float sensor3Value, float sensor4Value)
-{
-  StaticJsonDocument<200> doc;
+// What the ESP sends, collected off SoftwareSerial without heap appends
+Ring<char, ESP_RX_BUFFER_SIZE> espRx;
 
-  doc["sensor1Value"] = String(sensor1Value);
-  doc["sensor2Value"] = String(sensor2Value);
-  doc["sensor3Value"] = String(sensor3Value);
-  doc["sensor4Value"] = String(sensor4Value);
+// Every wait of the loop runs on the wheel, serviced from serviceBackground()
+TimerWheel timers;
+Timer espTimer;  // ESP response and drain windows
+Timer loopTimer; // pacing of the control loop
 
-  char jsonBuffer[512];
-  serializeJson(doc, jsonBuffer);
+// Zones that want water; the arbiter decides which pumps actually run
+ZoneMask pumpRequests = 0;
+PumpArbiter arbiter;
 
-  return jsonBuffer;
-}
+#if ADAPTIVE_SAMPLING
+ZoneCadence cadences[ZONE_COUNT];
+#endif
+
+#if REPORT_BY_EXCEPTION
+#ifdef REPORT_DEADBANDS
+const uint8_t reportDeadbands[ZONE_COUNT] = REPORT_DEADBANDS;
+#endif
+ZoneReport reports[ZONE_COUNT];
+Timer heartbeatTimer; // not pending at boot, so the first cycle sends every frame
+ZoneMask reportedFaults;
+#endif
 
 /**
  * Send data through Serial to ESP8266 module
  * @param command
  * @param timeout
  * @param debug
- * @return
+ * @param echo log the command while waiting for the ESP
  */
-String sendDataToWiFiBoard(String command, const int timeout, boolean debug)
+void sendDataToWiFiBoard(String command, const int timeout, boolean debug, boolean echo)
 {
-  String response = "";
+  uint16_t received = 0;
+  uint16_t echoed = echo ? 0 : command.length();
 
+#if BUS_ROLE == BUS_ROLE_MASTER
+  wifi.listen(); // the bus shares SoftwareSerial's single receiver
+#endif
   wifi.print(command); // send the read character to the esp8266
+  TRACE(TRACE_EVENT_ESP_TX, command.length());
 
-  long int time = millis();
+  timerStart(timers, espTimer, uptimeMs(), timeout);
 
-  while((time+timeout) > millis()) {
-    while(wifi.available()) {
-      // The esp has data so display its output to the serial window
-      char c = wifi.read(); // read the next character.
-      response+=c;
-    }
+  while(timerPending(espTimer)) {
+    received += receiveFromWiFiBoard(debug);
+    echoed = echoFrame(command, echoed, true);
+    serviceBackground();
   }
+  TRACE(TRACE_EVENT_ESP_RX, received);
+
+  echoFrame(command, echoed, false);
+  logWiFiOutput(debug);
+}
 
-  if (debug) {
-    Serial.print(response);
+/**
+ * Log a frame FRAME_ECHO_PIECE bytes per line: it is longer than the log's TX ring plus
+ * the UART buffer, so it goes out a piece at a time as the wait drains the log
+ * @param frame
+ * @param echoed bytes of the frame already logged
+ * @param whenRoom stop at the first piece the TX ring has no room for yet
+ * @return bytes of the frame logged now
+ */
+uint16_t echoFrame(const String &frame, uint16_t echoed, boolean whenRoom)
+{
+  while (echoed < frame.length()) {
+    uint16_t count = min(frame.length() - echoed, (unsigned int)FRAME_ECHO_PIECE);
+    if (whenRoom && logRoom() < count + 2U) {
+      break;
+    }
+    LOG_DEBUG("%.*s", count, frame.c_str() + echoed);
+    echoed += count;
   }
+  return echoed;
+}
+
+/**
+ * Move what the ESP sent from SoftwareSerial straight into espRx. When espRx is full
+ * its oldest run is logged and dropped to make room.
+ * @param debug
+ * @return bytes received
+ */
+uint16_t receiveFromWiFiBoard(boolean debug)
+{
+  uint16_t received = 0;
+
+  while (wifi.available()) {
+    char *span;
+    uint8_t room = espRx.reserve(span);
+    if (room == 0) {
+      const char *oldest;
+      uint8_t count = espRx.peek(oldest);
+      if (debug) {
+        LOG_DEBUG("%.*s", count, oldest);
+      }
+      espRx.consume(count);
+      continue;
+    }
 
-  return response;
+    uint8_t count = 0;
+    while (count < room && wifi.available()) {
+      span[count++] = wifi.read();
+    }
+    espRx.commit(count);
+    received += count;
+  }
+  return received;
 }
 
-void setup() {
-  Serial.begin(9600);
+/**
+ * Log what the ESP sent, straight from espRx, and empty it
+ * @param debug
+ */
+void logWiFiOutput(boolean debug)
+{
+  const char *span;
+  uint8_t count;
 
-  pinMode(IN1, OUTPUT);
-  pinMode(IN2, OUTPUT);
-  pinMode(IN3, OUTPUT);
-  pinMode(IN4, OUTPUT);
+  while ((count = espRx.peek(span)) > 0) {
+    if (debug) {
+      LOG_DEBUG("%.*s", count, span);
+    }
+    espRx.consume(count);
+  }
+}
 
-  pinMode(Pin1, INPUT);
-  pinMode(Pin2, INPUT);
-  pinMode(Pin3, INPUT);
-  pinMode(Pin4, INPUT);
+/**
+ * Request a pump state and account for the transition when it changes.
+ * The relay itself switches on the next relaysFlush().
+ * @param zone
+ * @param on
+ */
+void setPump(uint8_t zone, boolean on)
+{
+  if (bitRead(relaysState(), zone) != on) {
+    relaySet(zone, on);
+    pumpsUpdate(zone, on);
+    TRACE(TRACE_EVENT_RELAY, zone << 8 | on);
+  }
+}
 
-  digitalWrite(IN1, HIGH);
-  digitalWrite(IN2, HIGH);
-  digitalWrite(IN3, HIGH);
-  digitalWrite(IN4, HIGH);
+/**
+ * @param zone
+ * @return true while the zone's pump may not run: locked out, or the reservoir is low
+ */
+boolean pumpHeld(uint8_t zone)
+{
+#if RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+  if (reservoirStatus().interlocked) {
+    return true;
+  }
+#endif
+  return pumpLockedOut(zone);
+}
 
-  delay(500);
+/**
+ * Ask for water for a dry plant unless the response monitor locked its pump out
+ * @param zone
+ * @param moisture
+ */
+void waterPlant(uint8_t zone, float moisture)
+{
+#if PREDICTIVE_ENABLED
+  boolean thirsty = predictorUpdate(predictors[zone], moisture, pumpOnMs(zone), pumpHeld(zone), millis());
+  boolean watering = thirsty || predictors[zone].state != PREDICT_IDLE;
+#elif PULSE_SOAK_ENABLED
+  boolean thirsty = pulseSoakUpdate(pulseSoak[zone], moisture > MOISTURE_THRESHOLD && !pumpHeld(zone),
+                                    bitRead(relaysState(), zone), millis());
+  boolean watering = thirsty || pulseSoak[zone].state != PULSE_IDLE;
+#else
+  boolean thirsty = moisture > MOISTURE_THRESHOLD;
+  boolean watering = thirsty;
+#endif
+  // The response window spans the whole watering cycle, pulses and soaks included
+  pumpMonitorSample(zone, moisture, watering);
+  bitWrite(pumpRequests, zone, thirsty && !pumpLockedOut(zone));
 }
 
-void loop() {
+/**
+ * Switch the pumps to what the arbiter grants for the current requests, none while the
+ * reservoir is low
+ */
+void applyPumpGrants()
+{
+  // A lockout between two scans (flow, current) withdraws the request at once
+  ZoneMask requests = pumpRequests & ~pumpFaults();
+#if RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+  if (reservoirService()) {
+    requests = 0;
+  }
+#endif
+  ZoneMask granted = arbiterUpdate(arbiter, requests, millis());
 
-  if (DEBUG == true) {
-    Serial.print("buffer: ");
-    if (wifi.available()) {
-      String espBuf;
-      long int time = millis();
-
-      while((time+1000) > millis()) {
-        while (wifi.available()) {
-          // The esp has data so display its output to the serial window
-          char c = wifi.read(); // read the next character.
-          espBuf += c;
-        }
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    setPump(zone, bitRead(granted, zone));
+  }
+  relaysFlush();
+
+#if PUMP_CURRENT_ENABLED
+  // Right after the switch, so a turn-on burst starts with the relay closing
+  ZoneMask faulted = currentUpdate(relaysState());
+  if (faulted) {
+    // A pump running dry or stalled goes off now, the arbiter drops its grant next pass
+    for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+      if (bitRead(faulted, zone)) {
+        setPump(zone, false);
       }
-      Serial.print(espBuf);
     }
-    Serial.println(" endbuffer");
+    relaysFlush();
+  }
+#endif
+}
+
+/**
+ * Non-blocking housekeeping, called from every wait loop: expire due timers, drain the
+ * log and trace buffers, collect background sensor conversions and flow meter pulses
+ */
+void serviceBackground()
+{
+  timerWheelAdvance(timers, uptimeMs());
+  logFlush();
+  TRACE_FLUSH();
+  sensorsPoll();
+#if BUS_ROLE == BUS_ROLE_SLAVE
+  busService();
+#endif
+#if PULSE_SOAK_ENABLED || PREDICTIVE_ENABLED
+  endPumpBursts();
+#endif
+#if FLOW_METERS_ENABLED
+  flowUpdate(relaysState());
+#endif
+  applyPumpGrants();
+}
+
+#if PULSE_SOAK_ENABLED || PREDICTIVE_ENABLED
+/**
+ * Withdraw the requests of zones whose burst or pulse is over. Runs between samples, so
+ * a burst lasts PULSE_BURST_MS and a pulse its planned length however long the rest of
+ * the loop takes
+ */
+void endPumpBursts()
+{
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(pumpRequests, zone)) {
+      continue;
+    }
+#if PREDICTIVE_ENABLED
+    boolean more = predictorTick(predictors[zone], pumpOnMs(zone), millis());
+#else
+    boolean more = pulseSoakTick(pulseSoak[zone], bitRead(relaysState(), zone), millis());
+#endif
+    if (!more) {
+      bitClear(pumpRequests, zone);
+    }
+  }
+}
+#endif
+
+/**
+ * @return bit n set when zone n is read this cycle
+ */
+ZoneMask zonesToSample()
+{
+#if ADAPTIVE_SAMPLING
+  ZoneMask due = 0;
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    bitWrite(due, zone, cadenceDue(cadences[zone], millis()));
   }
+  return due;
+#else
+  return (ZoneMask)~0;
+#endif
+}
 
-  Serial.print("Plant 1 - Moisture Level:");
-  sensor1Value = analogRead(Pin1);
-  Serial.println(sensor1Value);
+/**
+ * Send every zone to the ESP, TELEMETRY_ZONES_PER_FRAME zones per frame
+ * @param values one reading per zone
+ */
+void sendTelemetry(const float *values)
+{
+  for (uint8_t first = 0; first < ZONE_COUNT; first += TELEMETRY_ZONES_PER_FRAME) {
+    String preparedData = prepareDataForWiFi(values, first);
 
-  if (sensor1Value > 450) {
-    digitalWrite(IN1, LOW);
-  } else {
-    digitalWrite(IN1, HIGH);
+    // Only the last frame waits the full second for the ESP, the watchdog allows 8 s per cycle
+    boolean lastFrame = first + TELEMETRY_ZONES_PER_FRAME >= ZONE_COUNT;
+    sendDataToWiFiBoard(preparedData, lastFrame ? 1000 : 250, DEBUG, DEBUG);
   }
+}
 
-  Serial.print("Plant 2 - Moisture Level:");
-  sensor2Value = analogRead(Pin2);
-  Serial.println(sensor2Value);
+#if REPORT_BY_EXCEPTION
+/**
+ * Send the zones whose filtered reading left the deadband or whose pump switched, or
+ * every frame when the heartbeat is due or a pump fault came or went
+ */
+void reportTelemetry()
+{
+  ZoneMask due = 0;
+  float values[ZONE_COUNT];
 
-  if (sensor2Value > 450) {
-    digitalWrite(IN2, LOW);
-  } else {
-    digitalWrite(IN2, HIGH);
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    bitWrite(due, zone, reportUpdate(reports[zone], sensorValues[zone], bitRead(relaysState(), zone)));
+    values[zone] = reportValue(reports[zone]);
   }
 
-  Serial.print("Plant 3 - Moisture Level:");
-  sensor3Value = analogRead(Pin3);
-  Serial.println(sensor3Value);
+  if (!timerPending(heartbeatTimer) || pumpFaults() != reportedFaults) {
+    sendTelemetry(values);
+    for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+      reportSent(reports[zone]);
+    }
+    timerStart(timers, heartbeatTimer, uptimeMs(), REPORT_HEARTBEAT_MS);
+    reportedFaults = pumpFaults();
+    return;
+  }
 
-  if (sensor3Value > 450) {
-    digitalWrite(IN3, LOW);
-  } else {
-    digitalWrite(IN3, HIGH);
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(due, zone)) {
+      continue;
+    }
+    String preparedData = prepareZoneForWiFi(values[zone], zone);
+
+    boolean lastFrame = (due >> zone) == 1;
+    sendDataToWiFiBoard(preparedData, lastFrame ? 1000 : 250, DEBUG, DEBUG);
+    reportSent(reports[zone]);
   }
+}
+#endif
 
-  Serial.print("Plant 4 - Moisture Level:");
-  sensor4Value = analogRead(Pin4);
-  Serial.println(sensor4Value);
+#if BUS_ROLE == BUS_ROLE_MASTER
+/**
+ * Forward the sensor frame of a bus node to the ESP, shaped like our own frames plus "node"
+ * @param address
+ * @param frame
+ */
+void forwardNodeToWiFi(uint8_t address, const BusSensorFrame &frame)
+{
+  for (uint8_t first = 0; first < frame.zoneCount; first += TELEMETRY_ZONES_PER_FRAME) {
+    sendDataToWiFiBoard(prepareNodeForWiFi(address, frame, first), 100, DEBUG);
+  }
+}
+#endif
 
-  if (sensor4Value > 450) {
-    digitalWrite(IN4, LOW);
-  } else {
-    digitalWrite(IN4, HIGH);
+void setup() {
+  // Relays off and watchdog armed before anything else can hang
+  relaysBegin();
+  watchdogBegin();
+
+  logBegin(9600);
+  pumpsBegin();
+  sensorsBegin();
+#if FLOW_METERS_ENABLED
+  flowBegin();
+#endif
+#if PUMP_CURRENT_ENABLED
+  currentBegin();
+#endif
+#if RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+  reservoirBegin();
+#endif
+  arbiterInit(arbiter);
+  timerWheelInit(timers, uptimeMs());
+  timerInit(espTimer);
+  timerInit(loopTimer);
+#if PREDICTIVE_ENABLED
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    predictorInit(predictors[zone]);
+  }
+#endif
+#if PULSE_SOAK_ENABLED
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    pulseSoakInit(pulseSoak[zone]);
+  }
+#endif
+#if ADAPTIVE_SAMPLING
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    cadenceInit(cadences[zone], PREDICTIVE_ENABLED ? PREDICT_SAMPLE_PERIOD : SAMPLE_MAX_MS);
+  }
+#endif
+#if REPORT_BY_EXCEPTION
+  timerInit(heartbeatTimer);
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+#ifdef REPORT_DEADBANDS
+    reportInit(reports[zone], reportDeadbands[zone]);
+#else
+    reportInit(reports[zone], REPORT_DEADBAND);
+#endif
+  }
+#endif
+#if BUS_ROLE != BUS_ROLE_NONE
+  busBegin(sensorValues);
+#endif
+
+  TRACE(TRACE_EVENT_BOOT, watchdogResetCause());
+  if (watchdogResetCause() & RESET_CAUSE_HUNG_TASK) {
+    LOG_WARN("Watchdog reset, task %d was hung", watchdogBreadcrumb());
   }
 
-  String preparedData = prepareDataForWiFi(sensor1Value, sensor2Value, sensor3Value, sensor4Value);
-  if (DEBUG == true) {
-    Serial.println(preparedData);
+  delay(500);
+}
+
+void loop() {
+  TRACE(TRACE_EVENT_LOOP, 0);
+
+  watchdogEnter(TASK_ESP_DRAIN);
+  if (DEBUG == true && BUS_ROLE != BUS_ROLE_SLAVE) {
+    if (wifi.available()) {
+      timerStart(timers, espTimer, uptimeMs(), 1000);
+
+      while(timerPending(espTimer)) {
+        // The esp has data so display its output to the serial window
+        receiveFromWiFiBoard(true);
+        serviceBackground();
+      }
+    }
+    logWiFiOutput(true);
   }
-  sendDataToWiFiBoard(preparedData, 1000, DEBUG);
+  watchdogCheckIn(TASK_ESP_DRAIN);
 
-  delay(2000); // 2 seconds
-}
\ No newline at end of file
+  watchdogEnter(TASK_SENSORS);
+  ZoneMask sampled = zonesToSample();
+  sensorsScan(sensorValues, sampled);
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(sampled, zone)) {
+      continue;
+    }
+    LOG_INFO("Plant %d - Moisture Level:%d", zone + 1, (int)sensorValues[zone]);
+    TRACE(TRACE_EVENT_SENSOR, zone << 10 | (int)sensorValues[zone]);
+
+    waterPlant(zone, sensorValues[zone]);
+#if ADAPTIVE_SAMPLING
+    cadenceUpdate(cadences[zone], sensorValues[zone], bitRead(pumpRequests | relaysState(), zone), millis());
+#endif
+  }
+  applyPumpGrants();
+  watchdogCheckIn(TASK_SENSORS);
+
+  watchdogEnter(TASK_TELEMETRY);
+#if BUS_ROLE != BUS_ROLE_SLAVE && REPORT_BY_EXCEPTION
+  reportTelemetry();
+#elif BUS_ROLE != BUS_ROLE_SLAVE
+  sendTelemetry(sensorValues);
+#endif
+#if BUS_ROLE == BUS_ROLE_MASTER
+  busPollCycle(forwardNodeToWiFi);
+#endif
+  pumpsCheckpoint(false);
+  watchdogCheckIn(TASK_TELEMETRY);
+
+  // Keep the background work going instead of blocking in delay()
+  timerStart(timers, loopTimer, uptimeMs(), LOOP_WAIT_MS);
+  while(timerPending(loopTimer)) {
+    serviceBackground();
+  }
+}
@@ -0,0 +1,101 @@
+/**
+  Pin plan check: every feature the build enables claims its pins here, and a
+  static_assert rejects two features sharing one, naming the feature whose pins to move
+  in config.h. Included once, from main.cpp.
+*/
+
+#ifndef PINS_H
+#define PINS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+struct PinGroup {
+  const uint8_t *pins;
+  uint8_t count;
+};
+
+/**
+ * @return true when pin is one of the count pins
+ */
+constexpr bool pinIn(uint8_t pin, const uint8_t *pins, uint8_t count)
+{
+  return count > 0 && (pins[0] == pin || pinIn(pin, pins + 1, count - 1));
+}
+
+/**
+ * @return true when the two groups have a pin in common
+ */
+constexpr bool pinsOverlap(const PinGroup &a, const PinGroup &b)
+{
+  return a.count > 0 && (pinIn(a.pins[0], b.pins, b.count) || pinsOverlap(PinGroup{ a.pins + 1, (uint8_t)(a.count - 1) }, b));
+}
+
+/**
+ * @return true when groups[group] shares a pin with any other of the count groups
+ */
+constexpr bool pinClash(const PinGroup *groups, uint8_t count, uint8_t group, uint8_t other = 0)
+{
+  return other < count && ((other != group && pinsOverlap(groups[group], groups[other])) || pinClash(groups, count, group, other + 1));
+}
+
+#define PIN_GROUP(pins, enabled) { pins, (uint8_t)((enabled) ? sizeof(pins) : 0) }
+
+static constexpr uint8_t pinsSerial[] = { 0, 1 }; // the log and trace port
+static constexpr uint8_t pinsEsp[] = { ESP_RX_PIN, ESP_TX_PIN };
+#if RELAY_BACKEND == RELAY_BACKEND_595
+static constexpr uint8_t pinsRelays[] = { RELAY_595_LATCH_PIN, MOSI, MISO, SCK };
+#else
+static constexpr uint8_t pinsRelays[] = RELAY_PINS;
+#endif
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+static constexpr uint8_t pinsSensors[] = MUX_SELECT_PINS;
+#elif SENSOR_BACKEND == SENSOR_BACKEND_ADS1115
+static constexpr uint8_t pinsSensors[] = { SDA, SCL, ADS1115_RDY_PIN };
+#else
+static constexpr uint8_t pinsSensors[] = SENSOR_PINS;
+#endif
+static constexpr uint8_t pinsSensorSignals[] = MUX_SIGNAL_PINS;
+static constexpr uint8_t pinsBus[] = { BUS_RX_PIN, BUS_TX_PIN, BUS_DE_PIN };
+static constexpr uint8_t pinsCurrent[] = PUMP_CURRENT_PINS;
+static constexpr uint8_t pinsReservoir[] = { RESERVOIR_PIN };
+static constexpr uint8_t pinsFlow[] = FLOW_METER_PINS;
+
+enum PinUser {
+  PINS_SERIAL,
+  PINS_ESP,
+  PINS_RELAYS,
+  PINS_SENSORS,
+  PINS_SENSOR_SIGNALS,
+  PINS_BUS,
+  PINS_CURRENT,
+  PINS_RESERVOIR,
+  PINS_FLOW,
+  PIN_USER_COUNT
+};
+
+// A disabled feature claims no pins
+static constexpr PinGroup pinGroups[PIN_USER_COUNT] = {
+  PIN_GROUP(pinsSerial, true),
+  PIN_GROUP(pinsEsp, BUS_ROLE != BUS_ROLE_SLAVE),
+  PIN_GROUP(pinsRelays, true),
+  PIN_GROUP(pinsSensors, true),
+  PIN_GROUP(pinsSensorSignals, SENSOR_BACKEND == SENSOR_BACKEND_MUX),
+  PIN_GROUP(pinsBus, BUS_ROLE != BUS_ROLE_NONE),
+  PIN_GROUP(pinsCurrent, PUMP_CURRENT_ENABLED),
+  PIN_GROUP(pinsReservoir, RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE),
+  PIN_GROUP(pinsFlow, FLOW_METERS_ENABLED),
+};
+
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_ESP), "ESP_RX_PIN/ESP_TX_PIN share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_RELAYS),
+              "the relays (RELAY_PINS, or RELAY_595_LATCH_PIN and SPI) share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_SENSORS),
+              "the sensors (SENSOR_PINS, MUX_SELECT_PINS, or I2C and ADS1115_RDY_PIN) share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_SENSOR_SIGNALS), "MUX_SIGNAL_PINS share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_BUS), "BUS_RX_PIN/BUS_TX_PIN/BUS_DE_PIN share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_CURRENT), "PUMP_CURRENT_PINS share a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_RESERVOIR), "RESERVOIR_PIN shares a pin with another feature");
+static_assert(!pinClash(pinGroups, PIN_USER_COUNT, PINS_FLOW), "FLOW_METER_PINS share a pin with another feature");
+
+#endif
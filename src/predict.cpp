@@ -0,0 +1,195 @@
+#include "predict.h"
+
+#define Q16_ONE 65536L
+
+#define PREDICT_MAX_LAG 120 // seconds, a slower response is treated as no response
+
+/**
+ * @param predictor
+ */
+void predictorInit(ZonePredictor &predictor)
+{
+  predictor.dryRate = 0;
+  predictor.covariance = Q16_ONE;
+  predictor.filtered = 0;
+  predictor.sampleReading = 0;
+  predictor.sampleTime = 0;
+  predictor.stateUntil = 0;
+  predictor.pulseStart = 0;
+  predictor.pulseRunMs = 0;
+  predictor.prePulse = 0;
+  predictor.soakMinimum = 0;
+  predictor.pulseMs = 0;
+  predictor.gain = PREDICT_DEFAULT_GAIN;
+  predictor.lagSeconds = PREDICT_DEFAULT_LAG;
+  predictor.state = PREDICT_IDLE;
+  predictor.primed = false;
+}
+
+/**
+ * One RLS step for y = dryRate * x with forgetting:
+ *   k = P x / (lambda + x P x),  dryRate += k (y - x dryRate),  P = (P - k x P) / lambda
+ * @param predictor
+ * @param seconds x, time since the last sample
+ * @param delta y, change of the filtered reading over that time, Q4
+ */
+static void predictorLearnDrying(ZonePredictor &predictor, int32_t seconds, int32_t delta)
+{
+  int64_t px = (int64_t)predictor.covariance * seconds;                      // Q16
+  int64_t denominator = PREDICT_FORGETTING + px * seconds;                    // Q16
+  int64_t gain = (px << 16) / denominator;                                    // Q16
+  int64_t error = ((int64_t)delta << 12) - (int64_t)predictor.dryRate * seconds; // Q16
+
+  predictor.dryRate += (int32_t)((gain * error) >> 16);
+
+  int64_t covariance = predictor.covariance - ((gain * px) >> 16);
+  covariance = (covariance << 16) / PREDICT_FORGETTING;
+  predictor.covariance = covariance < 1 ? 1 : (covariance > 64 * Q16_ONE ? 64 * Q16_ONE : (int32_t)covariance);
+}
+
+/**
+ * Learn gain and lag from how the reading answered the pulse that just soaked in
+ * @param predictor
+ * @param pulseMs how long the pump actually ran for it
+ */
+static void predictorLearnPulse(ZonePredictor &predictor, uint32_t pulseMs)
+{
+  int32_t drop = predictor.prePulse - predictor.soakMinimum;
+  if (drop <= 2 || pulseMs == 0) {
+    return; // no usable response, e.g. the pump monitor will deal with a dry reservoir
+  }
+
+  // Exponential averages with weight 1/4 keep one odd pulse from swinging the model
+  uint32_t measured = ((uint32_t)drop << 8) * 1000 / pulseMs;
+  if (measured > 0xFFFF) {
+    measured = 0xFFFF;
+  }
+  predictor.gain = (uint16_t)((3UL * predictor.gain + measured) / 4);
+}
+
+/**
+ * Stop pumping and let what the pulse delivered soak in; a pulse that never got the pump
+ * has nothing to judge
+ * @param predictor
+ * @param runMs the zone's pump run time, including the current run (see pumps.h)
+ * @param now ms
+ */
+static void predictorEndPulse(ZonePredictor &predictor, uint32_t runMs, uint32_t now)
+{
+  if (runMs == predictor.pulseRunMs) {
+    predictor.state = PREDICT_IDLE;
+    return;
+  }
+  predictor.state = PREDICT_SOAK;
+  predictor.soakMinimum = predictor.prePulse;
+  // Let the water reach the probe and spread before judging it
+  predictor.stateUntil = now + 2000UL * predictor.lagSeconds;
+}
+
+/**
+ * End the pulse once the pump has run its length; cheap enough to call on every pass of
+ * a wait loop
+ * @param predictor
+ * @param runMs the zone's pump run time, including the current run (see pumps.h)
+ * @param now ms
+ * @return true while the pump must keep running
+ */
+bool predictorTick(ZonePredictor &predictor, uint32_t runMs, uint32_t now)
+{
+  if (predictor.state != PREDICT_PULSE) {
+    return false;
+  }
+  uint32_t ran = runMs - predictor.pulseRunMs;
+  if (ran == 0) {
+    predictor.pulseStart = now; // still waiting for the arbiter
+  }
+  if (ran < predictor.pulseMs) {
+    return true;
+  }
+
+  predictorEndPulse(predictor, runMs, now);
+  return false;
+}
+
+/**
+ * Feed the latest reading and get the pump decision for this cycle
+ * @param predictor
+ * @param reading sensor counts, higher is drier
+ * @param runMs the zone's pump run time, including the current run (see pumps.h)
+ * @param lockedOut the pump must stay off (pumpmonitor.h): no pulse starts or goes on
+ * @param now ms
+ * @return true to run the pump
+ */
+bool predictorUpdate(ZonePredictor &predictor, int reading, uint32_t runMs, bool lockedOut, uint32_t now)
+{
+  if (!predictor.primed) {
+    predictor.filtered = (int32_t)reading << 4;
+    predictor.sampleReading = predictor.filtered;
+    predictor.sampleTime = now;
+    predictor.primed = true;
+  } else {
+    predictor.filtered += (((int32_t)reading << 4) - predictor.filtered) / 8;
+  }
+  int32_t current = predictor.filtered >> 4;
+
+  if (lockedOut && predictor.state == PREDICT_PULSE) {
+    predictorEndPulse(predictor, runMs, now);
+  }
+  if (predictorTick(predictor, runMs, now)) {
+    return true;
+  }
+
+  switch (predictor.state) {
+    case PREDICT_SOAK:
+      if (current < predictor.soakMinimum) {
+        if (predictor.soakMinimum == predictor.prePulse && predictor.prePulse - current > 2) {
+          uint32_t lag = (now - predictor.pulseStart) / 1000;
+          lag = lag > PREDICT_MAX_LAG ? PREDICT_MAX_LAG : lag;
+          predictor.lagSeconds = (uint16_t)((3UL * predictor.lagSeconds + lag) / 4);
+        }
+        predictor.soakMinimum = current;
+      }
+      if ((int32_t)(now - predictor.stateUntil) < 0) {
+        return false;
+      }
+      predictorLearnPulse(predictor, runMs - predictor.pulseRunMs);
+      predictor.state = PREDICT_IDLE;
+      predictor.sampleReading = predictor.filtered;
+      predictor.sampleTime = now;
+      break;
+
+    default:
+      break;
+  }
+
+  // Only dry soil without water in flight says anything about the drying rate
+  if (now - predictor.sampleTime >= PREDICT_SAMPLE_PERIOD) {
+    int32_t seconds = (now - predictor.sampleTime) / 1000;
+    predictorLearnDrying(predictor, seconds, predictor.filtered - predictor.sampleReading);
+    predictor.sampleReading = predictor.filtered;
+    predictor.sampleTime = now;
+  }
+
+  if (lockedOut) {
+    return false;
+  }
+
+  // Where will the reading be once water started now reaches the probe?
+  int32_t horizon = predictor.lagSeconds + PREDICT_SAMPLE_PERIOD / 1000;
+  int32_t rate = predictor.dryRate > 0 ? predictor.dryRate : 0;
+  int32_t predicted = current + (int32_t)(((int64_t)rate * horizon) >> 16);
+  if (predicted <= MOISTURE_THRESHOLD - PREDICT_GUARD) {
+    return false;
+  }
+
+  int32_t needed = predicted - (MOISTURE_THRESHOLD - PREDICT_TARGET_MARGIN);
+  uint32_t pulseMs = ((uint32_t)needed << 8) * 1000 / (predictor.gain ? predictor.gain : 1);
+  pulseMs = pulseMs < PREDICT_MIN_PULSE ? PREDICT_MIN_PULSE : (pulseMs > PREDICT_MAX_PULSE ? PREDICT_MAX_PULSE : pulseMs);
+
+  predictor.state = PREDICT_PULSE;
+  predictor.pulseStart = now;
+  predictor.pulseRunMs = runMs;
+  predictor.prePulse = current;
+  predictor.pulseMs = pulseMs;
+  return true;
+}
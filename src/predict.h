@@ -0,0 +1,52 @@
+/**
+  Predictive watering: learns each zone's drying rate online and waters in short pulses
+  before the reading crosses MOISTURE_THRESHOLD, instead of pumping until the probe
+  finally registers the water (which overshoots by the diffusion lag).
+
+  The drying rate is fitted by a scalar recursive least-squares estimator in fixed point
+  (Q16, forgetting factor PREDICT_FORGETTING) on the filtered reading, sampled every
+  PREDICT_SAMPLE_PERIOD while no water is in flight. Pump gain (counts per second of
+  pumping) and diffusion lag are learned from the response to each pulse.
+  Non-blocking like pulsesoak.h: predictorUpdate() decides at each sample and
+  predictorTick(), called from the wait loops, ends a pulse once the pump has run its
+  length by the run time ledger (pumps.h), so neither the loop period nor a preemption
+  stretches it. A locked out pump ends its pulse and starts no new one.
+  Plain C++ with no Arduino dependency, so the host simulator runs the same code.
+  One ZonePredictor is 44 bytes.
+*/
+
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum PredictState {
+  PREDICT_IDLE,
+  PREDICT_PULSE,
+  PREDICT_SOAK
+};
+
+struct ZonePredictor {
+  int32_t dryRate;        // counts per second, Q16
+  int32_t covariance;     // RLS covariance, Q16
+  int32_t filtered;       // EMA of the reading, Q4
+  int32_t sampleReading;  // filtered reading at the last RLS sample, Q4
+  uint32_t sampleTime;    // ms
+  uint32_t stateUntil;    // end of the current soak, ms
+  uint32_t pulseStart;    // ms, when the pump started
+  uint32_t pulseRunMs;    // the zone's pump run time when the pulse was planned
+  int16_t prePulse;       // reading when the last pulse started
+  int16_t soakMinimum;    // lowest reading seen during the soak
+  uint16_t gain;          // counts per second of pumping, Q8
+  uint16_t lagSeconds;    // pump start to first response at the probe
+  uint16_t pulseMs;       // planned length of the last pulse
+  uint8_t state;
+  uint8_t primed;
+};
+
+void predictorInit(ZonePredictor &predictor);
+bool predictorUpdate(ZonePredictor &predictor, int reading, uint32_t runMs, bool lockedOut, uint32_t now);
+bool predictorTick(ZonePredictor &predictor, uint32_t runMs, uint32_t now);
+
+#endif
@@ -0,0 +1,97 @@
+#include "pulsesoak.h"
+
+/**
+ * @param pulse
+ */
+void pulseSoakInit(PulseSoak &pulse)
+{
+  pulse.stateUntil = 0;
+  pulse.state = PULSE_IDLE;
+  pulse.bursts = 0;
+}
+
+/**
+ * @param pulse
+ * @param now ms
+ * @return true, the pump runs for this burst
+ */
+static bool pulseSoakStartBurst(PulseSoak &pulse, uint32_t now)
+{
+  pulse.state = PULSE_BURST;
+  pulse.bursts++;
+  pulse.stateUntil = now + PULSE_BURST_MS;
+  return true;
+}
+
+/**
+ * End the burst once it is due; cheap enough to call on every pass of a wait loop
+ * @param pulse
+ * @param running the pump is on; a burst waiting for the arbiter has not started yet
+ * @param now ms
+ * @return true while the pump must keep running
+ */
+bool pulseSoakTick(PulseSoak &pulse, bool running, uint32_t now)
+{
+  if (pulse.state != PULSE_BURST) {
+    return false;
+  }
+  if (!running) {
+    pulse.stateUntil = now + PULSE_BURST_MS;
+    return true;
+  }
+  if ((int32_t)(now - pulse.stateUntil) < 0) {
+    return true;
+  }
+
+  pulse.state = PULSE_SOAK;
+  pulse.stateUntil = now + PULSE_SOAK_MS;
+  return false;
+}
+
+/**
+ * Feed the verdict on the latest reading and get the pump decision for this cycle
+ * @param pulse
+ * @param thirsty the reading asks for water
+ * @param running the pump is on
+ * @param now ms
+ * @return true to run the pump
+ */
+bool pulseSoakUpdate(PulseSoak &pulse, bool thirsty, bool running, uint32_t now)
+{
+  if (pulseSoakTick(pulse, running, now)) {
+    return true;
+  }
+
+  switch (pulse.state) {
+    case PULSE_SOAK:
+      if ((int32_t)(now - pulse.stateUntil) < 0) {
+        return false;
+      }
+      if (!thirsty) {
+        pulse.state = PULSE_IDLE;
+        return false;
+      }
+      if (pulse.bursts < PULSE_MAX_BURSTS) {
+        return pulseSoakStartBurst(pulse, now);
+      }
+      pulse.state = PULSE_REST;
+      pulse.stateUntil = now + PULSE_REST_MS;
+      return false;
+
+    case PULSE_REST:
+      if ((int32_t)(now - pulse.stateUntil) < 0) {
+        return false;
+      }
+      pulse.state = PULSE_IDLE;
+      break;
+
+    default:
+      break;
+  }
+
+  if (!thirsty) {
+    return false;
+  }
+  pulse.bursts = 0;
+  return pulseSoakStartBurst(pulse, now);
+}
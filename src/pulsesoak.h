@@ -0,0 +1,37 @@
+/**
+  Pulse-and-soak watering: a thirsty zone gets PULSE_BURST_MS of water, then soaks for
+  PULSE_SOAK_MS so the water reaches the probe before the zone is judged again. Bursts
+  repeat while the zone stays thirsty, up to PULSE_MAX_BURSTS per watering; a zone still
+  dry after that rests for PULSE_REST_MS instead of flooding a broken probe.
+
+  Non-blocking: pulseSoakUpdate() decides at each sample and pulseSoakTick(), called from
+  the wait loops, ends a burst on time so its length does not depend on the loop period.
+  A burst's clock only starts once the arbiter actually switched its pump on.
+  Plain C++ with no Arduino dependency, so the host simulator runs the same code.
+  One PulseSoak is 6 bytes.
+*/
+
+#ifndef PULSESOAK_H
+#define PULSESOAK_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum PulseSoakState {
+  PULSE_IDLE,
+  PULSE_BURST,
+  PULSE_SOAK,
+  PULSE_REST
+};
+
+struct PulseSoak {
+  uint32_t stateUntil; // end of the current burst, soak or rest, ms
+  uint8_t state;
+  uint8_t bursts;      // bursts in the current watering
+};
+
+void pulseSoakInit(PulseSoak &pulse);
+bool pulseSoakUpdate(PulseSoak &pulse, bool thirsty, bool running, uint32_t now);
+bool pulseSoakTick(PulseSoak &pulse, bool running, uint32_t now);
+
+#endif
@@ -0,0 +1,217 @@
+#include "pumpcurrent.h"
+
+#define CURRENT_DRY_MA    ((uint32_t)PUMP_CURRENT_NOMINAL_MA * PUMP_CURRENT_DRY_PCT / 100)
+#define CURRENT_RIPPLE_MA ((uint32_t)PUMP_CURRENT_NOMINAL_MA * PUMP_CURRENT_RIPPLE_PCT / 100)
+#define CURRENT_STALL_MA  ((uint32_t)PUMP_CURRENT_NOMINAL_MA * PUMP_CURRENT_STALL_PCT / 100)
+#define CURRENT_MAX_MA    8000 // keeps the x 8 average in 16 bits
+
+static_assert(PUMP_CURRENT_BURST_SAMPLES >= 16 && PUMP_CURRENT_BURST_SAMPLES < 255,
+              "the burst must let the average settle and fit the sample counter");
+static_assert(PUMP_CURRENT_AVERAGE >= 1 && PUMP_CURRENT_AVERAGE <= 64, "PUMP_CURRENT_AVERAGE must keep the sum in 16 bits");
+static_assert(CURRENT_STALL_MA < CURRENT_MAX_MA, "PUMP_CURRENT_STALL_PCT is out of range");
+
+/**
+ * Forget the previous run, call when the pump switches on
+ * @param monitor
+ */
+void currentMonitorStart(CurrentMonitor &monitor)
+{
+  monitor.peak = 0;
+  monitor.mean = 0;
+  monitor.ripple = 0;
+  monitor.samples = 0;
+  monitor.suspect = 0;
+}
+
+/**
+ * @param meanMa average current
+ * @param rippleMa mean absolute deviation from it
+ * @return what a pump drawing this looks like
+ */
+uint8_t currentClassify(uint16_t meanMa, uint16_t rippleMa)
+{
+  if (meanMa >= CURRENT_STALL_MA) {
+    return CURRENT_STALL;
+  }
+  if (meanMa < CURRENT_DRY_MA) {
+    return CURRENT_DRY;
+  }
+  if (meanMa < PUMP_CURRENT_NOMINAL_MA && rippleMa >= CURRENT_RIPPLE_MA) {
+    return CURRENT_DRY; // sputtering on air
+  }
+  return CURRENT_NORMAL;
+}
+
+/**
+ * Feed one sample: the first PUMP_CURRENT_BURST_SAMPLES after currentMonitorStart() are
+ * the turn-on burst, every later one a running sample
+ * @param monitor
+ * @param milliamps
+ * @return CURRENT_NORMAL, or the fault once the burst or enough running samples show it
+ */
+uint8_t currentMonitorSample(CurrentMonitor &monitor, uint16_t milliamps)
+{
+  if (milliamps > CURRENT_MAX_MA) {
+    milliamps = CURRENT_MAX_MA;
+  }
+
+  if (monitor.samples == 0) {
+    monitor.mean = milliamps << 3;
+  } else {
+    monitor.mean += milliamps - (monitor.mean >> 3);
+  }
+  uint16_t average = monitor.mean >> 3;
+  uint16_t deviation = milliamps > average ? milliamps - average : average - milliamps;
+  monitor.ripple += deviation - (monitor.ripple >> 3);
+
+  if (monitor.samples < PUMP_CURRENT_BURST_SAMPLES) {
+    if (milliamps > monitor.peak) {
+      monitor.peak = milliamps;
+    }
+    if (++monitor.samples < PUMP_CURRENT_BURST_SAMPLES) {
+      return CURRENT_NORMAL;
+    }
+
+    // End of the burst: no current at all, or an inrush that never decayed
+    if (monitor.peak < CURRENT_DRY_MA) {
+      return CURRENT_DRY;
+    }
+    if (average >= CURRENT_STALL_MA) {
+      return CURRENT_STALL;
+    }
+    monitor.ripple = 0; // the decay is not ripple
+    return CURRENT_NORMAL;
+  }
+
+  uint8_t verdict = currentClassify(average, monitor.ripple >> 3);
+  if (verdict == CURRENT_NORMAL) {
+    monitor.suspect = 0;
+    return CURRENT_NORMAL;
+  }
+  if (++monitor.suspect < PUMP_CURRENT_CONFIRM) {
+    return CURRENT_NORMAL;
+  }
+  return verdict;
+}
+
+#if defined(ARDUINO) && PUMP_CURRENT_ENABLED
+#include <Arduino.h>
+#include "pumpmonitor.h"
+#include "log.h"
+#include "trace.h"
+
+static const uint8_t currentPins[] = PUMP_CURRENT_PINS;
+
+#define CURRENT_SENSOR_COUNT (sizeof(currentPins) / sizeof(currentPins[0]))
+#define CURRENT_SHARED       (CURRENT_SENSOR_COUNT != ZONE_COUNT)
+
+static_assert(CURRENT_SENSOR_COUNT == ZONE_COUNT || (CURRENT_SENSOR_COUNT == 1 && PUMP_MAX_ACTIVE == 1),
+              "one current sensor per zone, or one shared sensor with a single pump running at a time");
+
+static CurrentMonitor currentMonitors[ZONE_COUNT];
+static uint16_t currentZero[CURRENT_SENSOR_COUNT]; // ADC counts x 16 at 0 A
+static ZoneMask currentRunning = 0;
+static unsigned long lastCurrentSample = 0;
+static unsigned long lastBurstSample = 0; // us
+
+/**
+ * @param zone
+ * @param readings averaged back to back
+ * @return the current through the zone's sensor
+ */
+static uint16_t currentRead(uint8_t zone, uint8_t readings)
+{
+  uint8_t sensor = CURRENT_SHARED ? 0 : zone;
+  uint16_t sum = 0;
+
+  for (uint8_t i = 0; i < readings; i++) {
+    sum += analogRead(currentPins[sensor]);
+  }
+  int32_t counts = ((int32_t)sum << 4) / readings - currentZero[sensor];
+
+  if (counts <= 0) {
+    return 0;
+  }
+  return min(counts * PUMP_CURRENT_UA_PER_COUNT / 16000, (uint32_t)CURRENT_MAX_MA);
+}
+
+/**
+ * Lock a pump out on its current
+ * @param zone
+ * @param verdict
+ */
+static void currentFault(uint8_t zone, uint8_t verdict)
+{
+  pumpLockOut(zone);
+  if (verdict == CURRENT_STALL) {
+    LOG_WARN("Plant %d - pump stalled (%u mA), locked out", zone + 1, currentMonitors[zone].mean >> 3);
+    TRACE(TRACE_EVENT_PUMP_FAULT, zone << 8 | PUMP_FAULT_CURRENT_STALL);
+  } else {
+    LOG_WARN("Plant %d - pump running dry (%u mA), locked out", zone + 1, currentMonitors[zone].mean >> 3);
+    TRACE(TRACE_EVENT_PUMP_FAULT, zone << 8 | PUMP_FAULT_CURRENT_DRY);
+  }
+}
+
+/**
+ * Measure the sensors' zero, call while every pump is off
+ */
+void currentBegin()
+{
+  for (uint8_t sensor = 0; sensor < CURRENT_SENSOR_COUNT; sensor++) {
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < 16; i++) {
+      sum += analogRead(currentPins[sensor]);
+    }
+    currentZero[sensor] = sum;
+  }
+}
+
+/**
+ * Sample the running pumps: a pump switched on since the previous call starts its burst,
+ * one reading per call at least PUMP_CURRENT_BURST_US apart until it is complete, later
+ * one sample of PUMP_CURRENT_AVERAGE readings every PUMP_CURRENT_PERIOD_MS. Never waits,
+ * call right after the relays switched and from every wait loop.
+ * @param running bit n set while pump n runs
+ * @return bit n set when pump n was just locked out and must be switched off
+ */
+ZoneMask currentUpdate(ZoneMask running)
+{
+  ZoneMask faulted = 0;
+  unsigned long now = millis();
+  boolean periodic = now - lastCurrentSample >= PUMP_CURRENT_PERIOD_MS;
+  boolean burstDue = micros() - lastBurstSample >= PUMP_CURRENT_BURST_US;
+
+  if (periodic) {
+    lastCurrentSample = now;
+  }
+  if (burstDue) {
+    lastBurstSample = micros();
+  }
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(running, zone) || pumpLockedOut(zone)) {
+      continue;
+    }
+
+    uint8_t verdict = CURRENT_NORMAL;
+    if (!bitRead(currentRunning, zone)) {
+      currentMonitorStart(currentMonitors[zone]);
+    }
+    if (currentMonitors[zone].samples < PUMP_CURRENT_BURST_SAMPLES) {
+      if (burstDue) {
+        verdict = currentMonitorSample(currentMonitors[zone], currentRead(zone, 1));
+      }
+    } else if (periodic) {
+      verdict = currentMonitorSample(currentMonitors[zone], currentRead(zone, PUMP_CURRENT_AVERAGE));
+    }
+
+    if (verdict != CURRENT_NORMAL) {
+      currentFault(zone, verdict);
+      bitSet(faulted, zone);
+    }
+  }
+  currentRunning = running;
+
+  return faulted;
+}
+#endif
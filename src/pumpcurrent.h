@@ -0,0 +1,54 @@
+/**
+  Pump current sensing: tells a working pump from one that runs dry or stalls, which the
+  relays alone cannot. Every pump's current is sampled in a burst of
+  PUMP_CURRENT_BURST_SAMPLES right after it is switched on, covering relay bounce, inrush
+  and its decay (one reading per pass of the wait loops, the loop never stalls on it), then
+  once every PUMP_CURRENT_PERIOD_MS while it runs (an average of
+  PUMP_CURRENT_AVERAGE readings, the ACS712 is coarse and noisy at a few hundred mA).
+  Three streaming features per pump, constant time per sample and 8 bytes of RAM: the
+  burst's peak, a moving average of the current and a moving mean absolute deviation
+  from it (alpha 1/8, like pumpmonitor.h).
+    stall   the average stays at locked-rotor level: the inrush never decayed or the
+            impeller jammed while running (debris, a clog at the impeller)
+    dry     the pump draws well under its nominal current, or swings widely below it
+            while the intake sputters on air (empty reservoir, blocked intake); a burst
+            without any current (open relay contact, broken wire) counts as dry
+  The burst judges the start at once; while running, PUMP_CURRENT_CONFIRM samples in a
+  row must agree. A fault locks the pump out like the other monitors (pumpLockOut()).
+
+  One sensor on the supply line serves every zone when only one pump runs at a time
+  (PUMP_MAX_ACTIVE 1), otherwise each zone needs its own. The zero is measured at boot
+  with every pump off; wire the sensor so pump current reads positive.
+  The classifier is plain C++ so the host tools can feed it synthetic waveforms.
+*/
+
+#ifndef PUMPCURRENT_H
+#define PUMPCURRENT_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum PumpCurrentClass {
+  CURRENT_NORMAL = 0,
+  CURRENT_DRY    = 1,
+  CURRENT_STALL  = 2
+};
+
+struct CurrentMonitor {
+  uint16_t peak;   // mA, highest sample of the turn-on burst
+  uint16_t mean;   // mA x 8, moving average with alpha 1/8
+  uint16_t ripple; // mA x 8, moving mean absolute deviation from the average
+  uint8_t samples; // of the burst, stops counting after it
+  uint8_t suspect; // running samples in a row that looked like a fault
+};
+
+void currentMonitorStart(CurrentMonitor &monitor);
+uint8_t currentMonitorSample(CurrentMonitor &monitor, uint16_t milliamps);
+uint8_t currentClassify(uint16_t meanMa, uint16_t rippleMa);
+
+#if defined(ARDUINO) && PUMP_CURRENT_ENABLED
+void currentBegin();
+ZoneMask currentUpdate(ZoneMask running);
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+#include "pumpmonitor.h"
+
+/**
+ * @param monitor
+ */
+void responseInit(PumpMonitor &monitor)
+{
+  monitor.state = RESPONSE_UNPRIMED;
+}
+
+/**
+ * Close the window, the next pump run opens a new one from the current reading
+ * @param monitor
+ */
+static void responseIdle(PumpMonitor &monitor)
+{
+  monitor.state = RESPONSE_IDLE;
+  monitor.baseline = monitor.filtered;
+  monitor.ranMs = 0;
+}
+
+/**
+ * Feed one moisture reading; call once per control cycle
+ * @param monitor
+ * @param reading raw sensor counts, higher is drier
+ * @param runMs the zone's total pump run time, including the current run (see pumps.h)
+ * @param watering the zone is in a watering cycle: it asks for water, or its pulses and
+ *        soaks are not over yet
+ * @param now
+ * @return PUMP_FAULT_NO_RESPONSE when this reading locked the pump out,
+ *         PUMP_FAULT_RETRY when the lockout just expired, PUMP_FAULT_NONE otherwise
+ */
+uint8_t responseSample(PumpMonitor &monitor, int reading, uint32_t runMs, bool watering, uint32_t now)
+{
+  uint32_t ran = runMs - monitor.runMs;
+  monitor.runMs = runMs;
+
+  if (monitor.state == RESPONSE_UNPRIMED) {
+    monitor.filtered = reading << 3;
+    responseIdle(monitor);
+    return PUMP_FAULT_NONE;
+  }
+  monitor.filtered += reading - (monitor.filtered >> 3);
+
+  if (monitor.state == RESPONSE_LOCKED) {
+    if (now - monitor.since >= PUMP_LOCKOUT_RETRY) {
+      responseIdle(monitor);
+      return PUMP_FAULT_RETRY;
+    }
+    return PUMP_FAULT_NONE;
+  }
+
+  if (monitor.state == RESPONSE_VERDICT) {
+    if (responseDrop(monitor) >= PUMP_RESPONSE_MIN_DROP) {
+      // The water was only late
+      responseIdle(monitor);
+      return PUMP_FAULT_NONE;
+    }
+    if (now - monitor.since < PUMP_RESPONSE_LAG) {
+      return PUMP_FAULT_NONE;
+    }
+    responseLockOut(monitor, now);
+    return PUMP_FAULT_NO_RESPONSE;
+  }
+
+  if (watering || ran) {
+    monitor.since = now;
+  } else if (now - monitor.since >= PUMP_RESPONSE_SETTLE) {
+    // The cycle is over: the zone got its water
+    responseIdle(monitor);
+    return PUMP_FAULT_NONE;
+  }
+  if (monitor.state == RESPONSE_IDLE) {
+    if (!ran) {
+      monitor.baseline = monitor.filtered;
+      return PUMP_FAULT_NONE;
+    }
+    // The baseline is the reading from before the pump started
+    monitor.state = RESPONSE_RUNNING;
+  }
+
+  if (monitor.filtered > monitor.baseline) {
+    monitor.baseline = monitor.filtered;
+  }
+  monitor.ranMs = ran < (uint32_t)(0xFFFF - monitor.ranMs) ? monitor.ranMs + ran : 0xFFFF;
+
+  if (responseDrop(monitor) >= PUMP_RESPONSE_MIN_DROP) {
+    responseIdle(monitor);
+    return PUMP_FAULT_NONE;
+  }
+  if (monitor.ranMs >= PUMP_RESPONSE_WINDOW) {
+    monitor.state = RESPONSE_VERDICT;
+    monitor.since = now;
+  }
+  return PUMP_FAULT_NONE;
+}
+
+/**
+ * Lock a pump out, it retries after PUMP_LOCKOUT_RETRY
+ * @param monitor
+ * @param now
+ */
+void responseLockOut(PumpMonitor &monitor, uint32_t now)
+{
+  monitor.state = RESPONSE_LOCKED;
+  monitor.since = now;
+}
+
+/**
+ * @param monitor
+ * @return true while the pump must stay off: locked out, or waiting for the verdict
+ */
+bool responseHoldsPump(const PumpMonitor &monitor)
+{
+  return monitor.state == RESPONSE_LOCKED || monitor.state == RESPONSE_VERDICT;
+}
+
+/**
+ * @param monitor
+ * @return counts the filtered reading is below the highest since the window opened
+ */
+int responseDrop(const PumpMonitor &monitor)
+{
+  return ((int)monitor.baseline - (int)monitor.filtered) >> 3;
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "pumps.h"
+#include "log.h"
+#include "trace.h"
+
+static PumpMonitor monitors[ZONE_COUNT]; // zero, RESPONSE_UNPRIMED
+static ZoneMask monitorLocked = 0;
+
+/**
+ * Feed one moisture reading; call once per control cycle
+ * @param zone
+ * @param reading raw sensor counts, higher is drier
+ * @param watering the zone is in a watering cycle
+ */
+void pumpMonitorSample(uint8_t zone, int reading, bool watering)
+{
+  uint8_t event = responseSample(monitors[zone], reading, pumpOnMs(zone), watering, millis());
+
+  if (event == PUMP_FAULT_RETRY) {
+    bitClear(monitorLocked, zone);
+    LOG_INFO("Plant %d - pump lockout expired, retrying", zone + 1);
+    TRACE(TRACE_EVENT_PUMP_FAULT, zone << 8 | PUMP_FAULT_RETRY);
+  } else if (event == PUMP_FAULT_NO_RESPONSE) {
+    bitSet(monitorLocked, zone);
+    LOG_WARN("Plant %d - no moisture response (%d counts), pump locked out", zone + 1, responseDrop(monitors[zone]));
+    TRACE(TRACE_EVENT_PUMP_FAULT, zone << 8 | PUMP_FAULT_NO_RESPONSE);
+  }
+}
+
+/**
+ * Lock a pump out on other evidence than the moisture curve, e.g. no flow (see flow.h).
+ * It retries after PUMP_LOCKOUT_RETRY like a lockout from the monitor itself.
+ * @param zone
+ */
+void pumpLockOut(uint8_t zone)
+{
+  responseLockOut(monitors[zone], millis());
+  bitSet(monitorLocked, zone);
+}
+
+/**
+ * @param zone
+ * @return true while the pump of this zone must stay off
+ */
+bool pumpLockedOut(uint8_t zone)
+{
+  return responseHoldsPump(monitors[zone]);
+}
+
+/**
+ * @return bit n set while zone n is locked out
+ */
+ZoneMask pumpFaults()
+{
+  return monitorLocked;
+}
+#endif
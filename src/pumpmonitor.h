@@ -0,0 +1,60 @@
+/**
+  Pump response monitor: detects a dry reservoir or a failed pump from the moisture curve.
+  A window opens when the pump starts and adds up its run time over the whole watering
+  cycle, across arbiter preemptions, pulse-soak bursts and predictive pulses. It closes
+  once the zone has not asked for water for PUMP_RESPONSE_SETTLE, or as soon as the filtered reading has fallen
+  PUMP_RESPONSE_MIN_DROP counts below the highest one since it opened, pump on or off.
+  A window that reaches PUMP_RESPONSE_WINDOW of run time without either holds the pump
+  off for PUMP_RESPONSE_LAG, while the water still in flight reaches the probe. Without
+  the drop by then the pump is locked out until PUMP_LOCKOUT_RETRY has passed.
+  Constant time and 15 bytes of RAM per zone.
+  The detector is plain C++ so the host tools can replay moisture traces through it.
+*/
+
+#ifndef PUMPMONITOR_H
+#define PUMPMONITOR_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Why a pump was locked out, the low byte of TRACE_EVENT_PUMP_FAULT
+enum PumpFaultReason {
+  PUMP_FAULT_RETRY         = 0, // the lockout expired
+  PUMP_FAULT_NO_RESPONSE   = 1, // no moisture response
+  PUMP_FAULT_NO_FLOW       = 2, // see flow.h
+  PUMP_FAULT_CURRENT_DRY   = 3, // see pumpcurrent.h
+  PUMP_FAULT_CURRENT_STALL = 4,
+  PUMP_FAULT_NONE          = 0xFF // responseSample(): no change
+};
+
+enum ResponseState {
+  RESPONSE_UNPRIMED = 0, // no reading yet
+  RESPONSE_IDLE     = 1,
+  RESPONSE_RUNNING  = 2, // a window is open
+  RESPONSE_LOCKED   = 3,
+  RESPONSE_VERDICT  = 4  // the window's run time is used up, the pump waits for the verdict
+};
+
+static_assert(PUMP_RESPONSE_WINDOW < 0xFFFF, "the window's run time is kept in 16 bits");
+
+struct PumpMonitor {
+  uint16_t filtered; // reading x 8, exponential moving average with alpha 1/8
+  uint16_t baseline; // highest filtered reading since the window opened, x 8
+  uint16_t ranMs;    // pump run time in the open window
+  uint32_t runMs;    // the zone's run time counter at the previous reading
+  uint32_t since;    // last reading of the watering cycle, the verdict or lockout start
+  uint8_t state;
+};
+
+void responseInit(PumpMonitor &monitor);
+uint8_t responseSample(PumpMonitor &monitor, int reading, uint32_t runMs, bool watering, uint32_t now);
+void responseLockOut(PumpMonitor &monitor, uint32_t now);
+bool responseHoldsPump(const PumpMonitor &monitor);
+int responseDrop(const PumpMonitor &monitor);
+
+void pumpMonitorSample(uint8_t zone, int reading, bool watering);
+void pumpLockOut(uint8_t zone);
+bool pumpLockedOut(uint8_t zone);
+ZoneMask pumpFaults();
+
+#endif
@@ -0,0 +1,230 @@
+#include "pumps.h"
+#include <string.h>
+
+/**
+ * Start from the saved counters, or from zero, with every pump off
+ * @param ledger
+ * @param saved counters of the last checkpoint, nullptr for none
+ * @param now
+ */
+void pumpLedgerInit(PumpLedger &ledger, const PumpStats *saved, uint32_t now)
+{
+  if (saved) {
+    memcpy(ledger.zones, saved, sizeof(ledger.zones));
+  } else {
+    memset(ledger.zones, 0, sizeof(ledger.zones));
+  }
+  ledger.running = 0;
+  ledger.lastCheckpoint = now;
+  ledger.dirty = false;
+}
+
+/**
+ * Account for a pump switching on or off, call it on transitions only
+ * @param ledger
+ * @param zone
+ * @param on
+ * @param now
+ */
+void pumpLedgerSwitch(PumpLedger &ledger, uint8_t zone, bool on, uint32_t now)
+{
+  ZoneMask mask = (ZoneMask)1 << zone;
+
+  if (on) {
+    ledger.onSince[zone] = now;
+    ledger.zones[zone].activations++;
+    ledger.running |= mask;
+  } else if (ledger.running & mask) {
+    ledger.zones[zone].onTimeMs += now - ledger.onSince[zone];
+    ledger.running &= ~mask;
+  }
+
+  ledger.dirty = true;
+}
+
+/**
+ * Copy the counters out for saving when they changed and the checkpoint interval
+ * elapsed. Pumps still running are folded in up to now without closing their run, so a
+ * reset loses at most one interval of run time.
+ * @param ledger
+ * @param saved ZONE_COUNT counters to save
+ * @param force ignore the interval, e.g. right before an intentional reset
+ * @param now
+ * @return true when saved was filled
+ */
+bool pumpLedgerCheckpoint(PumpLedger &ledger, PumpStats *saved, bool force, uint32_t now)
+{
+  if (!ledger.dirty && !ledger.running) {
+    return false;
+  }
+  if (!force && now - ledger.lastCheckpoint < PUMP_CHECKPOINT_INTERVAL) {
+    return false;
+  }
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (ledger.running & ((ZoneMask)1 << zone)) {
+      ledger.zones[zone].onTimeMs += now - ledger.onSince[zone];
+      ledger.onSince[zone] = now;
+    }
+  }
+  memcpy(saved, ledger.zones, sizeof(ledger.zones));
+  ledger.lastCheckpoint = now;
+  ledger.dirty = false;
+  return true;
+}
+
+/**
+ * @param ledger
+ * @param zone
+ * @param now
+ * @return total pump run time, including the current run
+ */
+uint32_t pumpLedgerOnMs(const PumpLedger &ledger, uint8_t zone, uint32_t now)
+{
+  uint32_t onTimeMs = ledger.zones[zone].onTimeMs;
+
+  if (ledger.running & ((ZoneMask)1 << zone)) {
+    onTimeMs += now - ledger.onSince[zone];
+  }
+  return onTimeMs;
+}
+
+/**
+ * @param seconds pump run time
+ * @return water delivered at PUMP_FLOW_ML_PER_MIN
+ */
+uint32_t pumpEstimatedMillilitres(uint32_t seconds)
+{
+  // Split minutes and seconds so months of run time cannot overflow 32 bits
+  return (seconds / 60) * PUMP_FLOW_ML_PER_MIN + (seconds % 60) * PUMP_FLOW_ML_PER_MIN / 60;
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "flow.h"
+
+#if FLOW_METERS_ENABLED
+#define PUMP_STATS_MAGIC 0x5032 // "P2", P1 plus the flow totalizer
+#else
+#define PUMP_STATS_MAGIC 0x5031 // "P1", bump when PumpStats changes
+#endif
+
+struct PumpStatsRecord {
+  uint16_t magic;
+  PumpStats zones[ZONE_COUNT];
+  uint8_t checksum;
+};
+
+static PumpLedger pumpLedger;
+
+/**
+ * @param record
+ * @return byte sum of the counters
+ */
+static uint8_t pumpStatsChecksum(const PumpStatsRecord &record)
+{
+  const uint8_t *bytes = (const uint8_t *)record.zones;
+  uint8_t sum = 0;
+
+  for (size_t i = 0; i < sizeof(record.zones); i++) {
+    sum += bytes[i];
+  }
+
+  return sum;
+}
+
+/**
+ * Restore the counters saved by the last checkpoint, or start from zero
+ */
+void pumpsBegin()
+{
+  PumpStatsRecord record;
+  EEPROM.get(EEPROM_PUMP_STATS_ADDR, record);
+
+  boolean valid = record.magic == PUMP_STATS_MAGIC && record.checksum == pumpStatsChecksum(record);
+  pumpLedgerInit(pumpLedger, valid ? record.zones : nullptr, millis());
+}
+
+/**
+ * Account for a pump switching on or off, call it on transitions only
+ * @param zone
+ * @param on
+ */
+void pumpsUpdate(uint8_t zone, bool on)
+{
+  pumpLedgerSwitch(pumpLedger, zone, on, millis());
+}
+
+#if FLOW_METERS_ENABLED
+/**
+ * Add flow meter pulses to the zone's totalizer
+ * @param zone
+ * @param pulses
+ */
+void pumpsFlow(uint8_t zone, uint16_t pulses)
+{
+  pumpLedger.zones[zone].flowPulses += pulses;
+  pumpLedger.dirty = true;
+}
+#endif
+
+/**
+ * Save the counters to EEPROM when they changed and the checkpoint interval elapsed
+ * @param force ignore the interval, e.g. right before an intentional reset
+ */
+void pumpsCheckpoint(bool force)
+{
+  PumpStatsRecord record;
+
+  if (!pumpLedgerCheckpoint(pumpLedger, record.zones, force, millis())) {
+    return;
+  }
+  record.magic = PUMP_STATS_MAGIC;
+  record.checksum = pumpStatsChecksum(record);
+
+  EEPROM.put(EEPROM_PUMP_STATS_ADDR, record); // only rewrites bytes that changed
+}
+
+/**
+ * @param zone
+ * @return total pump run time in ms, including the current run; wraps after 49 days of it
+ */
+uint32_t pumpOnMs(uint8_t zone)
+{
+  return pumpLedgerOnMs(pumpLedger, zone, millis());
+}
+
+/**
+ * @param zone
+ * @return total pump run time, including the current run
+ */
+uint32_t pumpOnSeconds(uint8_t zone)
+{
+  return pumpOnMs(zone) / 1000;
+}
+
+/**
+ * @param zone
+ * @return number of times the pump was switched on
+ */
+uint16_t pumpActivations(uint8_t zone)
+{
+  return pumpLedger.zones[zone].activations;
+}
+
+/**
+ * Water delivered, measured by the flow meter or estimated from run time and
+ * PUMP_FLOW_ML_PER_MIN
+ * @param zone
+ * @return
+ */
+uint32_t pumpMillilitres(uint8_t zone)
+{
+#if FLOW_METERS_ENABLED
+  return flowMillilitres(pumpLedger.zones[zone].flowPulses);
+#else
+  return pumpEstimatedMillilitres(pumpOnSeconds(zone));
+#endif
+}
+#endif
@@ -0,0 +1,48 @@
+/**
+  Per-zone pump accounting: run time, activation count and water delivered, estimated
+  from run time or totalized from the flow meter pulses (FLOW_METERS_ENABLED, see flow.h).
+  Counters live in RAM and are checkpointed to EEPROM so they survive resets.
+  The ledger is plain C++ taking the time as a parameter, so the host tools can run it
+  through a month and across millis() wraps; the pumps*() glue feeds it millis().
+*/
+
+#ifndef PUMPS_H
+#define PUMPS_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct PumpStats {
+  uint32_t onTimeMs;
+  uint16_t activations;
+#if FLOW_METERS_ENABLED
+  uint32_t flowPulses;
+#endif
+};
+
+struct PumpLedger {
+  PumpStats zones[ZONE_COUNT];
+  uint32_t onSince[ZONE_COUNT];
+  ZoneMask running;
+  uint32_t lastCheckpoint;
+  bool dirty;
+};
+
+void pumpLedgerInit(PumpLedger &ledger, const PumpStats *saved, uint32_t now);
+void pumpLedgerSwitch(PumpLedger &ledger, uint8_t zone, bool on, uint32_t now);
+bool pumpLedgerCheckpoint(PumpLedger &ledger, PumpStats *saved, bool force, uint32_t now);
+uint32_t pumpLedgerOnMs(const PumpLedger &ledger, uint8_t zone, uint32_t now);
+uint32_t pumpEstimatedMillilitres(uint32_t seconds);
+
+void pumpsBegin();
+void pumpsUpdate(uint8_t zone, bool on);
+#if FLOW_METERS_ENABLED
+void pumpsFlow(uint8_t zone, uint16_t pulses);
+#endif
+void pumpsCheckpoint(bool force);
+uint32_t pumpOnMs(uint8_t zone);
+uint32_t pumpOnSeconds(uint8_t zone);
+uint16_t pumpActivations(uint8_t zone);
+uint32_t pumpMillilitres(uint8_t zone);
+
+#endif
@@ -0,0 +1,185 @@
+#include "relays.h"
+
+/**
+ * The bytes to shift into a 74HC595 chain, in the order they go out (farthest chip
+ * first, MSB first, so bit n of a byte lands on output Qn). Relays are active LOW.
+ * @param mask bit n set = relay n on; relay n is output n % 8 of chip n / 8
+ * @param chips in the chain
+ * @param bytes chips bytes, filled in
+ * @return number of bytes
+ */
+uint8_t relays595Frame(uint32_t mask, uint8_t chips, uint8_t *bytes)
+{
+  for (uint8_t chip = 0; chip < chips; chip++) {
+    bytes[chips - 1 - chip] = ~(uint8_t)(mask >> (chip * 8));
+  }
+  return chips;
+}
+
+#ifdef ARDUINO
+#include "fastgpio.h"
+
+#if RELAY_BACKEND == RELAY_BACKEND_595
+#include <SPI.h>
+#endif
+
+static ZoneMask relayMask = 0;    // wanted state, bit set = pump on
+static ZoneMask relayWritten = 0; // state last written to the hardware
+
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+
+static const uint8_t relayPins[] = RELAY_PINS;
+static_assert(sizeof(relayPins) == ZONE_COUNT, "RELAY_PINS must list one pin per zone, use the 74HC595 backend for more");
+
+/**
+ * Write the relay pins that change, batched into one register write per port
+ * @param mask
+ * @param changed
+ */
+static void relaysWrite(ZoneMask mask, ZoneMask changed)
+{
+  FastPortBatch batch;
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (bitRead(changed, zone)) {
+      batch.set(relayPins[zone], !bitRead(mask, zone)); // active LOW
+    }
+  }
+
+  batch.apply();
+}
+
+/**
+ * Switch every relay off (HIGH) before making the pins outputs, so no pump glitches on
+ */
+void relaysBegin()
+{
+  FastPortBatch batch;
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    batch.set(relayPins[zone], HIGH);
+  }
+
+  batch.apply();
+  batch.output();
+  relayMask = 0;
+  relayWritten = 0;
+}
+
+/**
+ * Switch every pump off from the watchdog interrupt. The port writes of relaysWrite()
+ * are atomic, so this is relaysAllOff()
+ */
+void relaysWatchdogOff()
+{
+  relaysAllOff();
+}
+
+#elif RELAY_BACKEND == RELAY_BACKEND_595
+
+/**
+ * Shift the full state into the chain, farthest chip first, and latch it
+ * @param mask
+ * @param changed unused, the chain is always rewritten as a whole
+ */
+static void relaysWrite(ZoneMask mask, ZoneMask changed)
+{
+  uint8_t frame[RELAY_595_CHIPS];
+  relays595Frame(mask, RELAY_595_CHIPS, frame);
+
+  SPI.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+  FastPin<RELAY_595_LATCH_PIN>::low();
+  for (uint8_t i = 0; i < RELAY_595_CHIPS; i++) {
+    SPI.transfer(frame[i]);
+  }
+  FastPin<RELAY_595_LATCH_PIN>::high();
+  SPI.endTransaction();
+}
+
+/**
+ * Clear the chain to all off; the 74HC595 powers up with random outputs
+ */
+void relaysBegin()
+{
+  FastPin<RELAY_595_LATCH_PIN>::high();
+  FastPin<RELAY_595_LATCH_PIN>::output();
+  SPI.begin();
+
+  relaysWrite(0, (ZoneMask)~0);
+  relayMask = 0;
+  relayWritten = 0;
+}
+
+/**
+ * Switch every pump off from the watchdog interrupt. The hang may be inside
+ * relaysWrite() with a frame half shifted, so the SPI peripheral is switched off instead
+ * of reused: MOSI and SCK fall back to their port bits and the all-off frame is clocked
+ * out by hand, pushing the half frame out of the chain, then latched. An interrupted
+ * transfer clocks nothing more and its latch edge latches the same frame again. SPI stays
+ * off until the watchdog resets the board 15 ms later.
+ */
+void relaysWatchdogOff()
+{
+  uint8_t frame[RELAY_595_CHIPS];
+  relays595Frame(0, RELAY_595_CHIPS, frame);
+
+  SPCR &= ~_BV(SPE);
+  FastPin<SCK>::low();
+  FastPin<RELAY_595_LATCH_PIN>::low();
+  for (uint8_t i = 0; i < RELAY_595_CHIPS; i++) {
+    for (uint8_t bit = 0x80; bit; bit >>= 1) {
+      FastPin<MOSI>::write(frame[i] & bit);
+      FastPin<SCK>::high();
+      FastPin<SCK>::low();
+    }
+  }
+  FastPin<RELAY_595_LATCH_PIN>::high();
+
+  relayMask = 0;
+  relayWritten = 0;
+}
+
+#endif
+
+/**
+ * Request a relay state, takes effect on the next relaysFlush()
+ * @param zone
+ * @param on
+ */
+void relaySet(uint8_t zone, bool on)
+{
+  bitWrite(relayMask, zone, on);
+}
+
+/**
+ * Push the requested states to the hardware if any of them changed
+ */
+void relaysFlush()
+{
+  ZoneMask changed = relayMask ^ relayWritten;
+  if (!changed) {
+    return;
+  }
+
+  relaysWrite(relayMask, changed);
+  relayWritten = relayMask;
+}
+
+/**
+ * Switch every pump off right now; the watchdog interrupt uses relaysWatchdogOff()
+ */
+void relaysAllOff()
+{
+  relayMask = 0;
+  relaysWrite(0, (ZoneMask)~0);
+  relayWritten = 0;
+}
+
+/**
+ * @return requested relay states, bit n set when the pump of zone n is on
+ */
+ZoneMask relaysState()
+{
+  return relayMask;
+}
+#endif
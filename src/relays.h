@@ -0,0 +1,26 @@
+/**
+  Relay bank: the pump relays are kept as a bit mask and pushed to the hardware in one
+  go by relaysFlush(), which does nothing when the mask did not change.
+  The GPIO backend drives one pin per zone, the 74HC595 backend shifts the whole mask
+  out over hardware SPI in a single transaction, 8 relays per chip. The frame it shifts
+  is built by plain C++ so the host tools can clock it through a modeled chain.
+*/
+
+#ifndef RELAYS_H
+#define RELAYS_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define RELAY_595_CHIPS ((ZONE_COUNT + 7) / 8)
+
+uint8_t relays595Frame(uint32_t mask, uint8_t chips, uint8_t *bytes);
+
+void relaysBegin();
+void relaySet(uint8_t zone, bool on);
+void relaysFlush();
+void relaysAllOff();
+void relaysWatchdogOff();
+ZoneMask relaysState();
+
+#endif
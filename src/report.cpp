@@ -0,0 +1,74 @@
+#include "report.h"
+
+#define REPORT_PRIMED    0x01 // filtered holds a reading
+#define REPORT_SENT      0x02 // reported holds a value the cloud has
+#define REPORT_PUMP      0x04 // pump state of the latest reading
+#define REPORT_PUMP_SENT 0x08 // pump state when the zone was last reported
+
+/**
+ * @param report
+ * @param deadband counts the filtered value may move before the zone is reported
+ */
+void reportInit(ZoneReport &report, uint8_t deadband)
+{
+  report.filtered = 0;
+  report.reported = 0;
+  report.deadband = deadband;
+  report.flags = 0;
+}
+
+/**
+ * Feed the latest reading; call once per control cycle
+ * @param report
+ * @param reading sensor counts, 0..1023 with fractions
+ * @param pumpOn
+ * @return true when the zone must be reported
+ */
+bool reportUpdate(ZoneReport &report, float reading, bool pumpOn)
+{
+  uint16_t sample = (uint16_t)(reading * 16);
+
+  if (!(report.flags & REPORT_PRIMED)) {
+    report.filtered = sample;
+    report.flags |= REPORT_PRIMED;
+  } else {
+    report.filtered += ((int16_t)(sample - report.filtered)) >> 2;
+  }
+
+  if (pumpOn) {
+    report.flags |= REPORT_PUMP;
+  } else {
+    report.flags &= ~REPORT_PUMP;
+  }
+
+  if (!(report.flags & REPORT_SENT) || !(report.flags & REPORT_PUMP) != !(report.flags & REPORT_PUMP_SENT)) {
+    return true;
+  }
+
+  int16_t moved = report.filtered - report.reported;
+  return moved > (int16_t)(report.deadband << 4) || -moved > (int16_t)(report.deadband << 4);
+}
+
+/**
+ * Record that the zone went out with its current filtered value and pump state
+ * @param report
+ */
+void reportSent(ZoneReport &report)
+{
+  report.reported = report.filtered;
+  report.flags |= REPORT_SENT;
+  if (report.flags & REPORT_PUMP) {
+    report.flags |= REPORT_PUMP_SENT;
+  } else {
+    report.flags &= ~REPORT_PUMP_SENT;
+  }
+}
+
+/**
+ * @param report
+ * @return filtered reading in sensor counts, the value frames carry
+ */
+float reportValue(const ZoneReport &report)
+{
+  return report.filtered / 16.0f;
+}
@@ -0,0 +1,32 @@
+/**
+  Report-by-exception: instead of every reading, a zone is sent when its filtered value
+  has moved more than its deadband away from the value the cloud last received, or when
+  its pump switched. The caller adds a full-state heartbeat every REPORT_HEARTBEAT_MS so
+  every value is refreshed even in a zone that never moves.
+
+  The filter is an exponential moving average with alpha 1/4 that keeps sensor noise from
+  crossing the deadband. Frames carry the filtered value, so the cloud's copy never drifts
+  more than the deadband from it without a report.
+  Plain C++ with no Arduino dependency, so the host simulator runs the same code.
+  One ZoneReport is 6 bytes.
+*/
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct ZoneReport {
+  uint16_t filtered; // reading x 16
+  uint16_t reported; // filtered value in the last frame, x 16
+  uint8_t deadband;  // counts
+  uint8_t flags;
+};
+
+void reportInit(ZoneReport &report, uint8_t deadband);
+bool reportUpdate(ZoneReport &report, float reading, bool pumpOn);
+void reportSent(ZoneReport &report);
+float reportValue(const ZoneReport &report);
+
+#endif
@@ -0,0 +1,223 @@
+#include "reservoir.h"
+
+static_assert(RESERVOIR_RESUME_ML > RESERVOIR_LOW_ML && RESERVOIR_RESUME_ML < RESERVOIR_CAPACITY_ML,
+              "RESERVOIR_RESUME_ML must lie between the low mark and a full reservoir");
+static_assert((unsigned long long)RESERVOIR_CAPACITY_ML * 8 * (RESERVOIR_USE_WINDOW_MS / 60000UL) <= 0xFFFFFFFFULL,
+              "the x 8 filter and the forecast keep the level in 32 bits");
+static_assert(RESERVOIR_USE_WINDOW_MS % 60000UL == 0, "RESERVOIR_USE_WINDOW_MS must be whole minutes");
+
+/**
+ * @param reservoir
+ * @param millilitres first level reading
+ * @param low the first sensed state, see reservoirLow(); the interlock starts from it
+ * @param now ms
+ */
+void reservoirInit(Reservoir &reservoir, uint32_t millilitres, bool low, uint32_t now)
+{
+  reservoir.filtered = millilitres << 3;
+  reservoir.use = 0;
+  reservoir.windowStart = now;
+  reservoir.windowLevel = millilitres;
+  reservoir.lowSince = now;
+  reservoir.windows = 0;
+  reservoir.low = low;
+  reservoir.interlocked = low;
+}
+
+/**
+ * Feed one level reading, every RESERVOIR_SAMPLE_MS
+ * @param reservoir
+ * @param millilitres
+ * @param now ms
+ */
+void reservoirLevel(Reservoir &reservoir, uint32_t millilitres, uint32_t now)
+{
+  reservoir.filtered += millilitres - (reservoir.filtered >> 3);
+
+  if (now - reservoir.windowStart < RESERVOIR_USE_WINDOW_MS) {
+    return;
+  }
+
+  uint32_t level = reservoir.filtered >> 3;
+  uint32_t used = reservoir.windowLevel > level ? reservoir.windowLevel - level : 0;
+  if (reservoir.windows == 0) {
+    reservoir.use = used << 3;
+  } else {
+    reservoir.use += used - (reservoir.use >> 3);
+  }
+  if (reservoir.windows < 255) {
+    reservoir.windows++;
+  }
+  reservoir.windowLevel = level;
+  reservoir.windowStart = now;
+}
+
+/**
+ * Debounce the sensed low state into the interlock
+ * @param reservoir
+ * @param low the float is down, or the filtered level is under the mark that applies
+ * @param now ms
+ * @return true while the pumps must stay off
+ */
+bool reservoirLow(Reservoir &reservoir, bool low, uint32_t now)
+{
+  if (low != reservoir.low) {
+    reservoir.low = low;
+    reservoir.lowSince = now;
+  }
+  if (reservoir.low != reservoir.interlocked && now - reservoir.lowSince >= RESERVOIR_DEBOUNCE_MS) {
+    reservoir.interlocked = reservoir.low;
+  }
+  return reservoir.interlocked;
+}
+
+/**
+ * @param reservoir
+ * @return filtered level
+ */
+uint32_t reservoirMillilitres(const Reservoir &reservoir)
+{
+  return reservoir.filtered >> 3;
+}
+
+/**
+ * @param reservoir
+ * @return hours until the level reaches RESERVOIR_LOW_ML at the recent use, or
+ *         RESERVOIR_HOURS_UNKNOWN
+ */
+uint16_t reservoirHoursLeft(const Reservoir &reservoir)
+{
+  if (reservoir.use == 0) {
+    return RESERVOIR_HOURS_UNKNOWN;
+  }
+
+  uint32_t level = reservoirMillilitres(reservoir);
+  uint32_t above = level > RESERVOIR_LOW_ML ? level - RESERVOIR_LOW_ML : 0;
+  // above / (use / 8) windows of RESERVOIR_USE_WINDOW_MS, in hours
+  uint32_t hours = above * 8 * (RESERVOIR_USE_WINDOW_MS / 60000UL) / reservoir.use / 60;
+  return hours < RESERVOIR_HOURS_UNKNOWN ? hours : RESERVOIR_HOURS_UNKNOWN - 1;
+}
+
+#if defined(ARDUINO) && RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+#include <Arduino.h>
+#include "pumps.h"
+#include "log.h"
+#include "trace.h"
+
+static Reservoir reservoir;
+static unsigned long lastReservoirSample = 0;
+
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_FLOAT
+static uint32_t deliveredAtRefill;
+
+/**
+ * @return water every pump delivered in its lifetime
+ */
+static uint32_t reservoirDelivered()
+{
+  uint32_t total = 0;
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    total += pumpMillilitres(zone);
+  }
+  return total;
+}
+
+/**
+ * @return RESERVOIR_CAPACITY_ML less what the pumps delivered since the refill
+ */
+static uint32_t reservoirRead()
+{
+  uint32_t used = reservoirDelivered() - deliveredAtRefill;
+  return used < RESERVOIR_CAPACITY_ML ? RESERVOIR_CAPACITY_ML - used : 0;
+}
+#else
+/**
+ * @return level from the analog sensor
+ */
+static uint32_t reservoirRead()
+{
+  int counts = analogRead(RESERVOIR_PIN);
+
+  if (counts <= RESERVOIR_EMPTY_COUNTS) {
+    return 0;
+  }
+  if (counts >= RESERVOIR_FULL_COUNTS) {
+    return RESERVOIR_CAPACITY_ML;
+  }
+  return (uint32_t)(counts - RESERVOIR_EMPTY_COUNTS) * RESERVOIR_CAPACITY_ML / (RESERVOIR_FULL_COUNTS - RESERVOIR_EMPTY_COUNTS);
+}
+#endif
+
+/**
+ * Start full (float) or at the first reading (analog), interlocked if that is already low
+ */
+void reservoirBegin()
+{
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_FLOAT
+  pinMode(RESERVOIR_PIN, INPUT_PULLUP);
+  deliveredAtRefill = reservoirDelivered();
+#endif
+  uint32_t level = reservoirRead();
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_FLOAT
+  boolean low = digitalRead(RESERVOIR_PIN) == HIGH; // open: the float hangs below the mark
+#else
+  boolean low = level < RESERVOIR_LOW_ML;
+#endif
+  reservoirInit(reservoir, level, low, millis());
+  if (low) {
+    LOG_WARN("Reservoir low (%lu mL), pumps interlocked", (unsigned long)level);
+    TRACE(TRACE_EVENT_RESERVOIR, (uint16_t)1 << 15 | min(level / 100, 0x7FFFUL));
+  }
+}
+
+/**
+ * Sample the level every RESERVOIR_SAMPLE_MS; call from every wait loop, before the pumps
+ * are granted
+ * @return true while the pumps must stay off
+ */
+bool reservoirService()
+{
+  unsigned long now = millis();
+
+  if (now - lastReservoirSample < RESERVOIR_SAMPLE_MS) {
+    return reservoir.interlocked;
+  }
+  lastReservoirSample = now;
+
+  reservoirLevel(reservoir, reservoirRead(), now);
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_FLOAT
+  boolean low = digitalRead(RESERVOIR_PIN) == HIGH; // open: the float hangs below the mark
+#else
+  uint32_t mark = reservoir.interlocked ? RESERVOIR_RESUME_ML : RESERVOIR_LOW_ML;
+  boolean low = reservoirMillilitres(reservoir) < mark;
+#endif
+
+  boolean wasInterlocked = reservoir.interlocked;
+  if (reservoirLow(reservoir, low, now) == wasInterlocked) {
+    return reservoir.interlocked;
+  }
+
+  uint32_t left = reservoirMillilitres(reservoir);
+  if (reservoir.interlocked) {
+    LOG_WARN("Reservoir low (%lu mL), pumps interlocked", (unsigned long)left);
+  } else {
+#if RESERVOIR_SENSOR == RESERVOIR_SENSOR_FLOAT
+    deliveredAtRefill = reservoirDelivered();
+    reservoir.filtered = RESERVOIR_CAPACITY_ML << 3;
+    left = RESERVOIR_CAPACITY_ML;
+#endif
+    LOG_INFO("Reservoir refilled (%lu mL), pumps released", (unsigned long)left);
+  }
+  TRACE(TRACE_EVENT_RESERVOIR, (uint16_t)reservoir.interlocked << 15 | min(left / 100, 0x7FFFUL));
+
+  return reservoir.interlocked;
+}
+
+/**
+ * @return level, interlock and water use
+ */
+const Reservoir &reservoirStatus()
+{
+  return reservoir;
+}
+#endif
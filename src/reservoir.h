@@ -0,0 +1,55 @@
+/**
+  Reservoir level and pump interlock. When the reservoir runs dry every zone still reads
+  dry, so without an interlock every pump would keep running on air. While the level is
+  low, applyPumpGrants() hands the arbiter no requests at all: every pump goes off in
+  the same pass and none starts until the reservoir is refilled.
+
+  Two sensors:
+    float   a switch at the low mark. It decides the interlock; the litres left are
+            counted down from RESERVOIR_CAPACITY_ML by the water the pumps delivered
+            (pumps.h) and start over when the float reports the refill.
+    analog  a level sensor mapped linearly from RESERVOIR_EMPTY_COUNTS to
+            RESERVOIR_FULL_COUNTS. Its readings are filtered (moving average, alpha
+            1/8) and the interlock has hysteresis: low below RESERVOIR_LOW_ML, refilled
+            above RESERVOIR_RESUME_ML.
+  Either way a change must hold for RESERVOIR_DEBOUNCE_MS, so slosh from a starting pump
+  or a bobbing float cannot toggle the pumps. The interlock starts from the first reading,
+  taken at boot with every pump off, so a reservoir that is already low never feeds one.
+  Water use is the level's drop per RESERVOIR_USE_WINDOW_MS, averaged over the windows
+  (alpha 1/8, a window with a refill counts as no use); the hours left are what remains
+  above the low mark at that rate.
+  The filter, debounce and forecast are plain C++ so the host tools can run them.
+*/
+
+#ifndef RESERVOIR_H
+#define RESERVOIR_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define RESERVOIR_HOURS_UNKNOWN 0xFFFF // no water used yet
+
+struct Reservoir {
+  uint32_t filtered;    // mL x 8, moving average with alpha 1/8
+  uint32_t use;         // mL per window x 8, moving average with alpha 1/8
+  uint32_t windowStart; // ms
+  uint32_t windowLevel; // mL at the window start
+  uint32_t lowSince;    // ms the sensed state last changed
+  uint8_t windows;      // closed so far, saturates
+  bool low;             // sensed state, not debounced
+  bool interlocked;
+};
+
+void reservoirInit(Reservoir &reservoir, uint32_t millilitres, bool low, uint32_t now);
+void reservoirLevel(Reservoir &reservoir, uint32_t millilitres, uint32_t now);
+bool reservoirLow(Reservoir &reservoir, bool low, uint32_t now);
+uint32_t reservoirMillilitres(const Reservoir &reservoir);
+uint16_t reservoirHoursLeft(const Reservoir &reservoir);
+
+#if defined(ARDUINO) && RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+void reservoirBegin();
+bool reservoirService();
+const Reservoir &reservoirStatus();
+#endif
+
+#endif
@@ -0,0 +1,240 @@
+/**
+  Single-producer single-consumer ring buffer for data crossing from an ISR to loop(),
+  or between any two contexts that never push or pop on the same side.
+
+  Head and tail are free-running counters, masked only on access, so all Size slots are
+  usable. Each side writes only its own counter and reads the other's, so neither side
+  locks: an 8-bit counter (Size up to 128) is a single load or store on the AVR, a 16-bit
+  one is read and written with interrupts held off for those two instructions. The
+  compiler barrier around the counter access keeps the item copies on the right side of
+  it. On the host the same accesses are acquire/release atomics, so the tools can hammer
+  it from two threads.
+
+  Besides push()/pop() and the bulk write()/read(), the spans give direct access to the
+  storage: peek() returns the contiguous run of items waiting to be read, consume() frees
+  them; reserve() returns the contiguous free run, commit() publishes what was written
+  into it. A run ends where the storage wraps, so a second call picks up the rest.
+*/
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#ifdef __AVR__
+#include <util/atomic.h>
+#endif
+
+template <bool Wide>
+struct RingIndexType {
+  typedef uint8_t type;
+};
+
+template <>
+struct RingIndexType<true> {
+  typedef uint16_t type;
+};
+
+/**
+ * Read the other side's counter
+ * @param index
+ * @return its value, with everything written before it was published visible
+ */
+template <typename Index>
+inline Index ringLoad(const Index &index)
+{
+#ifdef __AVR__
+  Index value;
+  if (sizeof(Index) == 1) {
+    value = *(const volatile Index *)&index;
+  } else {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      value = *(const volatile Index *)&index;
+    }
+  }
+  __asm__ __volatile__("" ::: "memory");
+  return value;
+#else
+  return __atomic_load_n(&index, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Publish this side's counter
+ * @param index
+ * @param value
+ */
+template <typename Index>
+inline void ringStore(Index &index, Index value)
+{
+#ifdef __AVR__
+  __asm__ __volatile__("" ::: "memory");
+  if (sizeof(Index) == 1) {
+    *(volatile Index *)&index = value;
+  } else {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      *(volatile Index *)&index = value;
+    }
+  }
+#else
+  __atomic_store_n(&index, value, __ATOMIC_RELEASE);
+#endif
+}
+
+template <typename T, uint16_t Size>
+class Ring {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "ring size must be a power of two");
+  static_assert(Size <= 32768, "ring size must fit a 16-bit free-running counter");
+
+public:
+  typedef typename RingIndexType<(Size > 128)>::type Index;
+
+  Ring() : head(0), tail(0) {}
+
+  // Producer side
+
+  /**
+   * @return free slots
+   */
+  Index room() const
+  {
+    return Size - (Index)(head - ringLoad(tail));
+  }
+
+  /**
+   * @param item
+   * @return false when full, the item is not stored
+   */
+  bool push(const T &item)
+  {
+    Index at = head;
+    if ((Index)(at - ringLoad(tail)) == Size) {
+      return false;
+    }
+    items[at & (Size - 1)] = item;
+    ringStore(head, (Index)(at + 1));
+    return true;
+  }
+
+  /**
+   * @param source
+   * @param count
+   * @return items stored, fewer than count when the ring fills
+   */
+  Index write(const T *source, Index count)
+  {
+    Index at = head;
+    Index free = Size - (Index)(at - ringLoad(tail));
+    if (count > free) {
+      count = free;
+    }
+    for (Index i = 0; i < count; i++) {
+      items[(Index)(at + i) & (Size - 1)] = source[i];
+    }
+    ringStore(head, (Index)(at + count));
+    return count;
+  }
+
+  /**
+   * Contiguous free storage to fill in place, published by commit()
+   * @param span set to the first free slot
+   * @return slots in the span, 0 when full
+   */
+  Index reserve(T *&span)
+  {
+    Index at = head;
+    Index free = Size - (Index)(at - ringLoad(tail));
+    Index offset = at & (Size - 1);
+    span = &items[offset];
+    return free < Size - offset ? free : Size - offset;
+  }
+
+  /**
+   * @param count slots of the reserved span that were filled
+   */
+  void commit(Index count)
+  {
+    ringStore(head, (Index)(head + count));
+  }
+
+  // Consumer side
+
+  /**
+   * @return items waiting
+   */
+  Index available() const
+  {
+    return ringLoad(head) - tail;
+  }
+
+  /**
+   * @param item
+   * @return false when empty, item untouched
+   */
+  bool pop(T &item)
+  {
+    Index at = tail;
+    if (ringLoad(head) == at) {
+      return false;
+    }
+    item = items[at & (Size - 1)];
+    ringStore(tail, (Index)(at + 1));
+    return true;
+  }
+
+  /**
+   * @param destination
+   * @param count
+   * @return items read, fewer than count when the ring runs empty
+   */
+  Index read(T *destination, Index count)
+  {
+    Index at = tail;
+    Index waiting = ringLoad(head) - at;
+    if (count > waiting) {
+      count = waiting;
+    }
+    for (Index i = 0; i < count; i++) {
+      destination[i] = items[(Index)(at + i) & (Size - 1)];
+    }
+    ringStore(tail, (Index)(at + count));
+    return count;
+  }
+
+  /**
+   * Contiguous items to parse in place, freed by consume()
+   * @param span set to the oldest item
+   * @return items in the span, 0 when empty
+   */
+  Index peek(const T *&span)
+  {
+    Index at = tail;
+    Index waiting = ringLoad(head) - at;
+    Index offset = at & (Size - 1);
+    span = &items[offset];
+    return waiting < Size - offset ? waiting : Size - offset;
+  }
+
+  /**
+   * @param count items to drop, at most available()
+   */
+  void consume(Index count)
+  {
+    ringStore(tail, (Index)(tail + count));
+  }
+
+  /**
+   * Drop everything waiting
+   */
+  void clear()
+  {
+    ringStore(tail, ringLoad(head));
+  }
+
+private:
+  T items[Size];
+  Index head; // free-running, written by the producer only
+  Index tail; // free-running, written by the consumer only
+};
+
+#endif
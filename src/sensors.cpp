@@ -0,0 +1,487 @@
+#include "sensors.h"
+
+#if SAMPLE_TIMER_ENABLED
+
+#include <util/atomic.h>
+#include "fastgpio.h"
+#include "ring.h"
+
+#define SAMPLE_TICK_US (SAMPLE_TIMER_PERIOD_MS * 1000UL / ZONE_COUNT)
+
+// Smallest Timer1 prescaler whose 16-bit count spans a tick
+#if SAMPLE_TICK_US <= 32768UL
+  #define SAMPLE_PRESCALE    8
+  #define SAMPLE_CLOCK_BITS  _BV(CS11)
+#elif SAMPLE_TICK_US <= 262144UL
+  #define SAMPLE_PRESCALE    64
+  #define SAMPLE_CLOCK_BITS  (_BV(CS11) | _BV(CS10))
+#elif SAMPLE_TICK_US <= 1048576UL
+  #define SAMPLE_PRESCALE    256
+  #define SAMPLE_CLOCK_BITS  _BV(CS12)
+#else
+  #define SAMPLE_PRESCALE    1024
+  #define SAMPLE_CLOCK_BITS  (_BV(CS12) | _BV(CS10))
+#endif
+
+#define SAMPLE_COUNTS_PER_US (F_CPU / 1000000UL)
+#define SAMPLE_TOP           (SAMPLE_TICK_US * SAMPLE_COUNTS_PER_US / SAMPLE_PRESCALE - 1)
+
+// SoftwareSerial holds interrupts off for a whole byte, ~1 ms at 9600 baud: a tick must
+// outlast that or a conversion is started after the next compare match
+static_assert(SAMPLE_TICK_US >= 2000UL, "SAMPLE_TIMER_PERIOD_MS allows less than 2 ms per zone");
+static_assert(SAMPLE_TICK_US <= 4194304UL, "SAMPLE_TIMER_PERIOD_MS is too long for Timer1");
+
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+#define MUX_SELECT_LINES (MUX_CHANNELS == 16 ? 4 : 3)
+#define MUX_COUNT        ((ZONE_COUNT + MUX_CHANNELS - 1) / MUX_CHANNELS)
+
+static const uint8_t muxSelectPins[] = MUX_SELECT_PINS;
+static const uint8_t muxSignalPins[] = MUX_SIGNAL_PINS;
+static_assert(MUX_COUNT <= sizeof(muxSignalPins), "ZONE_COUNT needs more multiplexers than MUX_SIGNAL_PINS lists");
+#else
+static const uint8_t sensorPins[] = SENSOR_PINS;
+static_assert(sizeof(sensorPins) == ZONE_COUNT, "SENSOR_PINS must list one pin per zone");
+#endif
+
+struct SensorSample {
+  uint16_t zoneValue; // zone << 10 | ADC result
+  uint16_t late;      // Timer1 counts from the compare match to the conversion start
+};
+
+static Ring<SensorSample, 16> samples;
+static uint8_t sampleZone = 0;         // ISR side: zone whose input is selected
+static uint16_t sampleLate;            // ISR side: handed from the compare to the ADC interrupt
+static volatile uint8_t samplesLost = 0;
+
+static int32_t sampleSums[ZONE_COUNT];
+static uint8_t sampleCounts[ZONE_COUNT];
+static float sampleLast[ZONE_COUNT];
+static SampleJitter jitter;
+
+/**
+ * Route a zone's sensor to the ADC input; the mux has a whole tick to settle
+ * @param zone
+ */
+static void sampleSelect(uint8_t zone)
+{
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+  FastPortBatch batch;
+  uint8_t channel = zone % MUX_CHANNELS;
+  for (uint8_t line = 0; line < MUX_SELECT_LINES; line++) {
+    batch.set(muxSelectPins[line], bitRead(channel, line));
+  }
+  batch.apply();
+  ADMUX = _BV(REFS0) | ((muxSignalPins[zone / MUX_CHANNELS] - A0) & 0x07);
+#else
+  ADMUX = _BV(REFS0) | ((sensorPins[zone] - A0) & 0x07);
+#endif
+}
+
+/**
+ * Compare match: start the selected zone's conversion. Timer1 restarted from 0 at the
+ * match, so its count is how late the conversion starts.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+  sampleLate = TCNT1;
+  ADCSRA |= _BV(ADSC);
+}
+
+/**
+ * Conversion done: hand the result to sensorsPoll() and select the next zone
+ */
+ISR(ADC_vect)
+{
+  SensorSample sample = { (uint16_t)(sampleZone << 10 | ADC), sampleLate };
+  if (!samples.push(sample) && samplesLost < 255) {
+    samplesLost++;
+  }
+
+  sampleZone = sampleZone + 1 < ZONE_COUNT ? sampleZone + 1 : 0;
+  sampleSelect(sampleZone);
+}
+
+/**
+ * Set up the inputs, the ADC interrupt and Timer1 in CTC mode at one zone per tick
+ */
+void sensorsBegin()
+{
+#if SENSOR_BACKEND == SENSOR_BACKEND_MUX
+  for (uint8_t line = 0; line < MUX_SELECT_LINES; line++) {
+    pinMode(muxSelectPins[line], OUTPUT);
+  }
+  for (uint8_t mux = 0; mux < MUX_COUNT; mux++) {
+    pinMode(muxSignalPins[mux], INPUT);
+  }
+#else
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    pinMode(sensorPins[zone], INPUT);
+  }
+#endif
+  jitter.minUs = 0xFFFF;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sampleZone = 0;
+    sampleSelect(0);
+    ADCSRA |= _BV(ADIE); // the Arduino core already enabled the ADC at a 125 kHz clock
+
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12); // CTC, TOP = OCR1A, stopped
+    TCNT1 = 0;
+    OCR1A = SAMPLE_TOP;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 = _BV(OCIE1A);
+    TCCR1B |= SAMPLE_CLOCK_BITS;
+  }
+}
+
+/**
+ * Collect the conversions the interrupts queued. Call often (from every wait loop), the
+ * queue holds 16 samples.
+ */
+void sensorsPoll()
+{
+  const SensorSample *span;
+  uint8_t count;
+
+  while ((count = samples.peek(span)) > 0) {
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t zone = span[i].zoneValue >> 10;
+      if (sampleCounts[zone] < 255) {
+        sampleSums[zone] += span[i].zoneValue & 0x3FF;
+        sampleCounts[zone]++;
+      }
+
+      uint16_t lateUs = (uint32_t)span[i].late * SAMPLE_PRESCALE / SAMPLE_COUNTS_PER_US;
+      if (lateUs < jitter.minUs) {
+        jitter.minUs = lateUs;
+      }
+      if (lateUs > jitter.maxUs) {
+        jitter.maxUs = lateUs;
+      }
+      jitter.samples++;
+    }
+    samples.consume(count);
+  }
+}
+
+/**
+ * Average of the samples taken since the zone was last scanned, the previous value if
+ * none came in
+ * @param values one reading per zone, in ADC counts
+ * @param zones bit n set to read zone n
+ */
+void sensorsScan(float *values, ZoneMask zones)
+{
+  sensorsPoll();
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(zones, zone)) {
+      continue;
+    }
+    if (sampleCounts[zone]) {
+      sampleLast[zone] = (float)sampleSums[zone] / sampleCounts[zone];
+      sampleSums[zone] = 0;
+      sampleCounts[zone] = 0;
+    }
+    values[zone] = sampleLast[zone];
+  }
+}
+
+/**
+ * Hand over the sample timing since the previous call and start a new window
+ * @param window filled in
+ */
+void sensorsJitter(SampleJitter &window)
+{
+  sensorsPoll();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    jitter.lost = samplesLost;
+    samplesLost = 0;
+  }
+  window = jitter;
+  if (!window.samples) {
+    window.minUs = 0;
+  }
+
+  jitter.minUs = 0xFFFF;
+  jitter.maxUs = 0;
+  jitter.samples = 0;
+}
+
+#elif SENSOR_BACKEND == SENSOR_BACKEND_DIRECT
+
+static const uint8_t sensorPins[] = SENSOR_PINS;
+static_assert(sizeof(sensorPins) == ZONE_COUNT, "SENSOR_PINS must list one pin per zone");
+
+/**
+ * Analog pins are inputs already, this only documents the wiring
+ */
+void sensorsBegin()
+{
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    pinMode(sensorPins[zone], INPUT);
+  }
+}
+
+/**
+ * Read the requested zones
+ * @param values one reading per zone, in ADC counts
+ * @param zones bit n set to read zone n
+ */
+void sensorsScan(float *values, ZoneMask zones)
+{
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (bitRead(zones, zone)) {
+      values[zone] = analogRead(sensorPins[zone]);
+    }
+  }
+}
+
+/**
+ * Nothing runs in the background with this backend
+ */
+void sensorsPoll()
+{
+}
+
+#elif SENSOR_BACKEND == SENSOR_BACKEND_MUX
+
+#include "fastgpio.h"
+
+#define MUX_SELECT_LINES  (MUX_CHANNELS == 16 ? 4 : 3)
+#define MUX_COUNT         ((ZONE_COUNT + MUX_CHANNELS - 1) / MUX_CHANNELS)
+#define MUX_SCAN_CHANNELS (ZONE_COUNT < MUX_CHANNELS ? ZONE_COUNT : MUX_CHANNELS)
+
+// The ADC samples during the first 1.5 ADC clocks (12 us at the Arduino 125 kHz ADC clock),
+// after that the input may change without disturbing the running conversion
+#define ADC_SAMPLE_HOLD_US 14
+
+static const uint8_t muxSelectPins[] = MUX_SELECT_PINS;
+static const uint8_t muxSignalPins[] = MUX_SIGNAL_PINS;
+static_assert(MUX_COUNT <= sizeof(muxSignalPins), "ZONE_COUNT needs more multiplexers than MUX_SIGNAL_PINS lists");
+static unsigned long muxSelectedAt;
+
+/**
+ * Point every multiplexer at a channel and remember when, for the settle time
+ * @param channel
+ */
+static void muxSelect(uint8_t channel)
+{
+  FastPortBatch batch;
+
+  for (uint8_t line = 0; line < MUX_SELECT_LINES; line++) {
+    batch.set(muxSelectPins[line], bitRead(channel, line));
+  }
+
+  batch.apply();
+  muxSelectedAt = micros();
+}
+
+/**
+ * Start a conversion on an analog pin without waiting for it, like analogRead() does
+ * @param pin
+ */
+static void adcStart(uint8_t pin)
+{
+  ADMUX = _BV(REFS0) | ((pin - A0) & 0x07);
+  ADCSRA |= _BV(ADSC);
+}
+
+/**
+ * @return result of the conversion started by adcStart()
+ */
+static int adcFinish()
+{
+  while (ADCSRA & _BV(ADSC));
+  return ADC;
+}
+
+/**
+ * Configure the select lines and park the multiplexers on channel 0
+ */
+void sensorsBegin()
+{
+  for (uint8_t line = 0; line < MUX_SELECT_LINES; line++) {
+    pinMode(muxSelectPins[line], OUTPUT);
+  }
+  for (uint8_t mux = 0; mux < MUX_COUNT; mux++) {
+    pinMode(muxSignalPins[mux], INPUT);
+  }
+  muxSelect(0);
+}
+
+/**
+ * Scan channel by channel; on each channel convert every mux, then switch to the next
+ * channel while the last conversion is still running
+ * @param values one reading per zone (zone = mux * MUX_CHANNELS + channel), in ADC counts
+ * @param zones bit n set to read zone n; the channels are still walked for the others
+ */
+void sensorsScan(float *values, ZoneMask zones)
+{
+  muxSelect(0);
+
+  for (uint8_t channel = 0; channel < MUX_SCAN_CHANNELS; channel++) {
+    for (uint8_t mux = 0; mux < MUX_COUNT; mux++) {
+      uint8_t zone = mux * MUX_CHANNELS + channel;
+      if (zone >= ZONE_COUNT) {
+        break;
+      }
+
+      boolean sample = bitRead(zones, zone);
+      if (sample) {
+        while (micros() - muxSelectedAt < MUX_SETTLE_US);
+        adcStart(muxSignalPins[mux]);
+      }
+
+      boolean lastOnChannel = mux == MUX_COUNT - 1 || zone + MUX_CHANNELS >= ZONE_COUNT;
+      if (lastOnChannel && channel + 1 < MUX_SCAN_CHANNELS) {
+        if (sample) {
+          delayMicroseconds(ADC_SAMPLE_HOLD_US);
+        }
+        muxSelect(channel + 1);
+      }
+
+      if (sample) {
+        values[zone] = adcFinish();
+      }
+    }
+  }
+}
+
+/**
+ * Nothing runs in the background with this backend
+ */
+void sensorsPoll()
+{
+}
+
+#elif SENSOR_BACKEND == SENSOR_BACKEND_ADS1115
+
+#include <Wire.h>
+
+static_assert(ZONE_COUNT <= 4, "the ADS1115 has four single-ended inputs");
+
+#define ADS1115_REG_CONVERSION 0x00
+#define ADS1115_REG_CONFIG     0x01
+#define ADS1115_REG_LO_THRESH  0x02
+#define ADS1115_REG_HI_THRESH  0x03
+
+// Continuous conversion, AINx against GND, +/-6.144 V range (LSB 187.5 uV),
+// comparator asserting ALERT/RDY after every conversion
+#define ADS1115_CONFIG(input) (0x4000 | ((uint16_t)(input) << 12) | ((uint16_t)ADS1115_DATA_RATE << 5))
+
+// 6.144 V full scale over 32768 counts, expressed in 5 V / 1023 internal ADC counts
+#define ADS1115_TO_ADC_COUNTS (6.144 / 32768.0 / 5.0 * 1023.0)
+
+static volatile boolean adsReady = false;
+static uint8_t adsInput = 0;
+static int32_t adsSums[ZONE_COUNT];
+static uint8_t adsSamples[ZONE_COUNT];
+static float adsLast[ZONE_COUNT];
+
+/**
+ * ALERT/RDY falling edge: a conversion result is waiting. Reading it needs I2C, which
+ * must not run in interrupt context, so only flag it for sensorsPoll()
+ */
+static void adsReadyIsr()
+{
+  adsReady = true;
+}
+
+/**
+ * @param reg
+ * @param value
+ */
+static void adsWrite(uint8_t reg, uint16_t value)
+{
+  Wire.beginTransmission(ADS1115_ADDRESS);
+  Wire.write(reg);
+  Wire.write(highByte(value));
+  Wire.write(lowByte(value));
+  Wire.endTransmission();
+}
+
+/**
+ * @return the last conversion result
+ */
+static int16_t adsReadConversion()
+{
+  Wire.beginTransmission(ADS1115_ADDRESS);
+  Wire.write(ADS1115_REG_CONVERSION);
+  Wire.endTransmission();
+
+  Wire.requestFrom((uint8_t)ADS1115_ADDRESS, (uint8_t)2);
+  uint8_t high = Wire.read();
+  uint8_t low = Wire.read();
+
+  return (int16_t)(high << 8 | low);
+}
+
+/**
+ * Turn ALERT/RDY into a conversion-ready pulse and start converting the first input
+ */
+void sensorsBegin()
+{
+  Wire.begin();
+  Wire.setClock(400000);
+
+  // Hi_thresh MSB set and Lo_thresh MSB clear select the conversion-ready function
+  adsWrite(ADS1115_REG_HI_THRESH, 0x8000);
+  adsWrite(ADS1115_REG_LO_THRESH, 0x0000);
+
+  pinMode(ADS1115_RDY_PIN, INPUT_PULLUP); // ALERT/RDY is open drain
+  attachInterrupt(digitalPinToInterrupt(ADS1115_RDY_PIN), adsReadyIsr, FALLING);
+
+  adsInput = 0;
+  adsWrite(ADS1115_REG_CONFIG, ADS1115_CONFIG(adsInput));
+}
+
+/**
+ * Collect a finished conversion and switch the ADC to the next input.
+ * Call often (from every wait loop), it returns at once when nothing is ready.
+ */
+void sensorsPoll()
+{
+  if (!adsReady) {
+    return;
+  }
+
+  int16_t raw = adsReadConversion();
+  if (adsSamples[adsInput] < 255) {
+    adsSums[adsInput] += raw;
+    adsSamples[adsInput]++;
+  }
+
+  // Writing the config restarts the conversion on the new input. Clear the flag only
+  // then: a conversion of the old input can end while the I2C transfers run, and its
+  // RDY pulse must not pass for the new input's (tools/ads_sim)
+  adsInput = (adsInput + 1) % ZONE_COUNT;
+  adsWrite(ADS1115_REG_CONFIG, ADS1115_CONFIG(adsInput));
+  adsReady = false;
+}
+
+/**
+ * Average of the samples collected since the zone was last scanned, the previous value if
+ * none came in. The conversions go on in the background for every zone regardless.
+ * @param values one reading per zone, in internal ADC counts
+ * @param zones bit n set to read zone n
+ */
+void sensorsScan(float *values, ZoneMask zones)
+{
+  sensorsPoll();
+
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    if (!bitRead(zones, zone)) {
+      continue;
+    }
+    if (adsSamples[zone]) {
+      adsLast[zone] = (float)adsSums[zone] / adsSamples[zone] * ADS1115_TO_ADC_COUNTS;
+      adsSums[zone] = 0;
+      adsSamples[zone] = 0;
+    }
+    values[zone] = adsLast[zone];
+  }
+}
+
+#endif
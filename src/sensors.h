@@ -0,0 +1,41 @@
+/**
+  Moisture sensor acquisition behind one per-zone interface.
+  The direct backend reads one analog pin per zone. The multiplexer backend scans one or
+  two 16:1 (or 8:1) analog muxes sharing their select lines: the next channel is selected
+  as soon as the ADC has sampled the current one, so the mux settles while the conversion
+  runs instead of in a dead delay.
+  The ADS1115 backend keeps the external ADC converting continuously in the background:
+  its ALERT/RDY pulse flags each result and sensorsPoll() collects it and moves on to the
+  next input. A scan returns the average of every sample taken since the previous scan,
+  scaled to the internal ADC's 0..1023 range (with fractional resolution) so thresholds
+  stay the same across backends.
+  A scan reads only the zones it is asked for and leaves the other values alone.
+
+  With SAMPLE_TIMER_ENABLED the direct and mux backends sample in the background too:
+  Timer1 interrupts start one zone's conversion per tick, the ADC interrupt queues the
+  result (see ring.h) and selects the next zone, and scans average what was queued.
+  Every sample records how late its conversion started after the compare match.
+*/
+
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Timing of the timed samples over a window
+struct SampleJitter {
+  uint16_t minUs;   // least and most a conversion started after its compare match
+  uint16_t maxUs;
+  uint16_t samples;
+  uint8_t lost;     // dropped because sensorsPoll() ran too seldom
+};
+
+void sensorsBegin();
+void sensorsScan(float *values, ZoneMask zones);
+void sensorsPoll();
+#if SAMPLE_TIMER_ENABLED
+void sensorsJitter(SampleJitter &window);
+#endif
+
+#endif
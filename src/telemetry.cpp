@@ -0,0 +1,209 @@
+#include "telemetry.h"
+#include "jsonschema.h"
+#include "watchdog.h"
+#include "pumps.h"
+#include "pumpmonitor.h"
+#include "relays.h"
+#include "sensors.h"
+#include "reservoir.h"
+
+#define TELEMETRY_SENSOR "\"sensor" JSON_UINT "Value\":\"" JSON_FLOAT "\""
+#define TELEMETRY_ARRAY  JSON_REPEAT(TELEMETRY_FRAME_ZONES, JSON_UINT, ",")
+
+// Same keys in the same order as the ArduinoJson document this replaced
+static constexpr char telemetryBody[] PROGMEM =
+  "{" JSON_REPEAT(TELEMETRY_FRAME_ZONES, TELEMETRY_SENSOR, ",")
+#if ZONE_COUNT > TELEMETRY_ZONES_PER_FRAME
+  ",\"firstZone\":" JSON_UINT
+#endif
+  ",\"pumpSec\":[" TELEMETRY_ARRAY "]"
+  ",\"pumpRuns\":[" TELEMETRY_ARRAY "]"
+  ",\"pumpMl\":[" TELEMETRY_ARRAY "]"
+  ",\"pumpFault\":" JSON_UINT;
+
+// One zone for report-by-exception, the same shape as a frame starting at that zone plus
+// the pump states
+static constexpr char telemetryZone[] PROGMEM =
+  "{" TELEMETRY_SENSOR ",\"firstZone\":" JSON_UINT
+  ",\"pumpSec\":[" JSON_UINT "],\"pumpRuns\":[" JSON_UINT "],\"pumpMl\":[" JSON_UINT "]"
+  ",\"pumps\":" JSON_UINT ",\"pumpFault\":" JSON_UINT;
+
+// Sample timing since the previous frame, with timed sampling
+static constexpr char telemetryJitter[] PROGMEM =
+  ",\"sampleLateUs\":[" JSON_UINT "," JSON_UINT "],\"samplesLost\":" JSON_UINT;
+
+// Water left, hours until the low mark and the pump interlock, with a reservoir sensor
+static constexpr char telemetryReservoir[] PROGMEM =
+  ",\"reservoirMl\":" JSON_UINT ",\"reservoirHours\":" JSON_UINT ",\"reservoirLow\":" JSON_UINT;
+
+#if BUS_ROLE == BUS_ROLE_MASTER
+// A bus node's frame: the head, "firstZone" when the node has more zones than fit a
+// frame, one sensor piece per zone and the tail
+static constexpr char telemetryNode[] PROGMEM = "{\"node\":" JSON_UINT;
+static constexpr char telemetryNodeFirst[] PROGMEM = ",\"firstZone\":" JSON_UINT;
+static constexpr char telemetryNodeSensor[] PROGMEM = "," TELEMETRY_SENSOR;
+static constexpr char telemetryNodeTail[] PROGMEM = ",\"pumps\":" JSON_UINT ",\"pumpFault\":" JSON_UINT "}";
+
+static_assert(jsonFieldCount(telemetryNodeSensor) == 2 && jsonFieldCount(telemetryNodeTail) == 2,
+              "the node pieces and prepareNodeForWiFi() disagree on the fields");
+#endif
+
+static constexpr char telemetryReset[] PROGMEM =
+  ",\"resetCause\":" JSON_UINT ",\"resetTask\":" JSON_UINT ",\"resets\":" JSON_UINT "}";
+
+static_assert(jsonFieldCount(telemetryBody) == 5 * TELEMETRY_FRAME_ZONES + 1 + (ZONE_COUNT > TELEMETRY_ZONES_PER_FRAME),
+              "telemetryBody and prepareDataForWiFi() disagree on the fields");
+static_assert(jsonFieldCount(telemetryZone) == 8, "telemetryZone and prepareZoneForWiFi() disagree on the fields");
+
+static boolean resetReported = false;
+
+// Room finishFrame() needs after a filled skeleton
+#if SAMPLE_TIMER_ENABLED
+#define TELEMETRY_JITTER_LENGTH jsonMaxLength(telemetryJitter)
+#else
+#define TELEMETRY_JITTER_LENGTH 0
+#endif
+#if RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+#define TELEMETRY_RESERVOIR_LENGTH jsonMaxLength(telemetryReservoir)
+#else
+#define TELEMETRY_RESERVOIR_LENGTH 0
+#endif
+#define TELEMETRY_TAIL_LENGTH (TELEMETRY_JITTER_LENGTH + TELEMETRY_RESERVOIR_LENGTH + jsonMaxLength(telemetryReset))
+
+/**
+ * Close a frame, with the sample timing when sampling is timed, the reservoir with a level
+ * sensor and the reset cause if it is the first frame after boot
+ * @param end terminating NUL of the filled skeleton, TELEMETRY_TAIL_LENGTH bytes left
+ */
+static void finishFrame(char *end)
+{
+#if SAMPLE_TIMER_ENABLED
+  SampleJitter window;
+  sensorsJitter(window);
+
+  JsonValue timing[jsonFieldCount(telemetryJitter)];
+  timing[0].u = window.minUs;
+  timing[1].u = window.maxUs;
+  timing[2].u = window.lost;
+  end = jsonFill(end, telemetryJitter, timing);
+#endif
+
+#if RESERVOIR_SENSOR != RESERVOIR_SENSOR_NONE
+  const Reservoir &reservoir = reservoirStatus();
+  JsonValue level[jsonFieldCount(telemetryReservoir)];
+  level[0].u = reservoirMillilitres(reservoir);
+  level[1].u = reservoirHoursLeft(reservoir);
+  level[2].u = reservoir.interlocked;
+  end = jsonFill(end, telemetryReservoir, level);
+#endif
+
+  if (!resetReported) {
+    JsonValue reset[jsonFieldCount(telemetryReset)];
+    reset[0].u = watchdogResetCause();
+    reset[1].u = watchdogBreadcrumb();
+    reset[2].u = watchdogResetCount();
+    jsonFill(end, telemetryReset, reset);
+    resetReported = true;
+  } else {
+    end[0] = '}';
+    end[1] = '\0';
+  }
+}
+
+/**
+ * Build the JSON frame with the sensor data of TELEMETRY_FRAME_ZONES zones
+ * @param sensorValues
+ * @param firstZone
+ * @return
+ */
+String prepareDataForWiFi(const float *sensorValues, uint8_t firstZone)
+{
+  firstZone = min(firstZone, ZONE_COUNT - TELEMETRY_FRAME_ZONES);
+
+  JsonValue values[jsonFieldCount(telemetryBody)];
+  JsonValue *value = values;
+
+  for (uint8_t zone = firstZone; zone < firstZone + TELEMETRY_FRAME_ZONES; zone++) {
+    (value++)->u = zone + 1;
+    (value++)->f = sensorValues[zone];
+  }
+
+  // Boards with more zones than fit a frame send several, the arrays start at this zone
+#if ZONE_COUNT > TELEMETRY_ZONES_PER_FRAME
+  (value++)->u = firstZone + 1;
+#endif
+
+  // Lifetime pump counters per zone: run seconds, activations and estimated millilitres
+  for (uint8_t zone = firstZone; zone < firstZone + TELEMETRY_FRAME_ZONES; zone++) {
+    (value++)->u = pumpOnSeconds(zone);
+  }
+  for (uint8_t zone = firstZone; zone < firstZone + TELEMETRY_FRAME_ZONES; zone++) {
+    (value++)->u = pumpActivations(zone);
+  }
+  for (uint8_t zone = firstZone; zone < firstZone + TELEMETRY_FRAME_ZONES; zone++) {
+    (value++)->u = pumpMillilitres(zone);
+  }
+  value->u = pumpFaults();
+
+  char jsonBuffer[jsonMaxLength(telemetryBody) + TELEMETRY_TAIL_LENGTH];
+  finishFrame(jsonFill(jsonBuffer, telemetryBody, values));
+  return jsonBuffer;
+}
+
+/**
+ * Build the JSON frame of a single zone
+ * @param value
+ * @param zone
+ * @return
+ */
+String prepareZoneForWiFi(float value, uint8_t zone)
+{
+  JsonValue values[jsonFieldCount(telemetryZone)];
+  values[0].u = zone + 1;
+  values[1].f = value;
+  values[2].u = zone + 1;
+  values[3].u = pumpOnSeconds(zone);
+  values[4].u = pumpActivations(zone);
+  values[5].u = pumpMillilitres(zone);
+  values[6].u = relaysState();
+  values[7].u = pumpFaults();
+
+  char jsonBuffer[jsonMaxLength(telemetryZone) + TELEMETRY_TAIL_LENGTH];
+  finishFrame(jsonFill(jsonBuffer, telemetryZone, values));
+  return jsonBuffer;
+}
+
+#if BUS_ROLE == BUS_ROLE_MASTER
+/**
+ * Build the JSON frame of up to TELEMETRY_ZONES_PER_FRAME zones of a bus node, in the
+ * shape of our own frames plus "node"
+ * @param address
+ * @param frame
+ * @param firstZone
+ * @return
+ */
+String prepareNodeForWiFi(uint8_t address, const BusSensorFrame &frame, uint8_t firstZone)
+{
+  char jsonBuffer[jsonMaxLength(telemetryNode) + jsonMaxLength(telemetryNodeFirst) +
+                  TELEMETRY_ZONES_PER_FRAME * jsonMaxLength(telemetryNodeSensor) + jsonMaxLength(telemetryNodeTail)];
+  JsonValue values[jsonFieldCount(telemetryNodeTail)];
+
+  values[0].u = address;
+  char *end = jsonFill(jsonBuffer, telemetryNode, values);
+  if (frame.zoneCount > TELEMETRY_ZONES_PER_FRAME) {
+    values[0].u = firstZone + 1;
+    end = jsonFill(end, telemetryNodeFirst, values);
+  }
+
+  for (uint8_t zone = firstZone; zone < frame.zoneCount && zone < firstZone + TELEMETRY_ZONES_PER_FRAME; zone++) {
+    values[0].u = zone + 1;
+    values[1].f = frame.readings[zone] / 16.0f;
+    end = jsonFill(end, telemetryNodeSensor, values);
+  }
+
+  values[0].u = frame.pumps;
+  values[1].u = frame.faults;
+  jsonFill(end, telemetryNodeTail, values);
+  return jsonBuffer;
+}
+#endif
@@ -0,0 +1,24 @@
+/**
+  Telemetry frames for the ESP: one JSON object per TELEMETRY_FRAME_ZONES zones with the
+  readings, lifetime pump counters and faults, plus the reset cause in the first frame
+  after boot, the sample timing when sampling is timed and the reservoir level with a
+  level sensor ("reservoirHours" 65535: no water used yet). Report-by-exception sends
+  single zones in the same shape (see report.h), a bus master forwards the frames of its
+  nodes in that shape too, with the node address as "node".
+  The frame is a compile-time skeleton in flash (see jsonschema.h).
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "bus.h"
+
+String prepareDataForWiFi(const float *sensorValues, uint8_t firstZone);
+String prepareZoneForWiFi(float value, uint8_t zone);
+#if BUS_ROLE == BUS_ROLE_MASTER
+String prepareNodeForWiFi(uint8_t address, const BusSensorFrame &frame, uint8_t firstZone);
+#endif
+
+#endif
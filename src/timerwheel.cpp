@@ -0,0 +1,149 @@
+#include "timerwheel.h"
+
+#define TIMER_MASK  (TIMER_SLOTS - 1)
+#define TIMER_RANGE ((uint64_t)1 << (TIMER_SLOT_BITS * TIMER_LEVELS)) // ms the top level reaches
+
+/**
+ * Put a timer in the slot its expiry time falls in, relative to the wheel's next tick
+ * @param wheel
+ * @param timer not pending
+ */
+static void timerFile(TimerWheel &wheel, Timer &timer)
+{
+  // Already due: the next tick takes it
+  uint64_t expires = timer.expires > wheel.now ? timer.expires : wheel.now;
+  uint64_t delta = expires - wheel.now;
+
+  uint8_t level = 0;
+  while (level < TIMER_LEVELS - 1 && delta >> (TIMER_SLOT_BITS * (level + 1))) {
+    level++;
+  }
+  if (delta >= TIMER_RANGE) {
+    // Out of reach: wait in the top slot that cascades last, then get re-filed
+    expires = wheel.now + TIMER_RANGE - 1;
+  }
+
+  Timer **slot = &wheel.slots[level][(expires >> (TIMER_SLOT_BITS * level)) & TIMER_MASK];
+  timer.next = *slot;
+  if (timer.next) {
+    timer.next->pprev = &timer.next;
+  }
+  timer.pprev = slot;
+  *slot = &timer;
+}
+
+/**
+ * Level 0 wrapped: re-file the due slot of level 1 into the levels below, and of level 2
+ * if level 1 wrapped too, and so on
+ * @param wheel
+ */
+static void timerCascade(TimerWheel &wheel)
+{
+  for (uint8_t level = 1; level < TIMER_LEVELS; level++) {
+    uint8_t index = (wheel.now >> (TIMER_SLOT_BITS * level)) & TIMER_MASK;
+    Timer *timer = wheel.slots[level][index];
+    wheel.slots[level][index] = nullptr;
+
+    while (timer) {
+      Timer *next = timer->next;
+      timerFile(wheel, *timer);
+      timer = next;
+    }
+    if (index != 0) {
+      break;
+    }
+  }
+}
+
+/**
+ * @param wheel
+ * @param now uptime in ms, the first tick
+ */
+void timerWheelInit(TimerWheel &wheel, uint64_t now)
+{
+  for (uint8_t level = 0; level < TIMER_LEVELS; level++) {
+    for (uint8_t index = 0; index < TIMER_SLOTS; index++) {
+      wheel.slots[level][index] = nullptr;
+    }
+  }
+  wheel.now = now;
+}
+
+/**
+ * Expire every timer due up to now; call it from the wait loops
+ * @param wheel
+ * @param now uptime in ms
+ */
+void timerWheelAdvance(TimerWheel &wheel, uint64_t now)
+{
+  while (wheel.now <= now) {
+    uint8_t index = wheel.now & TIMER_MASK;
+    if (index == 0) {
+      timerCascade(wheel);
+    }
+
+    Timer *timer = wheel.slots[0][index];
+    wheel.slots[0][index] = nullptr;
+    while (timer) {
+      Timer *next = timer->next;
+      timer->pprev = nullptr;
+      timer = next;
+    }
+
+    // Jump to the next occupied slot of level 0, or to where it wraps
+    uint8_t next = index + 1;
+    while (next < TIMER_SLOTS && !wheel.slots[0][next]) {
+      next++;
+    }
+    uint64_t skip = wheel.now - index + next;
+    wheel.now = skip <= now ? skip : now + 1;
+  }
+}
+
+/**
+ * @param timer
+ */
+void timerInit(Timer &timer)
+{
+  timer.next = nullptr;
+  timer.pprev = nullptr;
+  timer.expires = 0;
+}
+
+/**
+ * (Re)arm a timer
+ * @param wheel
+ * @param timer
+ * @param now uptime in ms
+ * @param timeout ms from now
+ */
+void timerStart(TimerWheel &wheel, Timer &timer, uint64_t now, uint32_t timeout)
+{
+  timerStop(timer);
+  timer.expires = now + timeout;
+  timerFile(wheel, timer);
+}
+
+/**
+ * @param timer
+ */
+void timerStop(Timer &timer)
+{
+  if (!timer.pprev) {
+    return;
+  }
+  *timer.pprev = timer.next;
+  if (timer.next) {
+    timer.next->pprev = timer.pprev;
+  }
+  timer.pprev = nullptr;
+}
+
+/**
+ * @param timer
+ * @return true until the wheel has advanced to the timer's expiry time
+ */
+bool timerPending(const Timer &timer)
+{
+  return timer.pprev != nullptr;
+}
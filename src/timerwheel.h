@@ -0,0 +1,44 @@
+/**
+  Hierarchical timer wheel with 1 ms ticks on the 64-bit uptime. TIMER_LEVELS wheels of
+  TIMER_SLOTS slots each: level n holds the timers due between TIMER_SLOTS^n and
+  TIMER_SLOTS^(n+1) ms ahead, in the slot picked by their expiry time. Starting or
+  stopping a timer is O(1), a doubly linked list insert or unlink. Advancing the wheel
+  runs level 0 one tick at a time; a stretch of empty level 0 slots is skipped in one step.
+  Each time level 0 wraps, the due slot of the level above is cascaded down.
+  Timers further out than the top level reaches wait in its last slot and are re-filed
+  when it cascades, so any 64-bit expiry works.
+
+  Timers are polled: a timer stops being pending once the wheel has advanced to its
+  expiry time. There are no callbacks, so nothing runs behind the caller's back. The
+  caller owns the Timer storage, and a Timer must stay in place while it is pending.
+  Plain C++ with no Arduino dependency, so the host tools run the same code.
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_SLOT_BITS 3
+#define TIMER_SLOTS     (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS    8 // 2^24 ms = 4.6 hours before the top level re-files
+
+struct Timer {
+  Timer *next;
+  Timer **pprev;    // the pointer to this timer in its slot list, null while not pending
+  uint64_t expires; // uptime in ms
+};
+
+struct TimerWheel {
+  Timer *slots[TIMER_LEVELS][TIMER_SLOTS];
+  uint64_t now;     // next tick to process
+};
+
+void timerWheelInit(TimerWheel &wheel, uint64_t now);
+void timerWheelAdvance(TimerWheel &wheel, uint64_t now);
+void timerInit(Timer &timer);
+void timerStart(TimerWheel &wheel, Timer &timer, uint64_t now, uint32_t timeout);
+void timerStop(Timer &timer);
+bool timerPending(const Timer &timer);
+
+#endif
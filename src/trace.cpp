@@ -0,0 +1,112 @@
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <util/atomic.h>
+
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_EVENTS - 1)
+#define TRACE_CLOCK_MAX 0xFFFFFFUL
+
+struct TraceEvent {
+  uint8_t id;
+  uint8_t dt;
+  uint16_t payload;
+};
+
+static TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+static volatile uint8_t traceHead = 0; // free-running, written by traceRecord
+static volatile uint8_t traceTail = 0; // free-running, written by traceFlush
+static uint32_t traceStamp = 0;
+static uint16_t traceDropped = 0;
+
+/**
+ * Append one raw event, the caller has already checked for room
+ * @param id
+ * @param dt
+ * @param payload
+ */
+static void tracePut(uint8_t id, uint8_t dt, uint16_t payload)
+{
+  TraceEvent &event = traceBuffer[traceHead & TRACE_BUFFER_MASK];
+  event.id = id;
+  event.dt = dt;
+  event.payload = payload;
+  traceHead++;
+}
+
+/**
+ * Record an event stamped with the time elapsed since the previous one.
+ * Safe to call from an ISR; takes a few microseconds and never touches the UART.
+ * @param id
+ * @param payload
+ */
+void traceRecord(uint8_t id, uint16_t payload)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint32_t now = millis();
+    uint32_t delta = now - traceStamp;
+    if (delta > TRACE_CLOCK_MAX) {
+      delta = TRACE_CLOCK_MAX;
+    }
+
+    uint8_t needed = 1 + (delta > 0xFF ? 1 : 0) + (traceDropped ? 1 : 0);
+    uint8_t used = traceHead - traceTail;
+    if (TRACE_BUFFER_EVENTS - used < needed) {
+      traceDropped++;
+      return;
+    }
+
+    if (traceDropped) {
+      tracePut(TRACE_EVENT_OVERFLOW, 0, traceDropped);
+      traceDropped = 0;
+    }
+    if (delta > 0xFF) {
+      tracePut(TRACE_EVENT_CLOCK, delta >> 16, delta & 0xFFFF);
+      delta = 0;
+    }
+    tracePut(id, delta, payload);
+    traceStamp = now;
+  }
+}
+
+/**
+ * Hand pending events to the UART as one packet if its TX buffer has room for it
+ */
+void traceFlush()
+{
+  uint8_t pending = traceHead - traceTail;
+  int room = Serial.availableForWrite();
+  int fit = (room - 4) / 4;
+
+  uint8_t count = pending;
+  if (count > TRACE_PACKET_EVENTS) {
+    count = TRACE_PACKET_EVENTS;
+  }
+  if (fit < count) {
+    count = fit > 0 ? fit : 0;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  uint8_t sum = count;
+  Serial.write(TRACE_SYNC1);
+  Serial.write(TRACE_SYNC2);
+  Serial.write(count);
+
+  uint8_t tail = traceTail;
+  for (uint8_t i = 0; i < count; i++) {
+    const TraceEvent &event = traceBuffer[tail & TRACE_BUFFER_MASK];
+    uint8_t bytes[4] = { event.id, event.dt, lowByte(event.payload), highByte(event.payload) };
+    for (uint8_t b = 0; b < 4; b++) {
+      Serial.write(bytes[b]);
+      sum += bytes[b];
+    }
+    tail++;
+  }
+  traceTail = tail;
+
+  Serial.write(sum);
+}
+
+#endif
@@ -0,0 +1,50 @@
+/**
+  Compact binary event trace.
+  Each event is 4 bytes (id, milliseconds since the previous event, 16-bit payload) kept
+  in a RAM ring and drained to Serial in checksummed packets whenever the UART has room:
+    0xA5 0x5A <count> <count x event> <sum of count and event bytes, mod 256>
+  Gaps longer than 255 ms are carried by a TRACE_EVENT_CLOCK event in front of the next one.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Ring capacity in events, must be a power of two no larger than 128
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 32
+#endif
+
+// Largest packet handed to the UART in one go, keeps a packet inside its 64 byte TX buffer
+#define TRACE_PACKET_EVENTS 8
+
+#define TRACE_SYNC1 0xA5
+#define TRACE_SYNC2 0x5A
+
+enum TraceEventId {
+  TRACE_EVENT_CLOCK    = 0, // dt = bits 23..16, payload = bits 15..0 of the elapsed ms
+  TRACE_EVENT_OVERFLOW = 1, // payload = events lost while the ring was full
+  TRACE_EVENT_BOOT     = 2, // payload = reset cause (see watchdog.h)
+  TRACE_EVENT_LOOP     = 3, // start of a control cycle
+  TRACE_EVENT_SENSOR   = 4, // payload = zone << 10 | reading
+  TRACE_EVENT_RELAY    = 5, // payload = zone << 8 | on
+  TRACE_EVENT_ESP_TX   = 6, // payload = bytes sent to the ESP
+  TRACE_EVENT_ESP_RX   = 7, // payload = bytes received from the ESP
+  TRACE_EVENT_PUMP_FAULT = 8, // payload = zone << 8 | reason (PumpFaultReason, see pumpmonitor.h)
+  TRACE_EVENT_RESERVOIR  = 9  // payload = interlocked << 15 | decilitres left
+};
+
+void traceRecord(uint8_t id, uint16_t payload);
+void traceFlush();
+
+#if TRACE_ENABLED
+  #define TRACE(id, payload) traceRecord((id), (payload))
+  #define TRACE_FLUSH() traceFlush()
+#else
+  #define TRACE(id, payload) do {} while (0)
+  #define TRACE_FLUSH() do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#include "uptime.h"
+
+/**
+ * @param uptime
+ * @param now current 32-bit clock
+ */
+void uptimeInit(Uptime &uptime, uint32_t now)
+{
+  uptime.wraps = 0;
+  uptime.last = now;
+}
+
+/**
+ * @param uptime
+ * @param now current 32-bit clock, never more than one wrap after the previous call
+ * @return now extended to 64 bits
+ */
+uint64_t uptimeExtend(Uptime &uptime, uint32_t now)
+{
+  if (now < uptime.last) {
+    uptime.wraps++;
+  }
+  uptime.last = now;
+  return (uint64_t)uptime.wraps << 32 | now;
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+static Uptime boardUptime = { 0, 0 };
+
+/**
+ * Main context only, it updates the wrap count
+ * @return ms since boot
+ */
+uint64_t uptimeMs()
+{
+  return uptimeExtend(boardUptime, millis());
+}
+#endif
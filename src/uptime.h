@@ -0,0 +1,22 @@
+/**
+  Monotonic 64-bit uptime in ms. millis() wraps after 49.7 days; uptimeExtend() counts
+  the wraps so callers never see time go backwards. It must see the 32-bit clock at
+  least once per wrap period, which the control loop does many times a second.
+  The extension is plain C++ so the host tools can run it across a forced wrap.
+*/
+
+#ifndef UPTIME_H
+#define UPTIME_H
+
+#include <stdint.h>
+
+struct Uptime {
+  uint32_t wraps;
+  uint32_t last; // 32-bit clock at the previous call
+};
+
+void uptimeInit(Uptime &uptime, uint32_t now);
+uint64_t uptimeExtend(Uptime &uptime, uint32_t now);
+uint64_t uptimeMs();
+
+#endif
@@ -0,0 +1,182 @@
+#include "watchdog.h"
+#if defined(ARDUINO)
+#include "relays.h"
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#endif
+
+#define CRASH_RECORD_MAGIC 0x5AFE
+
+struct CrashRecord {
+  uint16_t magic;
+  uint8_t task;     // task running when the watchdog interrupt fired
+  uint8_t hung;     // set by the watchdog interrupt
+  uint16_t resets;  // resets since the last power-on
+};
+
+// Survive a reset: the C runtime neither zeroes nor initialises .noinit
+static CrashRecord crashRecord __attribute__((section(".noinit")));
+#if defined(ARDUINO)
+static uint8_t mcusrCopy __attribute__((section(".noinit")));
+#endif
+
+static uint8_t resetCause = RESET_CAUSE_UNKNOWN;
+static uint8_t lastTask = WATCHDOG_NO_TASK;
+static volatile uint8_t currentTask = WATCHDOG_NO_TASK;
+static volatile uint8_t checkIns = 0;
+
+/**
+ * Pick the reset flags of this boot. Optiboot reads and clears MCUSR before the sketch
+ * starts; since 4.5 it passes the value on in r2, older versions (and other bootloaders)
+ * leave r2 undefined.
+ * @param mcusr MCUSR as the sketch finds it, only set without a bootloader
+ * @param passed r2 as the sketch finds it
+ * @return RESET_CAUSE_* flags, RESET_CAUSE_UNKNOWN when neither holds a plausible value
+ */
+uint8_t watchdogResetFlags(uint8_t mcusr, uint8_t passed)
+{
+  if (mcusr & RESET_CAUSE_FLAGS) {
+    return mcusr & RESET_CAUSE_FLAGS;
+  }
+  // One reset source at a time: a power-on also sets the brown-out flag, nothing else does
+  if (passed == RESET_CAUSE_POWER_ON || passed == (RESET_CAUSE_POWER_ON | RESET_CAUSE_BROWN_OUT) ||
+      passed == RESET_CAUSE_EXTERNAL || passed == RESET_CAUSE_BROWN_OUT || passed == RESET_CAUSE_WATCHDOG) {
+    return passed;
+  }
+  return RESET_CAUSE_UNKNOWN;
+}
+
+/**
+ * Decode why we reset from the flags and the crash record left in .noinit, and start
+ * the task bookkeeping afresh
+ * @param flags watchdogResetFlags() of this boot
+ */
+void watchdogBoot(uint8_t flags)
+{
+  resetCause = flags;
+  lastTask = WATCHDOG_NO_TASK;
+  currentTask = WATCHDOG_NO_TASK;
+  checkIns = 0;
+
+  // Our interrupt ran just before this reset: a watchdog reset whatever flags the
+  // bootloader left, an undefined r2 can look like a power-on
+  if (crashRecord.magic == CRASH_RECORD_MAGIC && crashRecord.hung) {
+    resetCause = RESET_CAUSE_HUNG_TASK | RESET_CAUSE_WATCHDOG;
+    lastTask = crashRecord.task;
+    crashRecord.resets++;
+  } else if (crashRecord.magic != CRASH_RECORD_MAGIC || (resetCause & RESET_CAUSE_POWER_ON)) {
+    crashRecord.magic = CRASH_RECORD_MAGIC;
+    crashRecord.resets = 0;
+  } else {
+    crashRecord.resets++;
+  }
+  crashRecord.task = WATCHDOG_NO_TASK;
+  crashRecord.hung = false;
+}
+
+/**
+ * Leave the breadcrumb of a watchdog timeout for the next boot
+ */
+void watchdogExpired()
+{
+  crashRecord.magic = CRASH_RECORD_MAGIC;
+  crashRecord.task = currentTask;
+  crashRecord.hung = true;
+}
+
+#if defined(ARDUINO)
+/**
+ * Runs from .init3, before the bootloader-armed watchdog can fire again during C++ init:
+ * keep the reset flags for later and stop the watchdog
+ */
+void captureResetFlags() __attribute__((naked, used, section(".init3")));
+void captureResetFlags()
+{
+  uint8_t passed;
+  __asm__ __volatile__ ("mov %0, r2" : "=r" (passed));
+  mcusrCopy = watchdogResetFlags(MCUSR, passed);
+  MCUSR = 0;
+  wdt_disable();
+}
+
+/**
+ * First stage of a watchdog timeout: make the pumps safe, leave a breadcrumb
+ * and let the watchdog reset the board 15 ms later
+ */
+ISR(WDT_vect)
+{
+  relaysWatchdogOff();
+  watchdogExpired();
+
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDE);
+}
+
+/**
+ * Decode why we reset and arm the watchdog (8 s, interrupt + reset).
+ * Call right after relaysBegin(), the watchdog interrupt switches the relays off.
+ */
+void watchdogBegin()
+{
+  watchdogBoot(mcusrCopy);
+
+  cli();
+  wdt_reset();
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDIE) | _BV(WDE) | _BV(WDP3) | _BV(WDP0);
+  sei();
+}
+#endif
+
+/**
+ * Mark a task as running, this is the breadcrumb left behind if the watchdog fires
+ * @param task
+ */
+void watchdogEnter(uint8_t task)
+{
+  currentTask = task;
+}
+
+/**
+ * A task finished its share of the cycle, feed the watchdog once every task has done so
+ * @param task
+ * @return true when this check-in fed the watchdog
+ */
+bool watchdogCheckIn(uint8_t task)
+{
+  currentTask = WATCHDOG_NO_TASK;
+  checkIns |= 1 << task;
+
+  if (checkIns != WATCHDOG_ALL_TASKS) {
+    return false;
+  }
+  checkIns = 0;
+#if defined(ARDUINO)
+  wdt_reset();
+#endif
+  return true;
+}
+
+/**
+ * @return RESET_CAUSE_* flags of the last reset
+ */
+uint8_t watchdogResetCause()
+{
+  return resetCause;
+}
+
+/**
+ * @return task that was running when the watchdog fired, WATCHDOG_NO_TASK otherwise
+ */
+uint8_t watchdogBreadcrumb()
+{
+  return lastTask;
+}
+
+/**
+ * @return resets since the last power-on
+ */
+uint16_t watchdogResetCount()
+{
+  return crashRecord.resets;
+}
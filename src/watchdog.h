@@ -0,0 +1,46 @@
+/**
+  Hardware watchdog supervision of the control loop.
+  Every task checks in once per cycle and the watchdog is only fed when all of them did,
+  so a single wedged task is enough to trip it. The watchdog runs in interrupt + reset
+  mode: its interrupt switches every pump relay off and records which task was running,
+  then the board resets. The reset cause and that breadcrumb survive in .noinit RAM.
+  Everything but the AVR glue (reset flag capture, the interrupt, arming) also builds on
+  a host, so tools can force a stall and check the recovery.
+*/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+
+enum WatchdogTask {
+  TASK_ESP_DRAIN = 0,
+  TASK_SENSORS   = 1,
+  TASK_TELEMETRY = 2,
+  TASK_COUNT     = 3
+};
+
+#define WATCHDOG_ALL_TASKS ((1 << TASK_COUNT) - 1)
+#define WATCHDOG_NO_TASK   0xFF
+
+// Reset cause as reported in telemetry: MCUSR flags plus our own marker. No MCUSR flag
+// at all means unknown: a bootloader cleared MCUSR and did not pass it on.
+#define RESET_CAUSE_UNKNOWN   0
+#define RESET_CAUSE_POWER_ON  0x01 // PORF
+#define RESET_CAUSE_EXTERNAL  0x02 // EXTRF
+#define RESET_CAUSE_BROWN_OUT 0x04 // BORF
+#define RESET_CAUSE_WATCHDOG  0x08 // WDRF
+#define RESET_CAUSE_FLAGS     0x0F
+#define RESET_CAUSE_HUNG_TASK 0x80 // our watchdog interrupt ran before the reset
+
+void watchdogBegin();
+uint8_t watchdogResetFlags(uint8_t mcusr, uint8_t passed);
+void watchdogBoot(uint8_t flags);
+void watchdogExpired();
+void watchdogEnter(uint8_t task);
+bool watchdogCheckIn(uint8_t task);
+uint8_t watchdogResetCause();
+uint8_t watchdogBreadcrumb();
+uint16_t watchdogResetCount();
+
+#endif
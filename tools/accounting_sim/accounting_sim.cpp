@@ -0,0 +1,228 @@
+/**
+  Pump accounting check: the real ledger of src/pumps.cpp through a simulated month,
+  compressed to the control loop's cadence (one pass every 3 s, each pump switching on
+  the millisecond it would), against exact 64-bit reference counters.
+
+  Every zone waters 1..4 times a day for 5..180 s, and now and then two zones overlap.
+  The board's millis() starts 10 days before its 32-bit wrap, so the wrap falls in the
+  month, and one run is placed across it. --resets N cuts the power N times at random:
+  the relays drop, RAM is lost, the ledger restarts from the last checkpoint image and
+  millis() from 0. loop() checkpoints every pass, PUMP_CHECKPOINT_INTERVAL applies.
+
+  Checked: without resets the ledger's run time and activations equal the reference to
+  the millisecond and pumpEstimatedMillilitres() stays within one second of flow of the
+  exact volume; with resets no zone loses more than what ran since the last checkpoint
+  before each reset. Output: per-zone totals, the largest differences, and the EEPROM
+  bytes rewritten per checkpoint (EEPROM.put() skips unchanged bytes).
+  Any failed check is printed and makes the exit status non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/accounting_sim/accounting_sim.cpp src/pumps.cpp -o accounting_sim
+    ./accounting_sim --days 31
+    ./accounting_sim --days 31 --resets 5
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pumps.h"
+
+#define LOOP_MS 3000ULL
+#define DAY_MS  86400000ULL
+
+struct Run {
+  uint64_t start, length; // simulated time, ms
+  uint8_t zone;
+};
+
+static uint32_t failures = 0;
+
+static void check(bool ok, const char *what, int zone)
+{
+  if (!ok) {
+    failures++;
+    printf("FAIL zone %d: %s\n", zone + 1, what);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t days = 31, resets = 0;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--days")) {
+      days = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--resets")) {
+      resets = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--days N] [--resets N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const uint64_t end = days * DAY_MS;
+  const uint64_t wrapAt = 10 * DAY_MS; // millis() = 2^32 here
+
+  // The schedule: runs at random times, one of them across the wrap
+  std::vector<Run> runs;
+  for (uint32_t day = 0; day < days; day++) {
+    for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+      int count = 1 + random() % 4;
+      for (int n = 0; n < count; n++) {
+        uint64_t start = day * DAY_MS + (uint64_t)(uniform(random) * (DAY_MS - 200000));
+        runs.push_back({ start, 5000 + (uint64_t)(uniform(random) * 175000), zone });
+      }
+    }
+  }
+  runs.push_back({ wrapAt - 40000, 90000, 0 });
+  std::sort(runs.begin(), runs.end(), [](const Run &a, const Run &b) { return a.start < b.start; });
+
+  // Power cuts
+  std::vector<uint64_t> cuts;
+  for (uint32_t n = 0; n < resets; n++) {
+    cuts.push_back((uint64_t)(uniform(random) * end));
+  }
+  std::sort(cuts.begin(), cuts.end());
+
+  // Exact reference and the board
+  uint64_t refOnMs[ZONE_COUNT] = {}, lostMs[ZONE_COUNT] = {};
+  uint32_t refRuns[ZONE_COUNT] = {}, lostRuns[ZONE_COUNT] = {};
+  uint64_t sinceCheckpointMs[ZONE_COUNT] = {};
+  uint32_t sinceCheckpointRuns[ZONE_COUNT] = {};
+  uint64_t onSince[ZONE_COUNT] = {};
+  bool on[ZONE_COUNT] = {};
+
+  PumpStats eeprom[ZONE_COUNT], saved[ZONE_COUNT];
+  bool eepromValid = false;
+  uint32_t checkpoints = 0, bytesWritten = 0, maxBytes = 0;
+
+  PumpLedger ledger;
+  uint64_t bootAt = 0, bootMillis = (1ULL << 32) - wrapAt;
+  auto boardMillis = [&](uint64_t now) { return (uint32_t)(bootMillis + (now - bootAt)); };
+  pumpLedgerInit(ledger, nullptr, boardMillis(0));
+
+  auto switchPump = [&](uint8_t zone, bool state, uint64_t now) {
+    if (on[zone] == state) {
+      return;
+    }
+    on[zone] = state;
+    pumpLedgerSwitch(ledger, zone, state, boardMillis(now));
+    if (state) {
+      onSince[zone] = now;
+      refRuns[zone]++;
+      sinceCheckpointRuns[zone]++;
+    } else {
+      refOnMs[zone] += now - onSince[zone];
+      sinceCheckpointMs[zone] += now - onSince[zone];
+    }
+  };
+
+  size_t next = 0, cut = 0;
+  std::vector<std::pair<uint64_t, uint8_t>> offAt; // pump off times of running runs
+  for (uint64_t now = 0; now < end;) {
+    // The next event: a loop pass, a pump switching on or off, a power cut
+    uint64_t pass = (now / LOOP_MS + 1) * LOOP_MS;
+    uint64_t at = pass;
+    if (next < runs.size()) {
+      at = std::min(at, runs[next].start);
+    }
+    for (auto &off : offAt) {
+      at = std::min(at, off.first);
+    }
+    if (cut < cuts.size()) {
+      at = std::min(at, cuts[cut]);
+    }
+    now = at;
+
+    for (auto off = offAt.begin(); off != offAt.end();) {
+      if (off->first <= now) {
+        switchPump(off->second, false, now);
+        off = offAt.erase(off);
+      } else {
+        ++off;
+      }
+    }
+    while (next < runs.size() && runs[next].start <= now) {
+      const Run &run = runs[next++];
+      if (!on[run.zone]) {
+        switchPump(run.zone, true, now);
+        offAt.push_back({ now + run.length, run.zone });
+      }
+    }
+
+    if (cut < cuts.size() && cuts[cut] <= now) {
+      cut++;
+      // Whatever ran since the last checkpoint is gone, the relays drop
+      for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        if (on[zone]) {
+          refOnMs[zone] += now - onSince[zone];
+          sinceCheckpointMs[zone] += now - onSince[zone];
+          on[zone] = false;
+        }
+        lostMs[zone] += sinceCheckpointMs[zone];
+        lostRuns[zone] += sinceCheckpointRuns[zone];
+        sinceCheckpointMs[zone] = 0;
+        sinceCheckpointRuns[zone] = 0;
+      }
+      offAt.clear();
+      bootAt = now;
+      bootMillis = 0;
+      pumpLedgerInit(ledger, eepromValid ? eeprom : nullptr, boardMillis(now));
+      continue;
+    }
+
+    if (now == pass && pumpLedgerCheckpoint(ledger, saved, false, boardMillis(now))) {
+      uint32_t bytes = 0;
+      for (size_t i = 0; i < sizeof(saved); i++) {
+        bytes += !eepromValid || ((uint8_t *)saved)[i] != ((uint8_t *)eeprom)[i];
+      }
+      memcpy(eeprom, saved, sizeof(eeprom));
+      eepromValid = true;
+      checkpoints++;
+      bytesWritten += bytes;
+      maxBytes = std::max(maxBytes, bytes);
+      for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        sinceCheckpointMs[zone] = 0;
+        sinceCheckpointRuns[zone] = 0;
+        if (on[zone]) {
+          // The open run was folded in up to now
+          refOnMs[zone] += now - onSince[zone];
+          onSince[zone] = now;
+        }
+      }
+    }
+  }
+
+  int64_t worstMs = 0, worstMl = 0;
+  printf("%u days, %zu runs, %u power cuts, millis() wraps at day %.0f unless a cut came first\n", days, runs.size(), resets,
+         wrapAt / (double)DAY_MS);
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    uint32_t ledgerMs = pumpLedgerOnMs(ledger, zone, boardMillis(end));
+    uint64_t expectMs = refOnMs[zone] + (on[zone] ? end - onSince[zone] : 0) - lostMs[zone];
+    uint32_t expectRuns = refRuns[zone] - lostRuns[zone];
+    int64_t diffMs = (int64_t)ledgerMs - (int64_t)expectMs;
+    int64_t exactMl = (int64_t)(expectMs * PUMP_FLOW_ML_PER_MIN / 60000);
+    int64_t diffMl = (int64_t)pumpEstimatedMillilitres(ledgerMs / 1000) - exactMl;
+    worstMs = std::max<int64_t>(worstMs, llabs(diffMs));
+    worstMl = std::max<int64_t>(worstMl, llabs(diffMl));
+
+    printf("zone %2d: %7.0f s  %4u runs  %8u mL | lost to resets %6.0f s %2u runs | diff %lld ms %lld mL\n",
+           zone + 1, ledgerMs / 1000.0, ledger.zones[zone].activations,
+           pumpEstimatedMillilitres(ledgerMs / 1000), lostMs[zone] / 1000.0, lostRuns[zone],
+           (long long)diffMs, (long long)diffMl);
+    check(diffMs == 0, "run time differs from the reference", zone);
+    check(ledger.zones[zone].activations == expectRuns, "activations differ from the reference", zone);
+    check(llabs(diffMl) <= PUMP_FLOW_ML_PER_MIN / 60 + 1, "volume off by more than one second of flow", zone);
+  }
+  printf("largest difference %lld ms, %lld mL\n", (long long)worstMs, (long long)worstMl);
+  printf("checkpoints %u, EEPROM bytes rewritten %u (max %u per checkpoint, record %zu)\n", checkpoints,
+         bytesWritten, maxBytes, sizeof(eeprom));
+  return failures ? 1 : 0;
+}
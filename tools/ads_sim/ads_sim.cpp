@@ -0,0 +1,176 @@
+/**
+  ADS1115 backend model: the I2C transactions of sensorsPoll() (src/sensors.cpp) timed
+  bit by bit on the bus, against a model of the ADS1115 converting continuously, for
+  every data rate at 100 and 400 kHz.
+
+  The device: writing the config register restarts the conversion on the selected input
+  after the STOP, every conversion takes 1/SPS (the internal oscillator is off by up to
+  10%, drawn per trial), the next one follows on the same input, and each end pulses
+  ALERT/RDY, which sets adsReady. The conversion register holds the last result.
+  The firmware: sensorsPoll() runs every --poll-us while the loop waits, and not at all
+  during one --busy-ms stretch per 100 ms of the loop's own work. With adsReady set it
+  reads the conversion register (pointer write, 2-byte read) and writes the config of the
+  next input (3 bytes), then clears adsReady, in that order.
+
+  The bus: a byte takes 9 SCL periods, START and STOP one each, and the TWI interrupt
+  holds SCL low for TWI_EVENT_US after every START and byte. Each Wire call costs
+  WIRE_CALL_US of library code on top. The two constants are estimates from the Wire
+  code path at 16 MHz, not measurements. Wire waits for the bus, so the whole transaction
+  time is CPU time.
+
+  Checked: every sample credited to an input was converted on that input. Output per
+  data rate and clock: samples per second in total and per zone, the time from a result
+  being ready to the next conversion starting, and the CPU share sensorsPoll() takes.
+  Any failed check is printed and makes the exit status non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/ads_sim/ads_sim.cpp -o ads_sim
+    ./ads_sim --zones 4 --poll-us 50 --busy-ms 5
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#define TWI_EVENT_US 4.0
+#define WIRE_CALL_US 12.0
+#define RUN_US       10000000.0 // 10 s per configuration
+
+static const uint16_t dataRates[8] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+
+/**
+ * @param bytes address byte included
+ * @param sclHz
+ * @return microseconds one Wire call keeps the CPU waiting
+ */
+static double transactionUs(uint8_t bytes, double sclHz)
+{
+  double bitUs = 1e6 / sclHz;
+  return WIRE_CALL_US + (2 + 9 * bytes) * bitUs + (1 + bytes) * TWI_EVENT_US;
+}
+
+struct Result {
+  double samples;
+  double busyUs;
+  double restartUs; // sum of result ready to next conversion start
+  uint32_t misattributed;
+};
+
+static Result run(uint8_t rate, double sclHz, uint8_t zones, double pollUs, double busyMs, std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const double convUs = 1e6 / dataRates[rate] * (0.9 + 0.2 * uniform(random));
+  const double busyUs = busyMs * 1000, busyPhase = 100000 * uniform(random);
+
+  // sensorsPoll(): pointer write (address + register), read (address + 2), config (address + 3)
+  const double readUs = transactionUs(2, sclHz) + transactionUs(3, sclHz);
+  const double writeUs = transactionUs(4, sclHz);
+
+  // The device
+  uint8_t convInput = 0, resultInput = 0;
+  double convStart = 0;
+  bool haveResult = false;
+
+  // The firmware
+  uint8_t adsInput = 0;
+  bool adsReady = false;
+
+  Result result = { 0, 0, 0, 0 };
+  auto nextPoll = [&](double t) {
+    double inLoop = std::fmod(t + busyPhase, 100000.0);
+    if (inLoop < busyUs) {
+      return t + busyUs - inLoop;
+    }
+    return (std::floor(t / pollUs) + 1) * pollUs;
+  };
+  // Conversions finishing up to t set adsReady; returns the end of the first one
+  auto advance = [&](double t) {
+    double done = -1;
+    while (convStart + convUs <= t) {
+      convStart += convUs;
+      resultInput = convInput;
+      haveResult = true;
+      adsReady = true;
+      if (done < 0) {
+        done = convStart;
+      }
+    }
+    return done;
+  };
+
+  double t = 0, readyAt = -1;
+  while (t < RUN_US) {
+    t = nextPoll(t);
+    double done = advance(t);
+    if (done >= 0 && readyAt < 0) {
+      readyAt = done;
+    }
+    if (!adsReady) {
+      continue;
+    }
+
+    // Read the conversion register: whatever finished before the read's last byte
+    double start = t;
+    t += readUs;
+    advance(t);
+    bool fromInput = haveResult && resultInput == adsInput;
+    result.misattributed += !fromInput;
+    result.samples++;
+
+    // Config write: the next input converts from the STOP on
+    adsInput = (adsInput + 1) % zones;
+    t += writeUs;
+    advance(t);
+    convInput = adsInput;
+    convStart = t;
+    adsReady = false;
+
+    result.busyUs += t - start;
+    result.restartUs += t - (readyAt >= 0 ? readyAt : start);
+    readyAt = -1;
+  }
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  uint8_t zones = 4;
+  double pollUs = 50, busyMs = 5;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--zones")) {
+      zones = (uint8_t)std::min(4, std::max(1, atoi(argv[i + 1])));
+    } else if (!strcmp(argv[i], "--poll-us")) {
+      pollUs = std::max(1.0, atof(argv[i + 1]));
+    } else if (!strcmp(argv[i], "--busy-ms")) {
+      busyMs = std::min(99.0, std::max(0.0, atof(argv[i + 1])));
+    } else {
+      fprintf(stderr, "usage: %s [--zones 1..4] [--poll-us N] [--busy-ms N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  uint32_t failures = 0;
+  printf("%u zones, polled every %.0f us, %.0f ms of 100 without polls\n", zones, pollUs, busyMs);
+  printf("%6s %5s %9s %9s %13s %6s %5s\n", "SPS", "kHz", "samples/s", "per zone", "ready->next us", "CPU", "wrong");
+  for (double sclHz : { 100000.0, 400000.0 }) {
+    for (uint8_t rate = 0; rate < 8; rate++) {
+      Result result = run(rate, sclHz, zones, pollUs, busyMs, random);
+      double seconds = RUN_US / 1e6;
+      printf("%6u %5.0f %9.1f %9.1f %13.0f %5.1f%% %5u\n", dataRates[rate], sclHz / 1000, result.samples / seconds,
+             result.samples / seconds / zones, result.restartUs / std::max(1.0, result.samples),
+             100 * result.busyUs / RUN_US, result.misattributed);
+      if (result.misattributed) {
+        printf("FAIL %u SPS at %.0f kHz: %u samples credited to the wrong input\n", dataRates[rate], sclHz / 1000,
+               result.misattributed);
+        failures++;
+      }
+    }
+  }
+  return failures ? 1 : 0;
+}
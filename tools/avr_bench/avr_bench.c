@@ -0,0 +1,187 @@
+/*
+  Cycle-accurate benchmark runner: executes the [env:uno_bench] firmware in simavr and
+  turns its GPIOR0 markers (see bench_ops.h) into exact cycle counts per operation, with
+  the stack and heap each run used and the static SRAM of the build.
+
+  The ADC inputs are driven from the command line (millivolts, AVCC = AREF = 5 V) and the
+  hardware UART output is counted, and echoed to stderr with --uart.
+
+  Output is one JSON object per line: one per operation, then a summary. Cycles are the
+  minimum and maximum over the runs, minus the "empty" operation (markers and call), and
+  include the interrupts taken meanwhile (Timer0, UART), as on the board.
+
+  Build and run (Linux, libsimavr and libelf installed):
+    pio run -e uno_bench
+    cc -O2 -std=c99 tools/avr_bench/avr_bench.c -lsimavr -lelf -o avr_bench
+    ./avr_bench .pio/build/uno_bench/firmware.elf --adc 0=2200 --adc 1=3100 > bench.jsonl
+    python3 tools/avr_bench/gate.py baseline.jsonl bench.jsonl
+
+  The same runner measures the larger boards: sensorsScan is then the full-scan period
+  of the multiplexers (A0 carries channels 0..15, A1 16..31) and relaysFlush the update
+  of a chain of 1, 2 or 4 74HC595s.
+    pio run -e uno_bench_zones8 && ./avr_bench .pio/build/uno_bench_zones8/firmware.elf --adc 0=2200
+    pio run -e uno_bench_zones16 && ./avr_bench .pio/build/uno_bench_zones16/firmware.elf --adc 0=2200
+    pio run -e uno_bench_zones32 && ./avr_bench .pio/build/uno_bench_zones32/firmware.elf --adc 0=2200 --adc 1=3100
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_adc.h>
+#include <simavr/avr_uart.h>
+#include "bench_ops.h"
+
+#define FREQUENCY   16000000
+#define CYCLE_LIMIT (60ULL * FREQUENCY) // a run that is not done after 60 s is hung
+
+struct OpResult {
+  const char *name;
+  uint64_t started;
+  uint64_t minCycles;
+  uint64_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t runs;
+  uint32_t maxStack;
+  uint32_t maxHeap;
+};
+
+#define BENCH_OP_ENTRY(id, name) [id] = { name, 0, UINT64_MAX, 0, 0, 0, 0, 0 },
+static struct OpResult ops[BENCH_OP_COUNT + 1] = { BENCH_OPS(BENCH_OP_ENTRY) };
+
+static int lastOp = 0;
+static uint32_t staticSram = 0;
+static uint64_t uartBytes = 0;
+static int echoUart = 0;
+static int done = 0;
+
+/**
+ * GPIOR0 write hook: every marker of the benchmark firmware lands here
+ */
+static void onEvent(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  (void)param;
+  avr->data[addr] = v;
+  uint32_t value = avr->data[BENCH_VALUE_LO_ADDR] | avr->data[BENCH_VALUE_HI_ADDR] << 8;
+
+  if (v == BENCH_EVENT_DONE) {
+    done = 1;
+  } else if (v == BENCH_EVENT_STATIC) {
+    staticSram = value;
+  } else if (v == BENCH_EVENT_STACK) {
+    if (ops[lastOp].maxStack < value) {
+      ops[lastOp].maxStack = value;
+    }
+  } else if (v == BENCH_EVENT_HEAP) {
+    if (ops[lastOp].maxHeap < value) {
+      ops[lastOp].maxHeap = value;
+    }
+  } else if ((v & ~BENCH_EVENT_END) >= 1 && (v & ~BENCH_EVENT_END) <= BENCH_OP_COUNT) {
+    struct OpResult *op = &ops[v & ~BENCH_EVENT_END];
+    lastOp = v & ~BENCH_EVENT_END;
+    if (!(v & BENCH_EVENT_END)) {
+      op->started = avr->cycle;
+      return;
+    }
+    uint64_t cycles = avr->cycle - op->started;
+    op->minCycles = cycles < op->minCycles ? cycles : op->minCycles;
+    op->maxCycles = cycles > op->maxCycles ? cycles : op->maxCycles;
+    op->totalCycles += cycles;
+    op->runs++;
+  }
+}
+
+static void onUart(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq;
+  (void)param;
+  uartBytes++;
+  if (echoUart) {
+    fputc((int)value, stderr);
+  }
+}
+
+static int usage(const char *program)
+{
+  fprintf(stderr, "usage: %s firmware.elf [--adc CHANNEL=MILLIVOLTS]... [--uart]\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[1], &firmware)) {
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+  strcpy(firmware.mmcu, "atmega328p");
+  firmware.frequency = FREQUENCY;
+
+  avr_t *avr = avr_make_mcu_by_name(firmware.mmcu);
+  if (!avr) {
+    fprintf(stderr, "simavr has no %s core\n", firmware.mmcu);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->vcc = avr->avcc = avr->aref = 5000;
+
+  avr_register_io_write(avr, BENCH_EVENT_ADDR, onEvent, NULL);
+
+  // Keep simavr from printing the UART itself, we count (and maybe echo) the bytes
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onUart, NULL);
+
+  for (int i = 2; i < argc; i++) {
+    int channel;
+    unsigned millivolts;
+    if (!strcmp(argv[i], "--uart")) {
+      echoUart = 1;
+    } else if (!strcmp(argv[i], "--adc") && i + 1 < argc && sscanf(argv[i + 1], "%d=%u", &channel, &millivolts) == 2 &&
+               channel >= 0 && channel < 8) {
+      avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + channel), millivolts);
+      i++;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  while (!done && avr->cycle < CYCLE_LIMIT) {
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) {
+      break;
+    }
+  }
+  if (!done) {
+    fprintf(stderr, "firmware did not finish the benchmarks (cycle %llu)\n", (unsigned long long)avr->cycle);
+    return 1;
+  }
+
+  uint64_t overhead = ops[1].runs ? ops[1].minCycles : 0;
+  for (int id = 2; id <= BENCH_OP_COUNT; id++) {
+    const struct OpResult *op = &ops[id];
+    if (!op->runs) {
+      continue;
+    }
+    printf("{\"op\":\"%s\",\"runs\":%u,\"cycles_min\":%llu,\"cycles_max\":%llu,\"cycles_mean\":%llu,"
+           "\"us_min\":%.1f,\"stack_bytes\":%u,\"heap_bytes\":%u}\n",
+           op->name, op->runs, (unsigned long long)(op->minCycles - overhead),
+           (unsigned long long)(op->maxCycles - overhead),
+           (unsigned long long)(op->totalCycles / op->runs - overhead),
+           (op->minCycles - overhead) * 1e6 / FREQUENCY, op->maxStack, op->maxHeap);
+  }
+  printf("{\"summary\":true,\"static_sram_bytes\":%u,\"sram_bytes\":2048,\"marker_overhead_cycles\":%llu,"
+         "\"uart_bytes\":%llu}\n",
+         staticSram, (unsigned long long)overhead, (unsigned long long)uartBytes);
+  return 0;
+}
@@ -0,0 +1,283 @@
+/**
+  Benchmark entry point, built instead of main.cpp by [env:uno_bench] and, with 8, 16
+  and 32 multiplexed zones behind 74HC595 relays, [env:uno_bench_zones8/16/32]. Runs each
+  operation a few times between GPIOR0 markers, measuring the stack it used by painting
+  the free RAM first, and reports through the protocol in bench_ops.h. Run the ELF with
+  tools/avr_bench/avr_bench, which counts the cycles in simavr.
+*/
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <SoftwareSerial.h>
+#include "config.h"
+#include "log.h"
+#include "pumps.h"
+#include "pumpmonitor.h"
+#include "relays.h"
+#include "sensors.h"
+#include "telemetry.h"
+#include "ring.h"
+#include "fastgpio.h"
+#include "bench_ops.h"
+
+#define BENCH_RUNS        8
+#define BENCH_SERIAL_RUNS 2    // one frame takes ~200 ms at 9600 baud
+#define BENCH_PAINT       0xA5
+#define BENCH_STACK_GUARD 8    // leaves benchRun's own frame and memset's call unpainted
+#define BENCH_HEAP_MARGIN 32   // room for malloc's bookkeeping between heap and paint
+#define BENCH_CLEAN_RUN   16   // this many untouched bytes in a row end the used stack
+#define BENCH_RING_ITEMS  32   // items per ring op, divide its cycles by this
+
+extern char __bss_end;
+extern char __heap_start;
+extern char *__brkval;
+
+typedef void (*BenchOp)();
+
+static SoftwareSerial wifi(ESP_RX_PIN, ESP_TX_PIN);
+static float sensorValues[ZONE_COUNT];
+static String frame;
+static Ring<uint8_t, 64> ring;
+static volatile uint8_t ringSink;
+
+// Four GPIO writes the three ways the firmware could drive the relay pins
+static constexpr uint8_t gpioPins[] = RELAY_PINS;
+static uint8_t gpioLevel = LOW;
+
+/**
+ * @param event one of BENCH_EVENT_*
+ * @param value
+ */
+static void benchReport(uint8_t event, uint16_t value)
+{
+  GPIOR1 = value & 0xFF;
+  GPIOR2 = value >> 8;
+  GPIOR0 = event;
+}
+
+/**
+ * @return first byte past the heap, or past .bss while the heap is empty
+ */
+static uint8_t *benchHeapEnd()
+{
+  return (uint8_t *)(__brkval ? __brkval : &__heap_start);
+}
+
+/**
+ * Run an operation between markers and report its stack and heap use
+ * @param op id from BENCH_OPS
+ * @param run
+ * @param runs
+ */
+static void benchRun(uint8_t op, BenchOp run, uint8_t runs)
+{
+  for (uint8_t i = 0; i < runs; i++) {
+    uint8_t *caller = (uint8_t *)SP;
+    uint8_t *top = caller - BENCH_STACK_GUARD;
+    uint8_t *bottom = benchHeapEnd() + BENCH_HEAP_MARGIN;
+    memset(bottom, BENCH_PAINT, top - bottom);
+
+    GPIOR0 = op;
+    run();
+    GPIOR0 = op | BENCH_EVENT_END;
+
+    // Walk down from the top: the stack ends where the paint is intact again. The heap
+    // may have grown into the bottom of the paint, so never scan from there.
+    uint8_t *lowest = top;
+    uint8_t clean = 0;
+    for (uint8_t *p = top - 1; p >= bottom && clean < BENCH_CLEAN_RUN; p--) {
+      if (*p == BENCH_PAINT) {
+        clean++;
+      } else {
+        clean = 0;
+        lowest = p;
+      }
+    }
+    benchReport(BENCH_EVENT_STACK, caller - lowest);
+    benchReport(BENCH_EVENT_HEAP, benchHeapEnd() - (uint8_t *)&__heap_start);
+  }
+}
+
+static void benchEmpty()
+{
+}
+
+static void benchPrepareData()
+{
+  frame = prepareDataForWiFi(sensorValues, 0);
+}
+
+/**
+ * The ArduinoJson document prepareDataForWiFi() used to build, kept as the reference
+ * for the schema encoder
+ */
+static void benchPrepareDataArduinoJson()
+{
+  StaticJsonDocument<320> doc;
+
+  for (uint8_t zone = 0; zone < TELEMETRY_FRAME_ZONES; zone++) {
+    char key[16];
+    snprintf_P(key, sizeof(key), PSTR("sensor%dValue"), zone + 1);
+    doc[key] = String(sensorValues[zone]);
+  }
+
+  JsonArray onSeconds = doc.createNestedArray("pumpSec");
+  JsonArray activations = doc.createNestedArray("pumpRuns");
+  JsonArray millilitres = doc.createNestedArray("pumpMl");
+  for (uint8_t zone = 0; zone < TELEMETRY_FRAME_ZONES; zone++) {
+    onSeconds.add(pumpOnSeconds(zone));
+    activations.add(pumpActivations(zone));
+    millilitres.add(pumpMillilitres(zone));
+  }
+  doc["pumpFault"] = pumpFaults();
+
+  char jsonBuffer[512];
+  serializeJson(doc, jsonBuffer);
+  frame = jsonBuffer;
+}
+
+static void benchSensorsScan()
+{
+  sensorsScan(sensorValues, (ZoneMask)~0);
+}
+
+static void benchRingPush()
+{
+  for (uint8_t i = 0; i < BENCH_RING_ITEMS; i++) {
+    ring.push(i);
+  }
+}
+
+static void benchRingPop()
+{
+  uint8_t item;
+  while (ring.pop(item)) {
+    ringSink = item;
+  }
+}
+
+/**
+ * Fill through reserve()/commit() and drain through peek()/consume(), two spans each
+ * when the storage wraps
+ */
+static void benchRingSpans()
+{
+  uint8_t left = BENCH_RING_ITEMS;
+  while (left) {
+    uint8_t *slots;
+    uint8_t count = ring.reserve(slots);
+    if (count > left) {
+      count = left;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      slots[i] = i;
+    }
+    ring.commit(count);
+    left -= count;
+  }
+
+  const uint8_t *span;
+  uint8_t count;
+  while ((count = ring.peek(span)) > 0) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      sum += span[i];
+    }
+    ringSink = sum;
+    ring.consume(count);
+  }
+}
+
+/**
+ * Flip every relay and push the new state: a full write, one SPI frame on a 74HC595
+ * chain, one batched write per port with GPIO relays
+ */
+static void benchRelaysFlush()
+{
+  ZoneMask state = ~relaysState();
+  for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+    relaySet(zone, bitRead(state, zone));
+  }
+  relaysFlush();
+}
+
+static void benchDigitalWrite()
+{
+  gpioLevel = !gpioLevel;
+  for (uint8_t i = 0; i < 4; i++) {
+    digitalWrite(gpioPins[i], gpioLevel);
+  }
+}
+
+static void benchFastPin()
+{
+  gpioLevel = !gpioLevel;
+  FastPin<gpioPins[0]>::write(gpioLevel);
+  FastPin<gpioPins[1]>::write(gpioLevel);
+  FastPin<gpioPins[2]>::write(gpioLevel);
+  FastPin<gpioPins[3]>::write(gpioLevel);
+}
+
+static void benchFastPortBatch()
+{
+  FastPortBatch batch;
+
+  gpioLevel = !gpioLevel;
+  for (uint8_t i = 0; i < 4; i++) {
+    batch.set(gpioPins[i], gpioLevel);
+  }
+  batch.apply();
+}
+
+static void benchSoftSerialSend()
+{
+  wifi.print(frame);
+}
+
+static void benchLogLine()
+{
+  LOG_INFO("Plant %d - Moisture Level:%d", 1, (int)sensorValues[0]);
+}
+
+static void benchLogFlush()
+{
+  logFlush();
+}
+
+void setup() {
+  benchReport(BENCH_EVENT_STATIC, (uint8_t *)&__bss_end - (uint8_t *)RAMSTART);
+
+  logBegin(9600);
+  relaysBegin();
+  pumpsBegin();
+  sensorsBegin();
+  wifi.begin(9600);
+
+  benchRun(1, benchEmpty, BENCH_RUNS);
+  benchRun(3, benchSensorsScan, BENCH_RUNS);
+  benchRun(2, benchPrepareData, BENCH_RUNS);
+  benchRun(7, benchPrepareDataArduinoJson, BENCH_RUNS);
+  benchRun(4, benchSoftSerialSend, BENCH_SERIAL_RUNS);
+  benchRun(5, benchLogLine, BENCH_RUNS);
+  benchRun(6, benchLogFlush, BENCH_RUNS);
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    // Runs of one each, so push and pop always find the ring empty and full
+    benchRun(8, benchRingPush, 1);
+    benchRun(9, benchRingPop, 1);
+  }
+  benchRun(10, benchRingSpans, BENCH_RUNS);
+  benchRun(11, benchRelaysFlush, BENCH_RUNS);
+  relaysAllOff();
+  for (uint8_t i = 0; i < 4; i++) {
+    pinMode(gpioPins[i], OUTPUT);
+  }
+  benchRun(12, benchDigitalWrite, BENCH_RUNS);
+  benchRun(13, benchFastPin, BENCH_RUNS);
+  benchRun(14, benchFastPortBatch, BENCH_RUNS);
+  relaysBegin();
+
+  benchReport(BENCH_EVENT_DONE, 0);
+}
+
+void loop() {
+}
@@ -0,0 +1,43 @@
+/**
+  Protocol between the benchmark firmware (bench_main.cpp) and the simavr runner
+  (avr_bench.c). The firmware marks events by writing GPIOR0; values travel in GPIOR1
+  (low byte) and GPIOR2 (high byte), written before the event. The runner hooks the
+  GPIOR0 write and reads the simulated cycle counter, so markers cost one OUT each.
+*/
+
+#ifndef BENCH_OPS_H
+#define BENCH_OPS_H
+
+// Data-space addresses of the ATmega328P general purpose I/O registers
+#define BENCH_EVENT_ADDR    0x3E // GPIOR0
+#define BENCH_VALUE_LO_ADDR 0x4A // GPIOR1
+#define BENCH_VALUE_HI_ADDR 0x4B // GPIOR2
+
+// GPIOR0 values: an operation id starts it, the id | BENCH_EVENT_END ends it, then the
+// measurements of that run follow
+#define BENCH_EVENT_END    0x40
+#define BENCH_EVENT_STACK  0xF0 // bytes of stack below the caller, incl. interrupts taken
+#define BENCH_EVENT_HEAP   0xF1 // bytes of heap in use right after the run
+#define BENCH_EVENT_STATIC 0xF2 // .data + .bss, once at start
+#define BENCH_EVENT_DONE   0xFF
+
+// id, name; "empty" is the cost of the markers and the call, subtracted from the others
+#define BENCH_OPS(X)                   \
+  X(1, "empty")                        \
+  X(2, "prepareDataForWiFi")           \
+  X(3, "sensorsScan")                  \
+  X(4, "softSerialSendFrame")          \
+  X(5, "logLine")                      \
+  X(6, "logFlush")                     \
+  X(7, "prepareDataArduinoJson")       \
+  X(8, "ringPush32")                   \
+  X(9, "ringPop32")                    \
+  X(10, "ringSpans32")                 \
+  X(11, "relaysFlush")                 \
+  X(12, "digitalWrite4")               \
+  X(13, "fastPin4")                    \
+  X(14, "fastPortBatch4")
+
+#define BENCH_OP_COUNT 14
+
+#endif
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Compare an avr_bench run with a baseline and fail on regressions.
+
+    python3 tools/avr_bench/gate.py baseline.jsonl bench.jsonl [--tolerance 2]
+
+An operation regresses when its minimum cycle count grows by more than the tolerance
+(percent) or its stack use grows at all; static SRAM must not grow either. Exits 1 on
+any regression, 0 otherwise.
+"""
+
+import json
+import sys
+
+
+def load(path):
+    ops = {}
+    summary = {}
+    with open(path) as lines:
+        for line in lines:
+            line = line.strip()
+            if not line:
+                continue
+            record = json.loads(line)
+            if record.get("summary"):
+                summary = record
+            else:
+                ops[record["op"]] = record
+    return ops, summary
+
+
+def main():
+    args = sys.argv[1:]
+    tolerance = 2.0
+    if "--tolerance" in args:
+        index = args.index("--tolerance")
+        tolerance = float(args[index + 1])
+        del args[index:index + 2]
+    if len(args) != 2:
+        sys.stderr.write(__doc__)
+        return 2
+
+    base_ops, base_summary = load(args[0])
+    ops, summary = load(args[1])
+    failed = False
+
+    for name, base in sorted(base_ops.items()):
+        current = ops.get(name)
+        if current is None:
+            print("%-22s missing from the new run" % name)
+            failed = True
+            continue
+        change = 100.0 * (current["cycles_min"] - base["cycles_min"]) / max(base["cycles_min"], 1)
+        verdict = "ok"
+        if change > tolerance or current["stack_bytes"] > base["stack_bytes"]:
+            verdict = "REGRESSION"
+            failed = True
+        print("%-22s cycles %9d -> %9d (%+.1f%%)  stack %4d -> %4d  %s" % (
+            name, base["cycles_min"], current["cycles_min"], change,
+            base["stack_bytes"], current["stack_bytes"], verdict))
+
+    if summary.get("static_sram_bytes", 0) > base_summary.get("static_sram_bytes", 0):
+        print("static SRAM %d -> %d bytes  REGRESSION" % (
+            base_summary["static_sram_bytes"], summary["static_sram_bytes"]))
+        failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
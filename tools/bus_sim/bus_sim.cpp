@@ -0,0 +1,321 @@
+/**
+  RS-485 bus simulation: a gateway polling its slaves the way busPollCycle() does
+  (src/bus.cpp), every frame built and parsed by the real bus code, byte by byte on a
+  modeled line at BUS_BAUD.
+
+  The gateway's loop pass: the ESP drain of a DEBUG build (1 s), its own telemetry (the
+  ESP waits of sendTelemetry()), then up to BUS_NODES_PER_CYCLE polls round robin over
+  the configured addresses, none started after BUS_CYCLE_BUDGET_MS, each answer
+  forwarded to the ESP (100 ms per frame of TELEMETRY_ZONES_PER_FRAME zones), then the
+  2 s wait. A poll that gets no complete answer within BUS_RESPONSE_TIMEOUT is given up.
+  A slave runs busService() from its wait loops, every 0..200 us, but not during the
+  work of its loop pass (--slave-busy-ms) or of its hourly pump checkpoint (2..16
+  EEPROM bytes at 3.4 ms each). An answer it starts late still goes out on the line and
+  garbles whatever the gateway sends meanwhile (both frames' overlapping bytes are
+  replaced by noise). Transmitters disable their receiver (DE and /RE tied).
+
+  Output per bus: the answered share of polls, timeouts and collisions, the age of a
+  node's data at the gateway (time between two answers of the same node, mean and max),
+  the gateway's poll cycle and whole loop pass (the watchdog resets after 8 s), the line
+  utilization, and the CPU a slave spends in SoftwareSerial's receive interrupt, which
+  holds the CPU for ~9.5 bit times of every byte on the line.
+  Checked: every frame the gateway accepts is the one the slave sent, and no loop pass
+  reaches the watchdog period. Any failed check is printed and makes the exit status
+  non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/bus_sim/bus_sim.cpp src/bus.cpp -o bus_sim
+    ./bus_sim --hours 2 --slave-busy-ms 3
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bus.h"
+
+#define MS              1000.0
+#define LOOP_WAIT_US    (2000 * MS)
+#define ESP_DRAIN_US    (1000 * MS)  // loop() of a DEBUG build drains the ESP's output first
+#define ESP_FRAME_US    (100 * MS)   // forwardNodeToWiFi(), per frame
+#define WATCHDOG_US     (8000 * MS)
+#define SERVICE_GAP_US  200.0        // between busService() calls of a waiting slave
+#define EEPROM_BYTE_US  3400.0
+#define CHECKPOINT_US   (3600000 * MS)
+
+static const double byteUs = 10 * 1e6 / BUS_BAUD;
+
+struct Transmission {
+  double start;
+  uint8_t bytes[BUS_MAX_FRAME];
+  uint8_t count;
+  int sender; // slave index, -1 the gateway
+
+  double end() const { return start + count * byteUs; }
+};
+
+struct Slave {
+  uint8_t address;
+  double phase;          // start of its first loop pass
+  double checkpointAt;   // next pump checkpoint
+  double checkpointUs;   // its EEPROM writes
+  BusParser parser;
+  BusSensorFrame frame;  // what it reports
+  double rxBytes;        // bytes its receive interrupt took
+};
+
+struct Scenario {
+  uint8_t addresses;
+  uint8_t present;
+  uint8_t zones;
+};
+
+struct Stats {
+  uint32_t polls, answered, timeouts, collisions, wrongFrames;
+  double lineUs, cycleUs, cycleMaxUs, passMaxUs, ageSumUs, ageMaxUs, slaveRxUs;
+  uint32_t ages, cycles;
+};
+
+static uint32_t failures = 0;
+static std::mt19937 generator(1);
+
+/**
+ * Replace the bytes of a that overlap b on the line by noise, and the other way round
+ */
+static bool collide(Transmission &a, Transmission &b)
+{
+  bool hit = false;
+  for (Transmission *x : { &a, &b }) {
+    const Transmission &y = x == &a ? b : a;
+    for (uint8_t i = 0; i < x->count; i++) {
+      double from = x->start + i * byteUs;
+      if (from < y.end() && from + byteUs > y.start) {
+        x->bytes[i] = (uint8_t)generator();
+        hit = true;
+      }
+    }
+  }
+  return hit;
+}
+
+/**
+ * End of the work in progress at t, or t when the slave is in its wait loop
+ */
+static double slaveFreeAt(Slave &slave, double t, double passUs, double busyUs)
+{
+  std::uniform_real_distribution<double> gap(0, SERVICE_GAP_US);
+  double since = t - slave.phase;
+  double passStart = slave.phase + (since < 0 ? -passUs : since - std::fmod(since, passUs));
+  double busyEnd = passStart + busyUs;
+  if (slave.checkpointAt >= passStart && slave.checkpointAt < passStart + passUs) {
+    busyEnd += slave.checkpointUs;
+  }
+  if (t >= passStart && t < busyEnd) {
+    t = busyEnd;
+  }
+  if (t >= slave.checkpointAt + CHECKPOINT_US) {
+    slave.checkpointAt += CHECKPOINT_US;
+    slave.checkpointUs = (2 + generator() % 15) * EEPROM_BYTE_US;
+  }
+  return t + gap(generator);
+}
+
+static Stats run(const Scenario &scenario, double hours, double slaveBusyMs)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const double slavePassUs = slaveBusyMs * MS + LOOP_WAIT_US, slaveBusyUs = slaveBusyMs * MS;
+  const uint8_t espFrames = (scenario.zones + TELEMETRY_ZONES_PER_FRAME - 1) / TELEMETRY_ZONES_PER_FRAME;
+  const uint8_t ownFrames = (ZONE_COUNT + TELEMETRY_ZONES_PER_FRAME - 1) / TELEMETRY_ZONES_PER_FRAME;
+  const double ownTelemetryUs = ((ownFrames - 1) * 250 + 1000) * MS;
+  const double endUs = hours * 3600e6;
+
+  // Slaves on the first addresses
+  std::vector<Slave> slaves(scenario.present);
+  for (uint8_t i = 0; i < scenario.present; i++) {
+    Slave &slave = slaves[i];
+    slave.address = i + 1;
+    slave.phase = uniform(generator) * slavePassUs;
+    slave.checkpointAt = uniform(generator) * CHECKPOINT_US;
+    slave.checkpointUs = (2 + generator() % 15) * EEPROM_BYTE_US;
+    busParserReset(slave.parser);
+    slave.frame.zoneCount = scenario.zones;
+    slave.rxBytes = 0;
+  }
+
+  Stats stats = {};
+  std::vector<double> lastAnswer(scenario.addresses + 1, -1);
+  BusParser gateway;
+  Transmission late = {};
+  uint8_t nextAddress = 1;
+  double passStart = 0;
+
+  // Every transmission reaches every other slave's parser; returns the slave a valid poll addressed
+  auto deliver = [&](const Transmission &tx) {
+    int polled = -1;
+    stats.lineUs += tx.count * byteUs;
+    for (Slave &slave : slaves) {
+      if (&slave - slaves.data() == tx.sender) {
+        continue;
+      }
+      slave.rxBytes += tx.count;
+      for (uint8_t i = 0; i < tx.count; i++) {
+        if (busParse(slave.parser, tx.bytes[i]) && slave.parser.address == slave.address &&
+            slave.parser.type == BUS_TYPE_POLL) {
+          polled = (int)(&slave - slaves.data());
+        }
+      }
+    }
+    return polled;
+  };
+
+  for (double t = 0; t < endUs;) {
+    passStart = t;
+    t += ESP_DRAIN_US + ownTelemetryUs;
+
+    double cycleStart = t;
+    for (uint8_t n = 0; n < BUS_NODES_PER_CYCLE && n < scenario.addresses && t - cycleStart < BUS_CYCLE_BUDGET_MS * MS; n++) {
+      uint8_t address = nextAddress;
+      nextAddress = nextAddress % scenario.addresses + 1;
+      stats.polls++;
+
+      // Flush, then the poll; an answer still arriving from the previous poll collides with it
+      busParserReset(gateway);
+      Transmission poll;
+      poll.start = t;
+      poll.sender = -1;
+      poll.count = busFrame(poll.bytes, address, BUS_TYPE_POLL, nullptr, 0);
+      if (late.count && late.end() > poll.start) {
+        stats.collisions += collide(late, poll);
+      }
+      if (late.count) {
+        deliver(late);
+        for (uint8_t i = 0; i < late.count; i++) {
+          if (late.start + (i + 1) * byteUs > poll.end()) {
+            busParse(gateway, late.bytes[i]); // lands in the gateway's parser after its flush
+          }
+        }
+        late.count = 0;
+      }
+      int polled = deliver(poll);
+      t = poll.end();
+      double deadline = t + BUS_RESPONSE_TIMEOUT * MS;
+
+      if (polled < 0) {
+        stats.timeouts++;
+        t = deadline;
+        continue;
+      }
+      Slave &slave = slaves[polled];
+      for (uint8_t zone = 0; zone < scenario.zones; zone++) {
+        slave.frame.readings[zone] = (uint16_t)(generator() % 16384);
+      }
+      slave.frame.pumps = (uint16_t)(generator() & 0xF);
+      slave.frame.faults = 0;
+
+      Transmission answer;
+      answer.start = slaveFreeAt(slave, t, slavePassUs, slaveBusyUs);
+      answer.sender = polled;
+      uint8_t payload[BUS_MAX_PAYLOAD];
+      answer.count = busFrame(answer.bytes, slave.address, BUS_TYPE_DATA, payload, busSensorPayload(payload, slave.frame));
+
+      if (answer.end() > deadline) {
+        stats.timeouts++;
+        late = answer;
+        t = deadline;
+        continue;
+      }
+      deliver(answer);
+      bool received = false;
+      BusSensorFrame frame;
+      for (uint8_t i = 0; i < answer.count && !received; i++) {
+        if (busParse(gateway, answer.bytes[i]) && gateway.address == address && gateway.type == BUS_TYPE_DATA) {
+          received = busDecodeSensorFrame(gateway, frame);
+        }
+      }
+      t = answer.end();
+      if (!received) {
+        stats.timeouts++;
+        t = deadline;
+        continue;
+      }
+
+      bool same = frame.zoneCount == slave.frame.zoneCount && frame.pumps == slave.frame.pumps &&
+                  !memcmp(frame.readings, slave.frame.readings, scenario.zones * sizeof(uint16_t));
+      stats.wrongFrames += !same;
+      stats.answered++;
+      if (lastAnswer[address] >= 0) {
+        double age = t - lastAnswer[address];
+        stats.ageSumUs += age;
+        stats.ageMaxUs = std::max(stats.ageMaxUs, age);
+        stats.ages++;
+      }
+      lastAnswer[address] = t;
+      t += espFrames * ESP_FRAME_US; // the gateway listens to its ESP meanwhile
+    }
+    stats.cycleUs += t - cycleStart;
+    stats.cycleMaxUs = std::max(stats.cycleMaxUs, t - cycleStart);
+    stats.cycles++;
+
+    t += LOOP_WAIT_US;
+    stats.passMaxUs = std::max(stats.passMaxUs, t - passStart);
+    if (late.count && late.end() <= t) {
+      deliver(late);
+      late.count = 0;
+    }
+  }
+
+  for (const Slave &slave : slaves) {
+    stats.slaveRxUs = std::max(stats.slaveRxUs, slave.rxBytes * byteUs * 0.95);
+  }
+  stats.slaveRxUs /= endUs;
+  stats.lineUs /= endUs;
+  return stats;
+}
+
+int main(int argc, char **argv)
+{
+  double hours = 2, slaveBusyMs = 3;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--hours")) {
+      hours = std::max(0.1, atof(argv[i + 1]));
+    } else if (!strcmp(argv[i], "--slave-busy-ms")) {
+      slaveBusyMs = std::max(0.0, atof(argv[i + 1]));
+    } else {
+      fprintf(stderr, "usage: %s [--hours N] [--slave-busy-ms N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const Scenario scenarios[] = {
+    { 4, 4, 4 }, { 8, 8, 4 }, { 16, 16, 4 }, { 32, 32, 4 }, { 32, 8, 4 }, { 8, 8, 16 }, { 32, 32, 16 },
+  };
+
+  printf("%.1f h at %u baud, slave loop work %.0f ms per pass\n", hours, BUS_BAUD, slaveBusyMs);
+  printf("%5s %7s %5s %8s %8s %6s %14s %15s %9s %6s %7s\n", "nodes", "present", "zones", "answered", "timeouts",
+         "coll.", "data age s", "poll cycle ms", "pass max", "line", "slv RX");
+  for (const Scenario &scenario : scenarios) {
+    Stats stats = run(scenario, hours, slaveBusyMs);
+    printf("%5u %7u %5u %7.2f%% %8u %6u %6.1f / %5.1f %7.0f / %5.0f %7.2f s %5.2f%% %6.2f%%\n", scenario.addresses,
+           scenario.present, scenario.zones, 100.0 * stats.answered / stats.polls, stats.timeouts, stats.collisions,
+           stats.ages ? stats.ageSumUs / stats.ages / 1e6 : 0.0, stats.ageMaxUs / 1e6,
+           stats.cycleUs / stats.cycles / MS, stats.cycleMaxUs / MS, stats.passMaxUs / 1e6, 100 * stats.lineUs,
+           100 * stats.slaveRxUs);
+    if (stats.wrongFrames) {
+      printf("FAIL %u nodes: the gateway accepted %u frames the slave did not send\n", scenario.addresses,
+             stats.wrongFrames);
+      failures++;
+    }
+    if (stats.passMaxUs >= WATCHDOG_US) {
+      printf("FAIL %u nodes: a gateway loop pass took %.2f s, the watchdog resets at 8 s\n", scenario.addresses,
+             stats.passMaxUs / 1e6);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
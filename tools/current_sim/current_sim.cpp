@@ -0,0 +1,248 @@
+/**
+  Pump current classifier check: synthetic current waveforms of a mini DC pump through
+  an ACS712 into the 10-bit ADC, sampled the way currentUpdate() samples them, and
+  classified by the real currentMonitorSample() of src/pumpcurrent.cpp.
+
+  Every trial draws its own pump: running current 0.8..1.2 x PUMP_CURRENT_NOMINAL_MA,
+  locked-rotor current 3..4.5 x running, inrush decaying with a 8..20 ms time constant,
+  15 % commutator ripple at 150..400 Hz, 3 % hydraulic wobble, a relay that closes 5..12 ms
+  after the command and bounces for 1 ms, a sensor zero 512 +- 3 counts measured at boot
+  like currentBegin() does, and 1 count of sensor noise. --ua-per-count swaps the
+  ACS712-05B (26400 uA per count) for another sensor, e.g. 1960 for a 0.1 ohm shunt
+  behind a x25 amplifier biased to mid-scale.
+    normal        moves water for the whole run
+    dry start     the reservoir is empty: the pump draws 0.3..0.5 x running
+    open          no current at all (relay contact, broken wire)
+    stall start   the impeller is jammed: the inrush never decays
+    empties       runs normally, sputters on air from 10 s (bursts of dry running), dry from 13 s
+    jams          runs normally, the impeller jams at 10 s
+  Every sample comes from a pass of serviceBackground(), at the cadence loop() calls it:
+  1..20 ms apart, with a stall of 260 ms one pass in 100. The burst takes one reading per
+  pass at least PUMP_CURRENT_BURST_US after the previous one, the first as the relay is
+  commanded; running samples come every PUMP_CURRENT_PERIOD_MS.
+
+  Output per case: share of trials classified as expected, the wrong verdicts, and the
+  time from the fault (or the turn-on) to the lockout.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/current_sim/current_sim.cpp src/pumpcurrent.cpp -o current_sim
+    ./current_sim --trials 2000
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pumpcurrent.h"
+
+#define ANALOG_READ_US 112
+#define RUN_SECONDS    30.0
+#define FAULT_AT       10.0
+
+enum Scenario {
+  SCENARIO_NORMAL,
+  SCENARIO_DRY_START,
+  SCENARIO_OPEN,
+  SCENARIO_STALL_START,
+  SCENARIO_EMPTIES,
+  SCENARIO_JAMS
+};
+
+struct ScenarioInfo {
+  const char *name;
+  uint8_t expected;
+  double faultAt; // s after the command, the latency is measured from here
+};
+
+static const ScenarioInfo scenarios[] = {
+  { "normal", CURRENT_NORMAL, 0 },
+  { "dry start", CURRENT_DRY, 0 },
+  { "open", CURRENT_DRY, 0 },
+  { "stall start", CURRENT_STALL, 0 },
+  { "empties", CURRENT_DRY, FAULT_AT },
+  { "jams", CURRENT_STALL, FAULT_AT },
+};
+
+struct Pump {
+  Scenario scenario;
+  double running, dry, lockedRotor; // mA
+  double tau, closeAt;              // s
+  double rippleHz, ripplePhase;
+  std::vector<double> airSwitches;  // empties: when the intake alternates air and water
+};
+
+static Pump drawPump(Scenario scenario, std::mt19937 &random)
+{
+  auto uniform = [&](double low, double high) { return std::uniform_real_distribution<double>(low, high)(random); };
+  Pump pump;
+  pump.scenario = scenario;
+  pump.running = PUMP_CURRENT_NOMINAL_MA * uniform(0.8, 1.2);
+  pump.dry = pump.running * uniform(0.3, 0.5);
+  pump.lockedRotor = pump.running * uniform(3, 4.5);
+  pump.tau = uniform(0.008, 0.020);
+  pump.closeAt = uniform(0.005, 0.012);
+  pump.rippleHz = uniform(150, 400);
+  pump.ripplePhase = uniform(0, 2 * M_PI);
+
+  std::exponential_distribution<double> segment(1 / 0.15);
+  for (double t = FAULT_AT; t < FAULT_AT + 3; t += segment(random)) {
+    pump.airSwitches.push_back(t);
+  }
+  return pump;
+}
+
+/**
+ * @return pump current in mA, t seconds after the relay was commanded on
+ */
+static double pumpCurrent(const Pump &pump, double t)
+{
+  if (pump.scenario == SCENARIO_OPEN || t < pump.closeAt) {
+    return 0;
+  }
+  double sinceClose = t - pump.closeAt;
+  if (sinceClose < 0.001 && fmod(sinceClose * 1e4 * 7.3, 1) < 0.5) {
+    return 0; // contact bounce
+  }
+
+  double level = pump.running;
+  if (pump.scenario == SCENARIO_DRY_START) {
+    level = pump.dry;
+  } else if (pump.scenario == SCENARIO_STALL_START) {
+    level = pump.lockedRotor * 0.95;
+  } else if (pump.scenario == SCENARIO_EMPTIES && t >= FAULT_AT) {
+    auto next = std::upper_bound(pump.airSwitches.begin(), pump.airSwitches.end(), t);
+    bool air = t >= FAULT_AT + 3 || (next - pump.airSwitches.begin()) % 2 == 1;
+    level = air ? pump.dry : pump.running;
+  } else if (pump.scenario == SCENARIO_JAMS && t >= FAULT_AT) {
+    level = pump.running + (pump.lockedRotor * 0.95 - pump.running) * std::min(1.0, (t - FAULT_AT) / 0.05);
+  }
+
+  double inrush = (pump.lockedRotor - level) * exp(-sinceClose / pump.tau);
+  double ripple = 1 + 0.15 * sin(2 * M_PI * pump.rippleHz * t + pump.ripplePhase);
+  double wobble = 1 + 0.03 * sin(2 * M_PI * 0.7 * t);
+  return std::max(0.0, (level + std::max(0.0, inrush)) * ripple * wobble);
+}
+
+static uint32_t uaPerCount = PUMP_CURRENT_UA_PER_COUNT;
+
+struct Sensor {
+  double zero; // true ADC counts at 0 A
+  std::normal_distribution<double> noise{ 0, 1 };
+};
+
+static int analogRead(Sensor &sensor, double milliamps, std::mt19937 &random)
+{
+  double counts = sensor.zero + milliamps * 1000 / uaPerCount + sensor.noise(random);
+  return std::min(1023, std::max(0, (int)lround(counts)));
+}
+
+struct TrialResult {
+  uint8_t verdict;
+  double at; // s after the command
+};
+
+static TrialResult trial(Scenario scenario, std::mt19937 &random)
+{
+  Pump pump = drawPump(scenario, random);
+  Sensor sensor;
+  sensor.zero = 512 + std::uniform_real_distribution<double>(-3, 3)(random);
+
+  // currentBegin(): 16 samples with every pump off
+  int32_t zero = 0;
+  for (int i = 0; i < 16; i++) {
+    zero += analogRead(sensor, 0, random);
+  }
+  // currentRead(): readings back to back, averaged in counts
+  auto milliamps = [&](double t, int readings) -> uint16_t {
+    int32_t sum = 0;
+    for (int i = 0; i < readings; i++) {
+      sum += analogRead(sensor, pumpCurrent(pump, t + i * ANALOG_READ_US * 1e-6), random);
+    }
+    int32_t counts = (sum << 4) / readings - zero;
+    return counts <= 0 ? 0 : std::min<uint32_t>(counts * uaPerCount / 16000, 8000);
+  };
+
+  CurrentMonitor monitor;
+  currentMonitorStart(monitor);
+  double t = std::uniform_real_distribution<double>(0.0001, 0.002)(random);
+
+  std::uniform_real_distribution<double> gap(0.001, 0.020), stall(0, 1);
+  double lastSample = -1, lastBurstSample = -1;
+  while (t < RUN_SECONDS) {
+    if (monitor.samples < PUMP_CURRENT_BURST_SAMPLES) {
+      if (lastBurstSample < 0 || t - lastBurstSample >= PUMP_CURRENT_BURST_US * 1e-6) {
+        lastBurstSample = t;
+        uint8_t verdict = currentMonitorSample(monitor, milliamps(t, 1));
+        if (verdict != CURRENT_NORMAL) {
+          return { verdict, t };
+        }
+      }
+    } else if (t - lastSample >= PUMP_CURRENT_PERIOD_MS / 1000.0) {
+      lastSample = t;
+      uint8_t verdict = currentMonitorSample(monitor, milliamps(t, PUMP_CURRENT_AVERAGE));
+      if (verdict != CURRENT_NORMAL) {
+        return { verdict, t };
+      }
+    }
+    t += stall(random) < 0.01 ? 0.260 : gap(random);
+  }
+  return { CURRENT_NORMAL, RUN_SECONDS };
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t trials = 2000;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--trials")) {
+      trials = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--ua-per-count")) {
+      uaPerCount = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--trials N] [--ua-per-count UA]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  static const char *classNames[] = { "normal", "dry", "stall" };
+  std::mt19937 random(1);
+  bool ok = true;
+
+  printf("%u uA per count, burst %d samples at least %d us apart, running samples of %d readings every %lu ms\n\n",
+         uaPerCount, PUMP_CURRENT_BURST_SAMPLES, PUMP_CURRENT_BURST_US, PUMP_CURRENT_AVERAGE, PUMP_CURRENT_PERIOD_MS);
+  printf("%-12s %-8s %9s %7s %7s %7s %11s %11s\n", "case", "expect", "correct", "normal", "dry", "stall",
+         "median", "worst");
+  for (uint8_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    const ScenarioInfo &info = scenarios[s];
+    uint32_t verdicts[3] = {}, correct = 0;
+    std::vector<double> latencies;
+
+    for (uint32_t n = 0; n < trials; n++) {
+      TrialResult result = trial((Scenario)s, random);
+      verdicts[result.verdict]++;
+      // A lockout before the case's own fault is a false one
+      if (result.verdict == info.expected && result.at >= info.faultAt) {
+        correct++;
+        if (info.expected != CURRENT_NORMAL) {
+          latencies.push_back(result.at - info.faultAt);
+        }
+      }
+    }
+
+    ok &= correct == trials;
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-12s %-8s %8.2f%% %7u %7u %7u", info.name, classNames[info.expected], 100.0 * correct / trials,
+           verdicts[CURRENT_NORMAL], verdicts[CURRENT_DRY], verdicts[CURRENT_STALL]);
+    if (latencies.empty()) {
+      printf(" %11s %11s\n", "-", "-");
+    } else {
+      printf(" %9.0f ms %8.0f ms\n", 1000 * latencies[latencies.size() / 2], 1000 * latencies.back());
+    }
+  }
+  return ok ? 0 : 1;
+}
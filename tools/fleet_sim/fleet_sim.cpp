@@ -0,0 +1,752 @@
+/**
+  Fleet load simulator: runs thousands of simulated irrigation controllers on one Linux
+  machine and publishes their telemetry through an in-process MQTT broker stand-in.
+
+  Every device has its own soil model (drying rate, pump response, diffusion lag, sensor
+  noise) and runs the firmware's control cycle: one reading per zone, pump on above
+  MOISTURE_THRESHOLD, pump accounting, then the prepareDataForWiFi() JSON frame every
+  ~3 s (2 s loop delay + 1 s ESP wait). Simulated time runs as fast as the CPU allows;
+  publish-to-delivery latency is measured on the wall clock.
+
+  The firmware modules keep their state in file statics (one board per process), so the
+  per-device control step is mirrored here rather than linked from src/. The predictive
+  controller (src/predict.cpp) and the pulse-and-soak scheduler (src/pulsesoak.cpp) are
+  instance based and run unmodified with --predictive and --pulse-soak.
+  Besides load figures the report gives water used, soil moisture statistics and the
+  overshoot below the threshold, to compare the watering modes with the plain threshold.
+  --service-ms is the gap between serviceBackground() passes, where bursts and pulses end
+  and the pump arbiter (src/arbiter.cpp) staggers its grants. The report gives each zone's
+  worst wait for a pump and the supply current at the turn-on edges; --current-log writes
+  the supply current profile of device 0 as CSV. --no-arbiter switches every requested pump
+  at once, like the firmware before the arbiter. --frame-log writes every frame with its
+  simulated time and device as "node", the trace tools/report_sim replays.
+  --adaptive reads each zone at the cadence src/cadence.cpp picks instead of every cycle;
+  the report gives ADC conversions and their energy per zone and day, and the delay from
+  the soil drying past MOISTURE_THRESHOLD to the first reading that shows it.
+
+  Build and run:
+    g++ -O2 -std=c++17 -pthread -Isrc tools/fleet_sim/fleet_sim.cpp src/predict.cpp src/pulsesoak.cpp \
+      src/arbiter.cpp src/cadence.cpp -o fleet_sim
+    ./fleet_sim --devices 10000 --minutes 10 --threads 4
+    ./fleet_sim --devices 1000 --minutes 1440 --pulse-soak
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "predict.h"
+#include "pulsesoak.h"
+#include "arbiter.h"
+#include "cadence.h"
+
+#define CYCLE_MS 3000
+
+// Supply current of a 3 V mini submersible pump, running and while its motor spins up
+#define PUMP_RUN_MA    130
+#define PUMP_INRUSH_MA 600
+#define PUMP_INRUSH_MS 100
+
+// Energy of one reading: analogRead() busy-waits 104 us at ~10 mA and 5 V. A resistive
+// probe powered only while it is read (10 ms settle at 20 mA) would add this much
+#define ADC_CONVERSION_UJ 5.2
+#define PROBE_SAMPLE_UJ   1000.0
+
+typedef std::chrono::steady_clock Clock;
+
+struct Message {
+  std::string topic;
+  std::string payload;
+  Clock::time_point published;
+};
+
+/**
+ * Stand-in for an MQTT broker: a single ingress queue drained by one delivery thread,
+ * which is where a real broker would fan messages out to subscribers
+ */
+class Broker {
+public:
+  void publish(Message &&message)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(message));
+    }
+    ready.notify_one();
+  }
+
+  void run()
+  {
+    std::deque<Message> batch;
+
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !queue.empty() || closed; });
+        if (queue.empty() && closed) {
+          return;
+        }
+        batch.swap(queue);
+      }
+
+      Clock::time_point now = Clock::now();
+      for (const Message &message : batch) {
+        // QoS 0 PUBLISH: fixed header (2), topic length (2), topic, payload
+        bytes += 4 + message.topic.size() + message.payload.size();
+        latenciesUs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - message.published).count());
+      }
+      delivered += batch.size();
+      batch.clear();
+    }
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    ready.notify_one();
+  }
+
+  uint64_t delivered = 0;
+  uint64_t bytes = 0;
+  std::vector<uint32_t> latenciesUs;
+
+private:
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Message> queue;
+  bool closed = false;
+};
+
+struct Zone {
+  double moisture;      // sensor counts, higher is drier
+  double dryingPerMs;   // counts gained per ms without water
+  double wettingPerMs;  // counts lost per ms of delivered water once it reached the probe
+  uint32_t lagMs;       // water takes this long to reach the probe
+  bool pumpOn;
+  uint64_t pumpOnSince;
+  uint64_t requestedSince;        // the zone has been waiting for its pump since
+  uint64_t onTimeMs;
+  uint16_t activations;
+  std::deque<uint64_t> pumpEdges; // pump switch times still travelling to the probe
+  double trough;                  // lowest moisture since it fell below the threshold, NaN
+                                  // until the soil first dried past it
+  ZonePredictor predictor;
+  PulseSoak pulse;
+  ZoneCadence cadence;
+  float reading;                  // last sample
+  uint64_t driedAt;               // the soil dried past the threshold here
+  bool dry;
+  bool drying;                    // dry and no reading has shown it yet
+};
+
+struct SoilStats {
+  uint64_t samples = 0;
+  uint64_t thirsty = 0; // true moisture above the threshold
+  double sum = 0;
+  double sumSquares = 0;
+  uint64_t pumpMs = 0;
+  uint64_t overshoots = 0;   // dips below the threshold
+  double overshootSum = 0;   // counts below the threshold at the bottom of each dip
+  double overshootMax = 0;
+  uint64_t bursts = 0;
+  uint64_t jitterSumMs = 0;  // burst length beyond PULSE_BURST_MS
+  uint64_t jitterMaxMs = 0;
+  uint64_t waits = 0;        // pump grants
+  uint64_t waitSumMs = 0;    // request to grant
+  uint64_t waitMaxMs[ZONE_COUNT] = {};
+  uint64_t turnOns = 0;
+  uint64_t stackedTurnOns = 0; // turn-ons while another pump was still in inrush
+  uint32_t peakMa = 0;         // supply current right after a turn-on edge
+  uint64_t conversions = 0;
+  std::vector<uint32_t> detectionMs; // soil past the threshold to a reading above it
+};
+
+struct PumpEdge {
+  uint64_t at;
+  uint8_t zone;
+  bool on;
+};
+
+enum Mode {
+  MODE_THRESHOLD,
+  MODE_PREDICTIVE,
+  MODE_PULSE_SOAK
+};
+
+static Mode mode = MODE_THRESHOLD;
+static uint32_t serviceMs = 20;
+static bool useArbiter = true;
+static bool logProfile = false;
+static bool adaptive = false;
+static FILE *frameLog = nullptr;
+static std::mutex frameLogMutex;
+
+struct Device {
+  uint32_t id;
+  uint64_t nextCycle;
+  Zone zones[ZONE_COUNT];
+  ZoneMask requests;
+  PumpArbiter arbiter;
+  std::mt19937 noise;
+  std::vector<PumpEdge> edges; // for the supply current profile, device 0 only
+};
+
+/**
+ * Advance a zone's soil by one control cycle; the pump effect arrives lagMs late
+ * @param zone
+ * @param now
+ */
+static void soilStep(Zone &zone, uint64_t now)
+{
+  zone.moisture += zone.dryingPerMs * CYCLE_MS;
+
+  // Water reaches the probe lagMs after the pump: overlap the pump runs, shifted by the
+  // lag, with the cycle that just ended
+  uint64_t windowEnd = now > zone.lagMs ? now - zone.lagMs : 0;
+  uint64_t windowStart = windowEnd > CYCLE_MS ? windowEnd - CYCLE_MS : 0;
+  for (size_t i = 0; i < zone.pumpEdges.size(); i += 2) {
+    uint64_t on = std::max(zone.pumpEdges[i], windowStart);
+    uint64_t off = std::min(i + 1 < zone.pumpEdges.size() ? zone.pumpEdges[i + 1] : UINT64_MAX, windowEnd);
+    if (off > on) {
+      zone.moisture -= zone.wettingPerMs * (off - on);
+    }
+  }
+  while (zone.pumpEdges.size() > 1 && zone.pumpEdges[1] <= windowEnd) {
+    zone.pumpEdges.pop_front();
+    zone.pumpEdges.pop_front();
+  }
+
+  zone.moisture = std::max(250.0, std::min(700.0, zone.moisture));
+}
+
+/**
+ * @param device
+ * @param at simulated milliseconds
+ * @return current drawn from the shared pump supply
+ */
+static uint32_t supplyCurrent(const Device &device, uint64_t at)
+{
+  uint32_t milliamps = 0;
+  for (const Zone &zone : device.zones) {
+    if (zone.pumpOn) {
+      milliamps += at - zone.pumpOnSince < PUMP_INRUSH_MS ? PUMP_INRUSH_MA : PUMP_RUN_MA;
+    }
+  }
+  return milliamps;
+}
+
+/**
+ * Switch a zone's pump and account for the run that just ended, the wait that led to
+ * it and the current it draws
+ * @param device
+ * @param i zone index
+ * @param on
+ * @param at simulated milliseconds
+ * @param stats
+ */
+static void switchPump(Device &device, int i, bool on, uint64_t at, SoilStats &stats)
+{
+  Zone &zone = device.zones[i];
+  if (on == zone.pumpOn) {
+    return;
+  }
+
+  bool stacked = false;
+  for (const Zone &other : device.zones) {
+    stacked |= on && other.pumpOn && at - other.pumpOnSince < PUMP_INRUSH_MS;
+  }
+
+  zone.pumpEdges.push_back(at);
+  if (on) {
+    zone.pumpOnSince = at;
+    zone.activations++;
+    uint64_t wait = at - zone.requestedSince;
+    stats.waits++;
+    stats.waitSumMs += wait;
+    stats.waitMaxMs[i] = std::max(stats.waitMaxMs[i], wait);
+  } else {
+    zone.onTimeMs += at - zone.pumpOnSince;
+    stats.pumpMs += at - zone.pumpOnSince;
+    zone.requestedSince = at; // pre-empted zones wait again from here
+  }
+  zone.pumpOn = on;
+
+  if (on) {
+    stats.turnOns++;
+    stats.stackedTurnOns += stacked;
+    stats.peakMa = std::max(stats.peakMa, supplyCurrent(device, at));
+  }
+  if (logProfile && device.id == 0) {
+    device.edges.push_back({ at, (uint8_t)i, on });
+  }
+}
+
+/**
+ * Track how far the soil dips below the threshold, one sample per dip
+ * @param zone
+ * @param stats
+ */
+static void trackOvershoot(Zone &zone, SoilStats &stats)
+{
+  if (zone.moisture > MOISTURE_THRESHOLD) {
+    if (zone.trough < MOISTURE_THRESHOLD) {
+      double depth = MOISTURE_THRESHOLD - zone.trough;
+      stats.overshoots++;
+      stats.overshootSum += depth;
+      stats.overshootMax = std::max(stats.overshootMax, depth);
+    }
+    zone.trough = MOISTURE_THRESHOLD;
+  } else if (zone.moisture < zone.trough) {
+    zone.trough = zone.moisture;
+  }
+}
+
+/**
+ * The zone's pump run time so far, pumpOnMs() on the board
+ * @param zone
+ * @param at simulated milliseconds
+ * @return milliseconds, the current run included
+ */
+static uint32_t zoneOnMs(const Zone &zone, uint64_t at)
+{
+  return (uint32_t)(zone.onTimeMs + (zone.pumpOn && at > zone.pumpOnSince ? at - zone.pumpOnSince : 0));
+}
+
+/**
+ * Run the serviceBackground() passes from the control pass up to the next cycle, like
+ * endPumpBursts() and applyPumpGrants() on the board: a burst or a pulse ends at the first
+ * pass after it is due and the arbiter hands out staggered grants
+ * @param device
+ * @param now start of the cycle
+ * @param stats
+ */
+static void servicePumps(Device &device, uint64_t now, SoilStats &stats)
+{
+  for (uint64_t at = now;; at += serviceMs) {
+    at = std::min(at, now + CYCLE_MS); // the next control cycle services too
+
+    for (int i = 0; mode == MODE_PULSE_SOAK && i < ZONE_COUNT; i++) {
+      PulseSoak &pulse = device.zones[i].pulse;
+      uint32_t due = pulse.stateUntil;
+      if ((device.requests >> i & 1) && pulse.state == PULSE_BURST && !pulseSoakTick(pulse, device.zones[i].pumpOn, (uint32_t)at)) {
+        device.requests &= ~((ZoneMask)1 << i);
+        stats.bursts++;
+        stats.jitterSumMs += at - due;
+        stats.jitterMaxMs = std::max(stats.jitterMaxMs, at - due);
+      }
+    }
+    for (int i = 0; mode == MODE_PREDICTIVE && i < ZONE_COUNT; i++) {
+      Zone &zone = device.zones[i];
+      if ((device.requests >> i & 1) && !predictorTick(zone.predictor, zoneOnMs(zone, at), (uint32_t)at)) {
+        device.requests &= ~((ZoneMask)1 << i);
+      }
+    }
+
+    // Releases first: the board flushes both edges of a hand-over together
+    ZoneMask granted = useArbiter ? arbiterUpdate(device.arbiter, device.requests, (uint32_t)at) : device.requests;
+    for (int i = 0; i < ZONE_COUNT; i++) {
+      if (!(granted >> i & 1)) {
+        switchPump(device, i, false, at, stats);
+      }
+    }
+    for (int i = 0; i < ZONE_COUNT; i++) {
+      if (granted >> i & 1) {
+        switchPump(device, i, true, at, stats);
+      }
+    }
+
+    bool bursting = (mode == MODE_PULSE_SOAK || mode == MODE_PREDICTIVE) && device.requests;
+    if (at == now + CYCLE_MS || (!bursting && !(device.requests & ~granted))) {
+      break;
+    }
+  }
+}
+
+/**
+ * One firmware control cycle: read, decide, account, build the telemetry frame
+ * @param device
+ * @param now simulated milliseconds
+ * @return the JSON frame prepareDataForWiFi() would send
+ */
+static std::string deviceStep(Device &device, uint64_t now, SoilStats &stats)
+{
+  std::normal_distribution<double> sensorNoise(0.0, 2.0);
+  char payload[512];
+  int length = 0;
+
+  float readings[ZONE_COUNT];
+  for (int i = 0; i < ZONE_COUNT; i++) {
+    Zone &zone = device.zones[i];
+    soilStep(zone, now);
+    readings[i] = (float)(int)(zone.moisture + sensorNoise(device.noise));
+
+    stats.samples++;
+    stats.sum += zone.moisture;
+    stats.sumSquares += zone.moisture * zone.moisture;
+    stats.thirsty += zone.moisture > MOISTURE_THRESHOLD;
+    trackOvershoot(zone, stats);
+
+    if (zone.moisture <= MOISTURE_THRESHOLD) {
+      zone.dry = false;
+      zone.drying = false;
+    } else if (!zone.dry) {
+      // A noisy reading may have shown it already
+      zone.dry = true;
+      zone.drying = !(zone.reading > MOISTURE_THRESHOLD);
+      zone.driedAt = now;
+      if (!zone.drying) {
+        stats.detectionMs.push_back(0);
+      }
+    }
+
+    // An adaptive zone that is not due keeps its last reading and its request
+    if (adaptive && !cadenceDue(zone.cadence, (uint32_t)now)) {
+      readings[i] = zone.reading;
+      continue;
+    }
+    zone.reading = readings[i];
+    stats.conversions++;
+    if (zone.drying && readings[i] > MOISTURE_THRESHOLD) {
+      stats.detectionMs.push_back(now - zone.driedAt);
+      zone.drying = false;
+    }
+
+    bool thirsty = readings[i] > MOISTURE_THRESHOLD;
+    bool on;
+    bool requested = device.requests >> i & 1;
+    switch (mode) {
+      case MODE_PREDICTIVE:
+        on = predictorUpdate(zone.predictor, (int)readings[i], zoneOnMs(zone, now), false, (uint32_t)now);
+        break;
+      case MODE_PULSE_SOAK:
+        on = pulseSoakUpdate(zone.pulse, thirsty, zone.pumpOn, (uint32_t)now);
+        break;
+      default:
+        on = thirsty;
+        break;
+    }
+    if (on && !requested) {
+      zone.requestedSince = now;
+    }
+    device.requests = on ? device.requests | (ZoneMask)1 << i : device.requests & ~((ZoneMask)1 << i);
+    cadenceUpdate(zone.cadence, (int)readings[i], on || zone.pumpOn, (uint32_t)now);
+  }
+  servicePumps(device, now, stats);
+
+  length += snprintf(payload + length, sizeof(payload) - length, "{");
+  for (int i = 0; i < ZONE_COUNT; i++) {
+    length += snprintf(payload + length, sizeof(payload) - length, "\"sensor%dValue\":\"%.2f\",", i + 1, readings[i]);
+  }
+
+  uint64_t seconds[ZONE_COUNT];
+  for (int i = 0; i < ZONE_COUNT; i++) {
+    const Zone &zone = device.zones[i];
+    // A staggered grant can switch a pump on later within this cycle
+    seconds[i] = zoneOnMs(zone, now) / 1000;
+  }
+
+  const char *arrays[] = { "pumpSec", "pumpRuns", "pumpMl" };
+  for (int a = 0; a < 3; a++) {
+    length += snprintf(payload + length, sizeof(payload) - length, "\"%s\":[", arrays[a]);
+    for (int i = 0; i < ZONE_COUNT; i++) {
+      uint64_t value = a == 0 ? seconds[i] : (a == 1 ? device.zones[i].activations : seconds[i] * PUMP_FLOW_ML_PER_MIN / 60);
+      length += snprintf(payload + length, sizeof(payload) - length, "%s%llu", i ? "," : "", (unsigned long long)value);
+    }
+    length += snprintf(payload + length, sizeof(payload) - length, "],");
+  }
+  snprintf(payload + length, sizeof(payload) - length, "\"pumpFault\":0}");
+
+  return payload;
+}
+
+/**
+ * @param id
+ * @param seed
+ * @return a device with randomised soil and a random phase in its cycle
+ */
+static Device makeDevice(uint32_t id, uint32_t seed)
+{
+  Device device;
+  device.id = id;
+  device.noise.seed(seed ^ (id * 2654435761u));
+
+  std::uniform_real_distribution<double> drying(0.5, 3.0);   // counts per minute
+  std::uniform_real_distribution<double> wetting(20.0, 60.0); // counts per minute of pumping
+  std::uniform_int_distribution<uint32_t> lag(5000, 30000);
+  std::uniform_real_distribution<double> start(300.0, 500.0);
+  std::uniform_int_distribution<uint32_t> phase(0, CYCLE_MS - 1);
+
+  for (Zone &zone : device.zones) {
+    zone.moisture = start(device.noise);
+    zone.dryingPerMs = drying(device.noise) / 60000.0;
+    zone.wettingPerMs = wetting(device.noise) / 60000.0;
+    zone.lagMs = lag(device.noise);
+    zone.pumpOn = false;
+    zone.pumpOnSince = 0;
+    zone.onTimeMs = 0;
+    zone.activations = 0;
+    zone.requestedSince = 0;
+    zone.trough = NAN;
+    predictorInit(zone.predictor);
+    pulseSoakInit(zone.pulse);
+    cadenceInit(zone.cadence, mode == MODE_PREDICTIVE ? PREDICT_SAMPLE_PERIOD : SAMPLE_MAX_MS);
+    zone.reading = NAN;
+    zone.driedAt = 0;
+    zone.dry = false;
+    zone.drying = false;
+  }
+  device.requests = 0;
+  arbiterInit(device.arbiter);
+  device.nextCycle = phase(device.noise);
+
+  return device;
+}
+
+/**
+ * Run a slice of the fleet through the simulated period, publishing every frame
+ * @param devices
+ * @param endMs
+ * @param broker
+ */
+static void runSlice(std::vector<Device> &devices, uint64_t endMs, Broker &broker, SoilStats &stats)
+{
+  // Devices are stepped in simulated-time order so the publish stream interleaves like a real fleet
+  for (uint64_t window = 0; window < endMs; window += CYCLE_MS) {
+    for (Device &device : devices) {
+      while (device.nextCycle < window + CYCLE_MS && device.nextCycle < endMs) {
+        Message message;
+        message.topic = "irrigation/" + std::to_string(device.id) + "/telemetry";
+        message.payload = deviceStep(device, device.nextCycle, stats);
+        if (frameLog) {
+          std::lock_guard<std::mutex> lock(frameLogMutex);
+          fprintf(frameLog, "%llu {\"node\":%u,%s\n", (unsigned long long)device.nextCycle, device.id,
+                  message.payload.c_str() + 1);
+        }
+        message.published = Clock::now();
+        broker.publish(std::move(message));
+        device.nextCycle += CYCLE_MS;
+      }
+    }
+  }
+}
+
+/**
+ * Write the supply current after every pump edge and every end of an inrush
+ * @param device
+ * @param path
+ * @return false if the file cannot be written
+ */
+static bool writeCurrentProfile(const Device &device, const char *path)
+{
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+
+  std::vector<PumpEdge> events = device.edges;
+  for (const PumpEdge &edge : device.edges) {
+    if (edge.on) {
+      events.push_back({ edge.at + PUMP_INRUSH_MS, edge.zone, true });
+    }
+  }
+  std::stable_sort(events.begin(), events.end(), [](const PumpEdge &a, const PumpEdge &b) { return a.at < b.at; });
+
+  // Replaying the edges in order, an "on" for a running pump is the end of its inrush
+  uint64_t onSince[ZONE_COUNT];
+  bool running[ZONE_COUNT] = {};
+  fprintf(file, "ms,mA\n");
+  for (const PumpEdge &event : events) {
+    if (!event.on) {
+      running[event.zone] = false;
+    } else if (!running[event.zone]) {
+      running[event.zone] = true;
+      onSince[event.zone] = event.at;
+    }
+    uint32_t milliamps = 0;
+    for (int i = 0; i < ZONE_COUNT; i++) {
+      if (running[i]) {
+        milliamps += event.at - onSince[i] < PUMP_INRUSH_MS ? PUMP_INRUSH_MA : PUMP_RUN_MA;
+      }
+    }
+    fprintf(file, "%llu,%u\n", (unsigned long long)event.at, milliamps);
+  }
+  fclose(file);
+  return true;
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t deviceCount = 1000;
+  uint32_t minutes = 10;
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  uint32_t seed = 1;
+  const char *currentLog = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--predictive")) {
+      mode = MODE_PREDICTIVE;
+    } else if (!strcmp(argv[i], "--pulse-soak")) {
+      mode = MODE_PULSE_SOAK;
+    } else if (!strcmp(argv[i], "--adaptive")) {
+      adaptive = true;
+    } else if (!strcmp(argv[i], "--no-arbiter")) {
+      useArbiter = false;
+    } else if (hasValue && !strcmp(argv[i], "--current-log")) {
+      currentLog = argv[++i];
+      logProfile = true;
+    } else if (hasValue && !strcmp(argv[i], "--frame-log")) {
+      frameLog = fopen(argv[++i], "w");
+      if (!frameLog) {
+        fprintf(stderr, "cannot write %s\n", argv[i]);
+        return 1;
+      }
+    } else if (hasValue && !strcmp(argv[i], "--service-ms")) {
+      serviceMs = std::max(1, atoi(argv[++i]));
+    } else if (hasValue && !strcmp(argv[i], "--devices")) {
+      deviceCount = atoi(argv[++i]);
+    } else if (hasValue && !strcmp(argv[i], "--minutes")) {
+      minutes = atoi(argv[++i]);
+    } else if (hasValue && !strcmp(argv[i], "--threads")) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if (hasValue && !strcmp(argv[i], "--seed")) {
+      seed = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--devices N] [--minutes M] [--threads T] [--seed S] [--predictive | --pulse-soak] [--service-ms MS]\n"
+                      "       [--no-arbiter] [--current-log FILE] [--frame-log FILE] [--adaptive]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::vector<Device>> slices(threads);
+  for (uint32_t id = 0; id < deviceCount; id++) {
+    slices[id % threads].push_back(makeDevice(id, seed));
+  }
+
+  Broker broker;
+  std::thread delivery(&Broker::run, &broker);
+
+  Clock::time_point started = Clock::now();
+  std::vector<std::thread> workers;
+  std::vector<SoilStats> stats(threads);
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back(runSlice, std::ref(slices[t]), (uint64_t)minutes * 60000, std::ref(broker), std::ref(stats[t]));
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  broker.close();
+  delivery.join();
+  if (frameLog) {
+    fclose(frameLog);
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+  uint32_t p50 = percentile(broker.latenciesUs, 0.50);
+  uint32_t p99 = percentile(broker.latenciesUs, 0.99);
+
+  printf("devices            %u\n", deviceCount);
+  printf("simulated          %u min (%.0fx real time)\n", minutes, minutes * 60.0 / elapsed);
+  printf("messages           %llu\n", (unsigned long long)broker.delivered);
+  printf("messages/sec       %.0f\n", broker.delivered / elapsed);
+  printf("latency p50        %u us\n", p50);
+  printf("latency p99        %u us\n", p99);
+  printf("broker bytes       %llu (%.1f per message)\n", (unsigned long long)broker.bytes,
+         broker.delivered ? (double)broker.bytes / broker.delivered : 0.0);
+  printf("fleet uplink rate  %.1f kB/s in real time\n", broker.bytes / (minutes * 60.0) / 1000.0);
+
+  SoilStats soil;
+  for (const SoilStats &slice : stats) {
+    soil.samples += slice.samples;
+    soil.thirsty += slice.thirsty;
+    soil.sum += slice.sum;
+    soil.sumSquares += slice.sumSquares;
+    soil.pumpMs += slice.pumpMs;
+    soil.overshoots += slice.overshoots;
+    soil.overshootSum += slice.overshootSum;
+    soil.overshootMax = std::max(soil.overshootMax, slice.overshootMax);
+    soil.bursts += slice.bursts;
+    soil.jitterSumMs += slice.jitterSumMs;
+    soil.jitterMaxMs = std::max(soil.jitterMaxMs, slice.jitterMaxMs);
+    soil.waits += slice.waits;
+    soil.waitSumMs += slice.waitSumMs;
+    for (int i = 0; i < ZONE_COUNT; i++) {
+      soil.waitMaxMs[i] = std::max(soil.waitMaxMs[i], slice.waitMaxMs[i]);
+    }
+    soil.turnOns += slice.turnOns;
+    soil.stackedTurnOns += slice.stackedTurnOns;
+    soil.peakMa = std::max(soil.peakMa, slice.peakMa);
+    soil.conversions += slice.conversions;
+    soil.detectionMs.insert(soil.detectionMs.end(), slice.detectionMs.begin(), slice.detectionMs.end());
+  }
+  double mean = soil.sum / soil.samples;
+  double variance = soil.sumSquares / soil.samples - mean * mean;
+  double zoneDays = (double)deviceCount * ZONE_COUNT * minutes / 1440.0;
+  const char *modeNames[] = { "threshold", "predictive", "pulse-soak" };
+  printf("controller         %s\n", modeNames[mode]);
+  printf("water per zone/day %.2f l\n", soil.pumpMs / 60000.0 * PUMP_FLOW_ML_PER_MIN / 1000.0 / zoneDays);
+  printf("soil moisture      mean %.1f, stddev %.1f counts\n", mean, sqrt(variance > 0 ? variance : 0));
+  printf("time too dry       %.2f %%\n", 100.0 * soil.thirsty / soil.samples);
+  printf("overshoot          mean %.1f, max %.1f counts below the threshold\n",
+         soil.overshoots ? soil.overshootSum / soil.overshoots : 0.0, soil.overshootMax);
+  if (mode == MODE_PULSE_SOAK) {
+    printf("burst end jitter   mean %.1f, max %llu ms late over %llu bursts\n",
+           soil.bursts ? (double)soil.jitterSumMs / soil.bursts : 0.0,
+           (unsigned long long)soil.jitterMaxMs, (unsigned long long)soil.bursts);
+  }
+
+  printf("pump arbiter       %s\n", useArbiter ? "on" : "off");
+  printf("pump wait          mean %.0f ms, worst per zone", soil.waits ? (double)soil.waitSumMs / soil.waits : 0.0);
+  for (int i = 0; i < ZONE_COUNT; i++) {
+    printf(" %llu", (unsigned long long)soil.waitMaxMs[i]);
+  }
+  printf(" ms\n");
+  printf("supply peak        %u mA, %llu of %llu turn-ons during another pump's inrush\n", soil.peakMa,
+         (unsigned long long)soil.stackedTurnOns, (unsigned long long)soil.turnOns);
+
+  double conversions = soil.conversions / zoneDays;
+  uint64_t detectionSum = 0;
+  for (uint32_t delay : soil.detectionMs) {
+    detectionSum += delay;
+  }
+  printf("sampling           %s\n", adaptive ? "adaptive" : "every cycle");
+  printf("ADC conversions    %.0f per zone/day\n", conversions);
+  printf("sampling energy    %.2f J per zone/day, %.1f J with a switched probe\n",
+         conversions * ADC_CONVERSION_UJ / 1e6, conversions * (ADC_CONVERSION_UJ + PROBE_SAMPLE_UJ) / 1e6);
+  printf("dry detection      mean %.1f s, p99 %.1f s, max %.1f s over %zu crossings\n",
+         soil.detectionMs.empty() ? 0.0 : detectionSum / 1000.0 / soil.detectionMs.size(),
+         percentile(soil.detectionMs, 0.99) / 1000.0, percentile(soil.detectionMs, 1.0) / 1000.0,
+         soil.detectionMs.size());
+  if (currentLog && !writeCurrentProfile(slices[0][0], currentLog)) {
+    fprintf(stderr, "cannot write %s\n", currentLog);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+/**
+  Flow meter simulation: pulse trains from a YF-S201 class meter into the INT1 counter of
+  src/flow.cpp while SoftwareSerial keeps interrupts off, then through the real windowed
+  rate and totalizer (flowMeterUpdate(), flowMeterRate(), flowMillilitres()) at the
+  cadence loop() services them.
+
+  Interrupts are modelled on one non-preemptive CPU:
+    SoftwareSerial TX   interrupts off for each byte sent (10 bits at 9600 baud)
+    SoftwareSerial RX   PCINT2 handler for each byte received (start edge to stop bit)
+    TIMER0_OVF          millis(), every 1024 us
+  A falling edge sets the INT1 flag; the handler runs as soon as interrupts are on and no
+  other handler runs, ahead of the PCINT and timer vectors. An edge that finds the flag
+  still set is lost: that takes two edges within one interrupts-off stretch, so pulses
+  faster than one per SoftwareSerial byte (~960 Hz) start to drop. At every seam between
+  two sections (between two bytes, at the end of a handler) INT1 is served first.
+  The handler's cost is an estimate, not a measurement: the attachInterrupt() dispatch
+  saves and restores the call-clobbered registers around an indirect call, about 100
+  cycles with the 16-bit increment (--isr-cycles to change it).
+
+  Output per load and pulse rate: pulses lost, totalizer error, worst windowed rate error
+  once the windows are full, CPU time in the handler and the worst delay it adds to a
+  SoftwareSerial start bit (the receiver samples mid-bit, 52 us after the edge).
+  The fault cases run the lockout rule of flowUpdate() (rate below FLOW_MIN_ML_PER_MIN
+  after FLOW_FAULT_MS of run time) against a dry start, a reservoir running empty, a slow
+  prime and flows just above and below the limit.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/flow_sim/flow_sim.cpp src/flow.cpp -o flow_sim
+    ./flow_sim --seconds 120
+    ./flow_sim --seconds 600 --isr-cycles 120
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "flow.h"
+
+#define CYCLES_PER_US 16
+#define BYTE_NS       1041667 // 10 bits at 9600 baud
+#define RX_BYTE_NS    963000  // PCINT2 handler: start edge to the middle of the stop bit
+#define BYTE_GAP_NS   8000    // interrupts on between two bytes of one burst
+#define TIMER0_NS     1024000
+#define TIMER0_COST   5000
+
+typedef std::function<double(double)> FlowProfile; // pulses per second at t seconds
+
+struct Interval {
+  int64_t start, end;
+};
+
+struct LoadProfile {
+  const char *name;
+  double txLinesPerSecond; // log and telemetry lines to the ESP, 60 bytes each
+  double rxLinesPerSecond; // responses from the ESP, 120 bytes each
+};
+
+static const LoadProfile loads[] = {
+  { "idle", 0, 0 },
+  { "normal", 0.5, 0.2 },
+  { "heavy", 4, 1 },
+};
+
+/**
+ * Interrupts-off sections of a run, in order
+ */
+static std::vector<Interval> blockedIntervals(const LoadProfile &load, int64_t end, uint32_t seed)
+{
+  std::mt19937 random(seed);
+  std::vector<Interval> blocked;
+
+  for (int64_t t = 0; t < end; t += TIMER0_NS) {
+    blocked.push_back({ t, t + TIMER0_COST });
+  }
+
+  auto bursts = [&](double perSecond, int bytes, int64_t byteNs) {
+    if (perSecond <= 0) {
+      return;
+    }
+    std::exponential_distribution<double> gap(perSecond);
+    for (int64_t t = (int64_t)(gap(random) * 1e9); t < end; t += (int64_t)(gap(random) * 1e9)) {
+      for (int i = 0; i < bytes; i++, t += BYTE_NS + BYTE_GAP_NS) {
+        blocked.push_back({ t, t + byteNs });
+      }
+    }
+  };
+  bursts(load.txLinesPerSecond, 60, BYTE_NS);
+  bursts(load.rxLinesPerSecond, 120, RX_BYTE_NS);
+
+  // One CPU: a section that would start while another runs starts after it. Adjacent
+  // sections are not merged, INT1 is the first vector served at every seam between them.
+  std::sort(blocked.begin(), blocked.end(), [](const Interval &a, const Interval &b) { return a.start < b.start; });
+  std::vector<Interval> merged;
+  for (Interval interval : blocked) {
+    if (!merged.empty() && interval.start < merged.back().end) {
+      interval.end += merged.back().end - interval.start;
+      interval.start = merged.back().end;
+    }
+    merged.push_back(interval);
+  }
+  return merged;
+}
+
+/**
+ * @return first time at or after t with interrupts on
+ */
+static int64_t interruptsOn(const std::vector<Interval> &blocked, int64_t t)
+{
+  auto next = std::upper_bound(blocked.begin(), blocked.end(), t,
+                               [](int64_t time, const Interval &interval) { return time < interval.start; });
+  if (next != blocked.begin() && t < (next - 1)->end) {
+    return (next - 1)->end;
+  }
+  return t;
+}
+
+struct RunResult {
+  uint64_t edges, counted;
+  double trueMl, totalMl;
+  double worstRateError;  // relative, once the windows are full
+  double isrLoad;         // fraction of CPU time
+  int64_t worstRxDelay;   // ns added to a SoftwareSerial start bit
+  double faultAt;         // s, or -1 without a lockout
+};
+
+/**
+ * Run one pump for a while
+ * @param flow pulse rate over time
+ * @param judgeRate compare the windowed rate with the true one (steady flows only)
+ */
+static RunResult run(const LoadProfile &load, FlowProfile flow, double seconds, uint32_t isrCycles,
+                     bool judgeRate, uint32_t seed)
+{
+  int64_t end = (int64_t)(seconds * 1e9);
+  int64_t isrNs = (int64_t)isrCycles * 1000 / CYCLES_PER_US;
+  std::vector<Interval> blocked = blockedIntervals(load, end, seed);
+  std::mt19937 random(seed + 1);
+  std::uniform_real_distribution<double> wobble(0.99, 1.01);
+
+  // Pulses: the meter's phase advances with the rate, each period +-1 % meter jitter
+  std::vector<int64_t> increments; // when the handler bumped the counter
+  RunResult result = {};
+  int64_t pendingStart = -1;       // when the handler of the latched edge will run
+  int64_t handlerFree = 0;
+  double phase = 0, factor = wobble(random);
+  const double step = 1e-4;
+  for (double t = 0; t < seconds; t += step) {
+    double hz = flow(t) * factor;
+    double at = t;
+    while (hz > 0 && phase + hz * (t + step - at) >= 1) {
+      at += (1 - phase) / hz;
+      phase = 0;
+      factor = wobble(random);
+      hz = flow(t) * factor;
+
+      int64_t edge = (int64_t)(at * 1e9);
+      result.edges++;
+      if (pendingStart > edge) {
+        continue; // INT1 flag still set: this edge is lost
+      }
+      int64_t start = interruptsOn(blocked, std::max(edge, handlerFree));
+      pendingStart = start;
+      handlerFree = start + isrNs;
+      increments.push_back(start + isrNs / 2);
+    }
+    phase += hz * (t + step - at);
+  }
+  result.counted = increments.size();
+  result.isrLoad = (double)result.counted * isrNs / end;
+
+  // A start bit arriving during the handler waits for it
+  for (const Interval &interval : blocked) {
+    if (interval.end - interval.start != RX_BYTE_NS) {
+      continue;
+    }
+    auto next = std::upper_bound(increments.begin(), increments.end(), interval.start);
+    if (next != increments.end()) {
+      int64_t handlerStart = *next - isrNs / 2;
+      if (handlerStart <= interval.start) {
+        result.worstRxDelay = std::max(result.worstRxDelay, handlerStart + isrNs - interval.start);
+      }
+    }
+  }
+
+  // loop(): serviceBackground() every few ms, stalled by scans and ESP windows now and then
+  FlowMeter meter;
+  flowMeterInit(meter, 0, 0);
+  std::uniform_int_distribution<int64_t> gap(1000000, 20000000);
+  std::uniform_real_distribution<double> stall(0, 1);
+  uint64_t totalPulses = 0;
+  size_t taken = 0;
+  result.faultAt = -1;
+  for (int64_t now = 0; now < end;) {
+    now += stall(random) < 0.01 ? 260000000 : gap(random);
+    now = std::min(now, end);
+    while (taken < increments.size() && increments[taken] <= now) {
+      taken++;
+    }
+    uint32_t ms = (uint32_t)(now / 1000000);
+    totalPulses += flowMeterUpdate(meter, (uint16_t)taken, ms);
+
+    uint32_t rate = flowMeterRate(meter);
+    if (result.faultAt < 0 && ms >= FLOW_FAULT_MS && rate < FLOW_MIN_ML_PER_MIN) {
+      result.faultAt = now / 1e9;
+    }
+    if (judgeRate && ms >= (FLOW_WINDOWS + 1) * FLOW_WINDOW_MS) {
+      double truth = flow(now / 1e9) * 60000 / FLOW_PULSES_PER_LITRE;
+      result.worstRateError = std::max(result.worstRateError, std::fabs(rate - truth) / truth);
+    }
+  }
+  result.trueMl = result.edges * 1000.0 / FLOW_PULSES_PER_LITRE;
+  result.totalMl = flowMillilitres(totalPulses);
+  return result;
+}
+
+static double litresPerMinute(double hz)
+{
+  return hz * 60 / FLOW_PULSES_PER_LITRE;
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 120;
+  uint32_t isrCycles = 100;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--seconds")) {
+      seconds = atof(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--isr-cycles")) {
+      isrCycles = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--seconds S] [--isr-cycles N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  static const double rates[] = { 11, 50, 100, 225, 300, 400, 500, 1000, 2000 };
+  bool ok = true;
+
+  printf("%-7s %7s %7s %9s %8s %10s %10s %8s %10s\n", "load", "Hz", "L/min", "pulses", "lost",
+         "total err", "rate err", "ISR CPU", "RX delay");
+  for (const LoadProfile &load : loads) {
+    for (double hz : rates) {
+      RunResult r = run(load, [hz](double) { return hz; }, seconds, isrCycles, true, (uint32_t)hz);
+      uint64_t lost = r.edges - r.counted;
+      printf("%-7s %7.0f %7.1f %9llu %8llu %9.3f%% %9.2f%% %7.3f%% %7.2f us\n", load.name, hz,
+             litresPerMinute(hz), (unsigned long long)r.edges, (unsigned long long)lost,
+             100 * (r.totalMl - r.trueMl) / r.trueMl, 100 * r.worstRateError, 100 * r.isrLoad,
+             r.worstRxDelay / 1e3);
+      if (hz <= 500) {
+        ok &= lost == 0 && r.faultAt < 0;
+      }
+    }
+  }
+
+  // Fault detection under heavy load: 100 Hz is 13.3 L/min
+  struct FaultCase {
+    const char *name;
+    FlowProfile flow;
+    bool fault;
+  };
+  const double limitHz = FLOW_MIN_ML_PER_MIN * FLOW_PULSES_PER_LITRE / 60000.0;
+  const FaultCase cases[] = {
+    { "dry start", [](double) { return 0.0; }, true },
+    { "runs dry at 30 s", [](double t) { return t < 30 ? 100.0 : 0.0; }, true },
+    { "2 s prime, 2 s ramp", [](double t) { return t < 2 ? 0.0 : (t < 4 ? 50 * (t - 2) : 100.0); }, false },
+    { "1.2 x limit", [limitHz](double) { return 1.2 * limitHz; }, false },
+    { "0.8 x limit", [limitHz](double) { return 0.8 * limitHz; }, true },
+  };
+
+  printf("\n%-22s %10s\n", "fault case (heavy)", "lockout");
+  for (const FaultCase &c : cases) {
+    double worst = -1, first = 1e9;
+    bool agrees = true;
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+      RunResult r = run(loads[2], c.flow, 60, isrCycles, false, seed);
+      agrees &= (r.faultAt >= 0) == c.fault;
+      worst = std::max(worst, r.faultAt);
+      first = std::min(first, r.faultAt);
+    }
+    if (c.fault) {
+      printf("%-22s %4.2f..%.2f s%s\n", c.name, first, worst, agrees ? "" : "  MISSED");
+    } else {
+      printf("%-22s %10s\n", c.name, agrees ? "none" : "FALSE FAULT");
+    }
+    ok &= agrees;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,575 @@
+/**
+  Gateway-side telemetry ingest: parses the frames the controllers send and appends them
+  to a columnar, per-zone compressed time-series store with an index for range queries.
+
+  Input (stdin):
+    --json  one frame per line, optionally prefixed by a unix timestamp in ms:
+            [1700000000000 ]{"node":3,"sensor1Value":"512.00",...}
+            Lines without "node" come from node 0 (a board with its own ESP).
+    --bus   raw RS-485 bus sensor frames (see src/bus.h), stamped on arrival
+
+  Store:
+    <store>.dat  blocks of up to BLOCK_SAMPLES samples of one zone; each block holds a
+                 timestamp column (delta-of-delta, zigzag varint) followed by a value
+                 column (readings x 16, delta, zigzag varint)
+    <store>.idx  zone names and one entry per block: zone, first/last timestamp,
+                 offset, size, sample count
+
+  Build and run:
+    g++ -O2 -std=c++17 tools/ingest/ingest.cpp -o ingest
+    ./ingest write store --json < frames.log
+    ./ingest query store 3:1 1700000000000 1700086400000
+    ./ingest bench /tmp/bench --zones 500 --days 365 --interval 300
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define BLOCK_SAMPLES 4096
+#define INDEX_MAGIC 0x31584449 // "IDX1"
+
+typedef std::chrono::steady_clock Clock;
+
+struct IndexEntry {
+  uint32_t zone;
+  uint32_t count;
+  int64_t first;
+  int64_t last;
+  uint64_t offset;
+  uint32_t size;
+};
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back((uint8_t)value | 0x80);
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static uint64_t getVarint(const uint8_t *&p)
+{
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *p++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+static uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Samples of one zone waiting to be written as a block
+ */
+struct OpenBlock {
+  std::vector<int64_t> times;
+  std::vector<int32_t> values;
+};
+
+class Store {
+public:
+  bool create(const std::string &path)
+  {
+    base = path;
+    data = fopen((path + ".dat").c_str(), "wb");
+    return data != nullptr;
+  }
+
+  bool open(const std::string &path)
+  {
+    base = path;
+    FILE *index = fopen((path + ".idx").c_str(), "rb");
+    if (!index) {
+      return false;
+    }
+
+    uint32_t magic = 0, zoneCount = 0, entryCount = 0;
+    bool ok = fread(&magic, 4, 1, index) == 1 && magic == INDEX_MAGIC && fread(&zoneCount, 4, 1, index) == 1;
+    for (uint32_t zone = 0; ok && zone < zoneCount; zone++) {
+      uint16_t length = 0;
+      ok = fread(&length, 2, 1, index) == 1;
+      std::string name(length, '\0');
+      ok = ok && fread(&name[0], 1, length, index) == length;
+      zoneNames.push_back(name);
+      zoneIds[zoneNames.back()] = zone;
+    }
+    ok = ok && fread(&entryCount, 4, 1, index) == 1;
+    entries.resize(ok ? entryCount : 0);
+    ok = ok && fread(entries.data(), sizeof(IndexEntry), entryCount, index) == entryCount;
+    fclose(index);
+
+    // Group by zone, then by time, so a query is a binary search
+    std::sort(entries.begin(), entries.end(), [](const IndexEntry &a, const IndexEntry &b) {
+      return a.zone != b.zone ? a.zone < b.zone : a.first < b.first;
+    });
+
+    data = fopen((path + ".dat").c_str(), "rb");
+    return ok && data != nullptr;
+  }
+
+  uint32_t zoneId(std::string_view name)
+  {
+    auto found = zoneIds.find(name);
+    if (found != zoneIds.end()) {
+      return found->second;
+    }
+    uint32_t id = zoneNames.size();
+    zoneNames.emplace_back(name);
+    zoneIds.emplace(zoneNames.back(), id);
+    open_.emplace_back();
+    return id;
+  }
+
+  int32_t lookup(const std::string &name) const
+  {
+    auto found = zoneIds.find(name);
+    return found == zoneIds.end() ? -1 : (int32_t)found->second;
+  }
+
+  void append(uint32_t zone, int64_t time, int32_t value)
+  {
+    OpenBlock &block = open_[zone];
+    block.times.push_back(time);
+    block.values.push_back(value);
+    samples++;
+    if (block.times.size() == BLOCK_SAMPLES) {
+      flush(zone);
+    }
+  }
+
+  void close()
+  {
+    for (uint32_t zone = 0; zone < open_.size(); zone++) {
+      flush(zone);
+    }
+    fclose(data);
+
+    FILE *index = fopen((base + ".idx").c_str(), "wb");
+    uint32_t magic = INDEX_MAGIC, zoneCount = zoneNames.size(), entryCount = entries.size();
+    fwrite(&magic, 4, 1, index);
+    fwrite(&zoneCount, 4, 1, index);
+    for (const std::string &name : zoneNames) {
+      uint16_t length = name.size();
+      fwrite(&length, 2, 1, index);
+      fwrite(name.data(), 1, length, index);
+    }
+    fwrite(&entryCount, 4, 1, index);
+    fwrite(entries.data(), sizeof(IndexEntry), entryCount, index);
+    fclose(index);
+  }
+
+  /**
+   * Decode every sample of a zone in [from, to]
+   */
+  template <typename Visitor>
+  uint64_t query(uint32_t zone, int64_t from, int64_t to, Visitor visit)
+  {
+    IndexEntry key = {};
+    key.zone = zone;
+    key.first = INT64_MIN;
+    auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const IndexEntry &a, const IndexEntry &b) {
+      return a.zone != b.zone ? a.zone < b.zone : a.first < b.first;
+    });
+
+    uint64_t matched = 0;
+    std::vector<uint8_t> buffer;
+    for (; it != entries.end() && it->zone == zone && it->first <= to; ++it) {
+      if (it->last < from) {
+        continue;
+      }
+      buffer.resize(it->size);
+      fseek(data, it->offset, SEEK_SET);
+      if (fread(buffer.data(), 1, it->size, data) != it->size) {
+        break;
+      }
+
+      const uint8_t *times = buffer.data();
+      const uint8_t *values = times;
+      for (uint32_t i = 0; i < it->count; i++) {
+        getVarint(values);
+      }
+
+      int64_t time = it->first, delta = 0;
+      int32_t value = 0;
+      for (uint32_t i = 0; i < it->count; i++) {
+        if (i > 0) {
+          delta += unzigzag(getVarint(times));
+          time += delta;
+        } else {
+          getVarint(times);
+        }
+        value += (int32_t)unzigzag(getVarint(values));
+        if (time >= from && time <= to) {
+          visit(time, value);
+          matched++;
+        }
+      }
+    }
+    return matched;
+  }
+
+  uint64_t samples = 0;
+  uint64_t bytes = 0;
+
+private:
+  void flush(uint32_t zone)
+  {
+    OpenBlock &block = open_[zone];
+    if (block.times.empty()) {
+      return;
+    }
+
+    encoded.clear();
+    int64_t previous = block.times[0], delta = 0;
+    putVarint(encoded, 0);
+    for (size_t i = 1; i < block.times.size(); i++) {
+      int64_t current = block.times[i] - previous;
+      putVarint(encoded, zigzag(current - delta));
+      delta = current;
+      previous = block.times[i];
+    }
+    int32_t last = 0;
+    for (int32_t value : block.values) {
+      putVarint(encoded, zigzag(value - last));
+      last = value;
+    }
+
+    IndexEntry entry;
+    entry.zone = zone;
+    entry.count = block.times.size();
+    entry.first = block.times.front();
+    entry.last = block.times.back();
+    entry.offset = bytes;
+    entry.size = encoded.size();
+    entries.push_back(entry);
+
+    fwrite(encoded.data(), 1, encoded.size(), data);
+    bytes += encoded.size();
+    block.times.clear();
+    block.values.clear();
+  }
+
+  std::string base;
+  FILE *data = nullptr;
+  std::deque<std::string> zoneNames; // stable storage for the views zoneIds is keyed on
+  std::unordered_map<std::string_view, uint32_t> zoneIds;
+  std::vector<OpenBlock> open_;
+  std::vector<IndexEntry> entries;
+  std::vector<uint8_t> encoded;
+};
+
+/**
+ * Parse "512.25" into 1/16 counts without allocating
+ */
+static int32_t parseSixteenths(std::string_view text)
+{
+  int32_t whole = 0, fraction = 0, scale = 1;
+  size_t i = 0;
+  bool negative = i < text.size() && text[i] == '-';
+  if (negative) {
+    i++;
+  }
+  for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++) {
+    whole = whole * 10 + (text[i] - '0');
+  }
+  if (i < text.size() && text[i] == '.') {
+    for (i++; i < text.size() && text[i] >= '0' && text[i] <= '9' && scale < 10000; i++) {
+      fraction = fraction * 10 + (text[i] - '0');
+      scale *= 10;
+    }
+  }
+  int32_t value = whole * 16 + (fraction * 16 + scale / 2) / scale;
+  return negative ? -value : value;
+}
+
+/**
+ * Zero-copy parse of one telemetry line: scans the buffer for "node" and "sensorNValue"
+ * keys and appends every reading, the line is never copied or tokenised
+ * @return readings stored
+ */
+static uint32_t ingestJsonLine(Store &store, std::string_view line, int64_t arrival)
+{
+  int64_t time = arrival;
+  size_t brace = line.find('{');
+  if (brace == std::string_view::npos) {
+    return 0;
+  }
+  if (brace > 0 && line[0] >= '0' && line[0] <= '9') {
+    time = strtoll(line.data(), nullptr, 10);
+  }
+  std::string_view json = line.substr(brace);
+
+  std::string_view node = "0";
+  size_t at = json.find("\"node\":");
+  if (at != std::string_view::npos) {
+    size_t start = at + 7, end = start;
+    while (end < json.size() && json[end] >= '0' && json[end] <= '9') {
+      end++;
+    }
+    node = json.substr(start, end - start);
+  }
+
+  char name[32];
+  uint32_t stored = 0;
+  for (size_t pos = json.find("\"sensor"); pos != std::string_view::npos; pos = json.find("\"sensor", pos + 1)) {
+    size_t numberStart = pos + 7, numberEnd = numberStart;
+    while (numberEnd < json.size() && json[numberEnd] >= '0' && json[numberEnd] <= '9') {
+      numberEnd++;
+    }
+    if (numberEnd == numberStart || json.compare(numberEnd, 8, "Value\":\"") != 0) {
+      continue;
+    }
+    size_t valueStart = numberEnd + 8;
+    size_t valueEnd = json.find('"', valueStart);
+    if (valueEnd == std::string_view::npos) {
+      break;
+    }
+
+    int length = snprintf(name, sizeof(name), "%.*s:%.*s", (int)node.size(), node.data(),
+                          (int)(numberEnd - numberStart), json.data() + numberStart);
+    store.append(store.zoneId(std::string_view(name, length)), time, parseSixteenths(json.substr(valueStart, valueEnd - valueStart)));
+    stored++;
+  }
+  return stored;
+}
+
+static int64_t nowMs()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static int writeJson(Store &store)
+{
+  char *line = nullptr;
+  size_t capacity = 0;
+  ssize_t length;
+  uint64_t readings = 0;
+
+  while ((length = getline(&line, &capacity, stdin)) > 0) {
+    readings += ingestJsonLine(store, std::string_view(line, length), nowMs());
+  }
+  free(line);
+
+  fprintf(stderr, "%llu readings\n", (unsigned long long)readings);
+  return 0;
+}
+
+static uint8_t crc8(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (int i = 0; i < 8; i++) {
+    crc = crc & 1 ? (crc >> 1) ^ 0x8C : crc >> 1;
+  }
+  return crc;
+}
+
+/**
+ * Bus sensor frames as the gateway sees them on the wire (src/bus.cpp)
+ */
+static int writeBus(Store &store)
+{
+  std::vector<uint8_t> input;
+  uint8_t chunk[4096];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+    input.insert(input.end(), chunk, chunk + got);
+  }
+
+  uint64_t readings = 0;
+  char name[32];
+  for (size_t i = 0; i + 5 <= input.size(); i++) {
+    if (input[i] != 0x7E) {
+      continue;
+    }
+    uint8_t address = input[i + 1], type = input[i + 2], length = input[i + 3];
+    if (type != 0x02 || i + 5 + length > input.size()) {
+      continue;
+    }
+    uint8_t crc = 0;
+    for (size_t k = i + 1; k < i + 4 + length; k++) {
+      crc = crc8(crc, input[k]);
+    }
+    const uint8_t *payload = &input[i + 4];
+    if (crc != input[i + 4 + length] || length < 5 || length != 1 + 2 * payload[0] + 4) {
+      continue;
+    }
+
+    int64_t time = nowMs();
+    for (uint8_t zone = 0; zone < payload[0]; zone++) {
+      int n = snprintf(name, sizeof(name), "%u:%u", address, zone + 1);
+      store.append(store.zoneId(std::string_view(name, n)), time, payload[1 + 2 * zone] | payload[2 + 2 * zone] << 8);
+      readings++;
+    }
+    i += 4 + length;
+  }
+
+  fprintf(stderr, "%llu readings\n", (unsigned long long)readings);
+  return 0;
+}
+
+static int query(const std::string &path, const std::string &zoneName, int64_t from, int64_t to)
+{
+  Store store;
+  if (!store.open(path)) {
+    fprintf(stderr, "cannot open %s\n", path.c_str());
+    return 1;
+  }
+  int32_t zone = store.lookup(zoneName);
+  if (zone < 0) {
+    fprintf(stderr, "unknown zone %s\n", zoneName.c_str());
+    return 1;
+  }
+
+  store.query(zone, from, to, [](int64_t time, int32_t value) {
+    printf("%lld %.2f\n", (long long)time, value / 16.0);
+  });
+  return 0;
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+/**
+ * Ingest synthetic JSON frames for a fleet over a period, then time range queries
+ */
+static int bench(const std::string &path, uint32_t zones, uint32_t days, uint32_t interval)
+{
+  const uint32_t zonesPerNode = 4;
+  uint32_t nodes = (zones + zonesPerNode - 1) / zonesPerNode;
+  int64_t start = 1700000000000LL;
+  int64_t end = start + (int64_t)days * 86400000LL;
+
+  std::mt19937 random(1);
+  std::vector<double> moisture(nodes * zonesPerNode, 400.0);
+  std::normal_distribution<double> step(0.0, 1.5);
+
+  Store store;
+  if (!store.create(path)) {
+    fprintf(stderr, "cannot create %s\n", path.c_str());
+    return 1;
+  }
+
+  // Frames are generated up front in chunks so the timing covers parsing and storage only
+  char line[256];
+  std::string chunk;
+  double ingestSeconds = 0;
+  uint64_t frames = 0, inputBytes = 0;
+  for (int64_t time = start; time < end; time += (int64_t)interval * 1000) {
+    chunk.clear();
+    for (uint32_t node = 0; node < nodes; node++) {
+      int length = snprintf(line, sizeof(line), "%lld {\"node\":%u", (long long)time, node);
+      for (uint32_t zone = 0; zone < zonesPerNode; zone++) {
+        double &value = moisture[node * zonesPerNode + zone];
+        value = std::max(250.0, std::min(700.0, value + step(random)));
+        length += snprintf(line + length, sizeof(line) - length, ",\"sensor%uValue\":\"%.2f\"", zone + 1, (double)(int)value);
+      }
+      length += snprintf(line + length, sizeof(line) - length, "}\n");
+      chunk.append(line, length);
+    }
+
+    Clock::time_point began = Clock::now();
+    std::string_view rest(chunk);
+    while (!rest.empty()) {
+      size_t newline = rest.find('\n');
+      ingestJsonLine(store, rest.substr(0, newline), time);
+      rest.remove_prefix(newline + 1);
+      frames++;
+    }
+    ingestSeconds += std::chrono::duration<double>(Clock::now() - began).count();
+    inputBytes += chunk.size();
+  }
+  Clock::time_point closing = Clock::now();
+  store.close();
+  ingestSeconds += std::chrono::duration<double>(Clock::now() - closing).count();
+
+  printf("zones              %u (%u nodes)\n", nodes * zonesPerNode, nodes);
+  printf("period             %u days every %u s\n", days, interval);
+  printf("samples            %llu\n", (unsigned long long)store.samples);
+  printf("ingest             %.0f frames/s, %.1f M samples/s\n", frames / ingestSeconds, store.samples / ingestSeconds / 1e6);
+  printf("stored             %.1f MB (%.2f bytes/sample, JSON input %.1f MB)\n", store.bytes / 1e6,
+         (double)store.bytes / store.samples, inputBytes / 1e6);
+
+  Store reader;
+  reader.open(path);
+  const struct { const char *name; int64_t span; } ranges[] = {
+    { "1 hour", 3600000LL }, { "1 day", 86400000LL }, { "30 days", 30 * 86400000LL }
+  };
+  for (const auto &range : ranges) {
+    std::vector<uint32_t> latencies;
+    uint64_t matched = 0;
+    for (int i = 0; i < 200; i++) {
+      uint32_t zone = random() % (nodes * zonesPerNode);
+      int64_t from = start + (int64_t)(random() % (uint64_t)std::max<int64_t>(1, end - start - range.span));
+      Clock::time_point began = Clock::now();
+      int64_t sum = 0;
+      matched += reader.query(zone, from, from + range.span, [&sum](int64_t, int32_t value) { sum += value; });
+      latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - began).count());
+    }
+    printf("query %-8s     p50 %u us, p99 %u us, %llu samples/query\n", range.name, percentile(latencies, 0.5),
+           percentile(latencies, 0.99), (unsigned long long)(matched / 200));
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 3 && !strcmp(argv[1], "write")) {
+    Store store;
+    if (!store.create(argv[2])) {
+      fprintf(stderr, "cannot create %s\n", argv[2]);
+      return 1;
+    }
+    int result = argc >= 4 && !strcmp(argv[3], "--bus") ? writeBus(store) : writeJson(store);
+    store.close();
+    return result;
+  }
+  if (argc == 6 && !strcmp(argv[1], "query")) {
+    return query(argv[2], argv[3], strtoll(argv[4], nullptr, 10), strtoll(argv[5], nullptr, 10));
+  }
+  if (argc >= 3 && !strcmp(argv[1], "bench")) {
+    uint32_t zones = 500, days = 365, interval = 300;
+    for (int i = 3; i + 1 < argc; i += 2) {
+      if (!strcmp(argv[i], "--zones")) {
+        zones = atoi(argv[i + 1]);
+      } else if (!strcmp(argv[i], "--days")) {
+        days = atoi(argv[i + 1]);
+      } else if (!strcmp(argv[i], "--interval")) {
+        interval = std::max(1, atoi(argv[i + 1]));
+      }
+    }
+    return bench(argv[2], zones, days, interval);
+  }
+
+  fprintf(stderr,
+          "usage: %s write <store> [--json|--bus] < input\n"
+          "       %s query <store> <node:zone> <from-ms> <to-ms>\n"
+          "       %s bench <store> [--zones 500] [--days 365] [--interval 300]\n",
+          argv[0], argv[0], argv[0]);
+  return 1;
+}
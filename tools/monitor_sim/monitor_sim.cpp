@@ -0,0 +1,321 @@
+/**
+  Pump response monitor replay: synthetic moisture traces of working and failing pumps
+  through the real detector of src/pumpmonitor.cpp, sampled and watered the way loop()
+  does it (one pass every LOOP_PERIOD_MS, a zone asks for water while its reading is
+  above MOISTURE_THRESHOLD and it is not locked out). The pumps are granted by the real
+  arbiter of src/arbiter.cpp and their run time comes from the ledger of src/pumps.cpp,
+  so with several zones on the trace they preempt each other every PUMP_SLICE_MS.
+  Each trace runs with one zone, and with ZONE_COUNT zones sharing the supply and the
+  reservoir.
+  --mode pulse waters the way PULSE_SOAK_ENABLED does instead: src/pulsesoak.cpp decides
+  at every sample and ends each burst between samples (endPumpBursts()). --mode predictive
+  waters the way PREDICTIVE_ENABLED does, in pulses from src/predict.cpp ended the same
+  way once the ledger shows the planned run time.
+
+  The soil dries by 2..6 counts an hour from 440..460. Water reaches the sensor 10..40 s
+  after the pump starts and keeps arriving as long after it stops; while it arrives the
+  reading falls at the trace's rate. Sensor noise is 2 counts, plus a 15..40 count spike
+  on one reading in 200.
+    healthy     40..100 counts a minute
+    slow soil   25..35 counts a minute, a clay pot or a deep sensor
+    dry         the reservoir is empty from the start: no water at all
+    empties     healthy, the reservoir runs empty at a random time of the second day
+    weak pump   8..15 counts a minute, a clogged line that barely waters
+  Every trial runs 3 days.
+
+  Output per trace: share of zones locked out at least once, the pump run time spent
+  without water (or with the weak pump) before that lockout, median and max, and the
+  share of zones locked out while the pump was moving water (false lockouts).
+  Checked: every zone of the dry and empties traces is locked out. A zone that never is
+  gets a FAIL line and makes the exit status non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/monitor_sim/monitor_sim.cpp src/pumpmonitor.cpp src/arbiter.cpp \
+        src/pumps.cpp src/pulsesoak.cpp src/predict.cpp -o monitor_sim
+    ./monitor_sim --trials 100 --mode pulse
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "arbiter.h"
+#include "pumps.h"
+#include "pumpmonitor.h"
+#include "pulsesoak.h"
+#include "predict.h"
+
+#define STEP_MS 1000 // the arbiter and the pumps, as serviceBackground() runs them
+#define LOOP_MS LOOP_PERIOD_MS
+#define DAY_MS  86400000UL
+
+enum Trace {
+  TRACE_HEALTHY,
+  TRACE_SLOW,
+  TRACE_DRY,
+  TRACE_EMPTIES,
+  TRACE_WEAK,
+  TRACE_COUNT
+};
+
+static const char *traceNames[TRACE_COUNT] = { "healthy", "slow soil", "dry", "empties", "weak pump" };
+
+// How loop() turns a reading into a pump request
+enum Mode {
+  MODE_THRESHOLD,
+  MODE_PULSE,
+  MODE_PREDICTIVE,
+  MODE_COUNT
+};
+
+static const char *modeNames[MODE_COUNT] = { "threshold", "pulse", "predictive" };
+
+// A zone's soil and water supply
+struct Soil {
+  double moisture;      // counts, higher is drier
+  double dryingPerMs;
+  double ratePerMs;     // fall while water arrives
+  uint32_t delayMs;     // pump start to water at the sensor, and pump stop to the last of it
+  uint32_t waterOnAt;   // water reaches the sensor from here ...
+  uint32_t waterOffAt;  // ... until here
+  bool flowing;         // the pump moves water
+};
+
+struct Zone {
+  Soil soil;
+  PumpMonitor monitor;
+  PulseSoak pulse;
+  ZonePredictor predictor;
+  bool pumpOn;
+  double dryStart;      // pump run time without water counts from here
+  double dryRunMs;
+};
+
+struct ZoneResult {
+  bool locked;
+  double dryRunMs;    // pump run time without water before the first lockout
+  bool falseLockout;  // locked out while the pump was still moving water
+};
+
+/**
+ * The soil of one zone for the trace
+ */
+static void soilInit(Soil &soil, Trace trace, std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  soil.moisture = 440 + 20 * uniform(random);
+  soil.dryingPerMs = (2 + 4 * uniform(random)) / 3600000.0;
+  soil.delayMs = 10000 + (uint32_t)(30000 * uniform(random));
+  soil.waterOnAt = soil.waterOffAt = 0;
+  soil.flowing = trace != TRACE_DRY;
+
+  double perMinute = 0;
+  switch (trace) {
+  case TRACE_HEALTHY:
+  case TRACE_EMPTIES:
+    perMinute = 40 + 60 * uniform(random);
+    break;
+  case TRACE_SLOW:
+    perMinute = 25 + 10 * uniform(random);
+    break;
+  case TRACE_WEAK:
+    perMinute = 8 + 7 * uniform(random);
+    break;
+  default:
+    break;
+  }
+  soil.ratePerMs = perMinute / 60000;
+}
+
+/**
+ * One trial: zones 0..zones-1 on the trace, sharing the supply and the reservoir
+ */
+static void trial(Mode mode, Trace trace, uint8_t zones, std::mt19937 &random, std::vector<ZoneResult> &results)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> noise(0, 2);
+
+  Zone zone[ZONE_COUNT];
+  ZoneResult result[ZONE_COUNT];
+  for (uint8_t z = 0; z < zones; z++) {
+    soilInit(zone[z].soil, trace, random);
+    responseInit(zone[z].monitor);
+    pulseSoakInit(zone[z].pulse);
+    predictorInit(zone[z].predictor);
+    zone[z].pumpOn = false;
+    zone[z].dryStart = -1;
+    zone[z].dryRunMs = 0;
+    result[z] = { false, 0, false };
+  }
+  // The reservoir of "empties" runs dry here
+  uint32_t emptyAt = DAY_MS + (uint32_t)(DAY_MS * uniform(random));
+
+  PumpArbiter arbiter;
+  arbiterInit(arbiter);
+  PumpLedger ledger;
+  pumpLedgerInit(ledger, nullptr, 0);
+  ZoneMask requests = 0;
+
+  for (uint32_t now = STEP_MS; now < 3 * DAY_MS; now += STEP_MS) {
+    for (uint8_t z = 0; z < zones; z++) {
+      Soil &soil = zone[z].soil;
+      // The soil over the last step
+      bool arriving = soil.waterOnAt && now > soil.waterOnAt && (soil.waterOffAt == 0 || now - STEP_MS < soil.waterOffAt);
+      soil.moisture += soil.dryingPerMs * STEP_MS;
+      if (arriving) {
+        soil.moisture -= soil.ratePerMs * STEP_MS;
+      }
+      soil.moisture = std::max(soil.moisture, 250.0);
+      if (soil.waterOffAt && now > soil.waterOffAt) {
+        soil.waterOnAt = soil.waterOffAt = 0;
+      }
+      if (zone[z].pumpOn && zone[z].dryStart >= 0) {
+        zone[z].dryRunMs += STEP_MS;
+      }
+      if (trace == TRACE_EMPTIES && soil.flowing && now >= emptyAt) {
+        soil.flowing = false;
+        if (zone[z].pumpOn) {
+          soil.waterOffAt = now + soil.delayMs;
+        }
+        zone[z].dryStart = now;
+      }
+    }
+
+    // loop(): every zone's reading through the monitor, then its request
+    if (now % LOOP_MS == 0) {
+      for (uint8_t z = 0; z < zones; z++) {
+        int reading = (int)lround(zone[z].soil.moisture + noise(random));
+        if (uniform(random) < 1.0 / 200) {
+          reading += 15 + (int)(25 * uniform(random));
+        }
+
+        bool locked = responseHoldsPump(zone[z].monitor);
+        bool thirsty = reading > MOISTURE_THRESHOLD;
+        bool watering = thirsty;
+        if (mode == MODE_PULSE) {
+          thirsty = pulseSoakUpdate(zone[z].pulse, thirsty && !locked, zone[z].pumpOn, now);
+          watering = thirsty || zone[z].pulse.state != PULSE_IDLE;
+        } else if (mode == MODE_PREDICTIVE) {
+          thirsty = predictorUpdate(zone[z].predictor, reading, pumpLedgerOnMs(ledger, z, now), locked, now);
+          watering = thirsty || zone[z].predictor.state != PREDICT_IDLE;
+        }
+        uint8_t event = responseSample(zone[z].monitor, reading, pumpLedgerOnMs(ledger, z, now), watering, now);
+        if (event == PUMP_FAULT_NO_RESPONSE && !result[z].locked) {
+          result[z].locked = true;
+          result[z].falseLockout = trace == TRACE_HEALTHY || trace == TRACE_SLOW || zone[z].dryStart < 0;
+          result[z].dryRunMs = zone[z].dryRunMs;
+        }
+        bool want = thirsty && !responseHoldsPump(zone[z].monitor);
+        requests = want ? requests | (ZoneMask)(1 << z) : requests & (ZoneMask)~(1 << z);
+      }
+    }
+
+    // endPumpBursts()
+    if (mode == MODE_PULSE) {
+      for (uint8_t z = 0; z < zones; z++) {
+        if ((requests >> z & 1) && !pulseSoakTick(zone[z].pulse, zone[z].pumpOn, now)) {
+          requests &= (ZoneMask)~(1 << z);
+        }
+      }
+    } else if (mode == MODE_PREDICTIVE) {
+      for (uint8_t z = 0; z < zones; z++) {
+        if ((requests >> z & 1) && !predictorTick(zone[z].predictor, pumpLedgerOnMs(ledger, z, now), now)) {
+          requests &= (ZoneMask)~(1 << z);
+        }
+      }
+    }
+
+    // applyPumpGrants()
+    ZoneMask granted = arbiterUpdate(arbiter, requests, now);
+    for (uint8_t z = 0; z < zones; z++) {
+      bool on = granted >> z & 1;
+      if (on == zone[z].pumpOn) {
+        continue;
+      }
+      Soil &soil = zone[z].soil;
+      zone[z].pumpOn = on;
+      pumpLedgerSwitch(ledger, z, on, now);
+      if (on) {
+        if (soil.flowing) {
+          // Water still in flight from the previous run keeps arriving
+          if (!soil.waterOnAt) {
+            soil.waterOnAt = now + soil.delayMs;
+          }
+          soil.waterOffAt = 0;
+        }
+        if ((!soil.flowing || trace == TRACE_WEAK) && zone[z].dryStart < 0) {
+          zone[z].dryStart = now;
+        }
+      } else if (soil.flowing && soil.waterOnAt) {
+        soil.waterOffAt = now + soil.delayMs;
+      }
+    }
+  }
+
+  results.insert(results.end(), result, result + zones);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t trials = 100;
+  Mode mode = MODE_THRESHOLD;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--trials")) {
+      trials = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--mode") && !strcmp(argv[i + 1], "pulse")) {
+      mode = MODE_PULSE;
+    } else if (!strcmp(argv[i], "--mode") && !strcmp(argv[i + 1], "predictive")) {
+      mode = MODE_PREDICTIVE;
+    } else if (!strcmp(argv[i], "--mode") && !strcmp(argv[i + 1], "threshold")) {
+      mode = MODE_THRESHOLD;
+    } else {
+      fprintf(stderr, "usage: %s [--trials N] [--mode threshold|pulse|predictive]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  uint32_t failures = 0;
+  printf("%s watering\n", modeNames[mode]);
+  printf("%-10s %5s %8s %14s %11s %8s\n", "trace", "zones", "locked", "dry run med s", "max s", "false");
+  for (uint8_t zones : { (uint8_t)1, (uint8_t)ZONE_COUNT }) {
+    for (int trace = 0; trace < TRACE_COUNT; trace++) {
+      std::vector<ZoneResult> results;
+      for (uint32_t n = 0; n < trials; n++) {
+        trial(mode, (Trace)trace, zones, random, results);
+      }
+
+      std::vector<double> dryRuns;
+      uint32_t locked = 0, falseLockouts = 0;
+      for (const ZoneResult &result : results) {
+        locked += result.locked;
+        falseLockouts += result.falseLockout;
+        if (result.locked && !result.falseLockout) {
+          dryRuns.push_back(result.dryRunMs / 1000);
+        }
+      }
+      std::sort(dryRuns.begin(), dryRuns.end());
+
+      printf("%-10s %5u %7.1f%%", traceNames[trace], zones, 100.0 * locked / results.size());
+      if (dryRuns.empty()) {
+        printf(" %14s %11s", "-", "-");
+      } else {
+        printf(" %14.0f %11.0f", dryRuns[dryRuns.size() / 2], dryRuns.back());
+      }
+      printf(" %7.1f%%\n", 100.0 * falseLockouts / results.size());
+      if ((trace == TRACE_DRY || trace == TRACE_EMPTIES) && locked < results.size()) {
+        printf("FAIL %s, %u zones: %u of %u zones never locked out\n", traceNames[trace], zones,
+               (uint32_t)results.size() - locked, (uint32_t)results.size());
+        failures++;
+      }
+    }
+  }
+  return failures ? 1 : 0;
+}
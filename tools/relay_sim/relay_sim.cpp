@@ -0,0 +1,198 @@
+/**
+  74HC595 relay chain check: the frames of src/relays.cpp clocked bit by bit through a
+  modeled chain of 1, 2 and 4 shift registers (8, 16 and 32 relays), the way the SPI
+  peripheral sends them (mode 0, MSB first) between the latch going low and high.
+
+  Each modeled chip has an 8-bit shift register, clocked on the rising SRCLK edge from
+  SER (its QH' feeds the next chip's SER), and a storage register copied on the rising
+  RCLK edge that drives Q0..Q7. Relays are active LOW.
+
+  Checked for --updates random relay states per chain, with 1..3 relays changing per
+  update like a loop pass does: after the latch every output matches its relay, and no
+  output moves before it (no relay glitches while the frame shifts through). Output per
+  chain: the bits shifted per update, the wire time at the 8 MHz SPI clock the driver
+  uses, and that of a digitalWrite() per relay (~5 us each) for comparison. CPU cycles
+  per relaysFlush() come from the AVR benchmark:
+    pio run -e uno_bench_zones8 && ./avr_bench .pio/build/uno_bench_zones8/firmware.elf
+  The watchdog interrupt can fire with relaysWrite() stopped anywhere in a frame. Checked
+  for every bit it can stop at: relaysWatchdogOff() (SPI off, the all-off frame clocked
+  by hand and latched) leaves every relay off, and so does the interrupted write once it
+  resumes with SPI off and raises the latch. For comparison the count of stop points
+  where an SPI all-off write from the interrupt, as relaysAllOff() does, ends with a
+  relay on once the interrupted frame finishes.
+  Any failed check is printed and makes the exit status non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/relay_sim/relay_sim.cpp src/relays.cpp -o relay_sim
+    ./relay_sim --updates 100000
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "relays.h"
+
+#define SPI_HZ             8000000.0
+#define DIGITAL_WRITE_US   5.0
+#define MAX_CHIPS          4
+
+struct Chain595 {
+  uint8_t shift[MAX_CHIPS];
+  uint8_t storage[MAX_CHIPS];
+  uint8_t chips;
+};
+
+/**
+ * Rising SRCLK: every register shifts up one, QH' of each chip feeds the next one
+ */
+static void clockBit(Chain595 &chain, bool ser)
+{
+  for (int chip = chain.chips - 1; chip >= 0; chip--) {
+    bool in = chip == 0 ? ser : (chain.shift[chip - 1] & 0x80);
+    chain.shift[chip] = (uint8_t)(chain.shift[chip] << 1 | in);
+  }
+}
+
+/**
+ * Rising RCLK: the shift registers drive the outputs
+ */
+static void latch(Chain595 &chain)
+{
+  memcpy(chain.storage, chain.shift, chain.chips);
+}
+
+/**
+ * @return relay states as the outputs drive them, active LOW
+ */
+static uint32_t relaysOn(const Chain595 &chain)
+{
+  uint32_t mask = 0;
+  for (uint8_t chip = 0; chip < chain.chips; chip++) {
+    mask |= (uint32_t)(uint8_t)~chain.storage[chip] << (chip * 8);
+  }
+  return mask;
+}
+
+/**
+ * Clock bits from..to - 1 of a frame into the chain, MSB of the first byte first
+ * @param chain
+ * @param bytes
+ * @param from
+ * @param to
+ */
+static void shiftBits(Chain595 &chain, const uint8_t *bytes, uint8_t from, uint8_t to)
+{
+  for (uint8_t bit = from; bit < to; bit++) {
+    clockBit(chain, bytes[bit / 8] >> (7 - bit % 8) & 1);
+  }
+}
+
+/**
+ * Fire the watchdog at every bit of a frame being written
+ * @param chain
+ * @param random
+ * @param spiPath counts the stop points where an SPI all-off write leaves a relay on
+ * @return stop points where a relay is left on with relaysWatchdogOff()
+ */
+static uint32_t watchdogCuts(Chain595 &chain, std::mt19937 &random, uint32_t &spiPath)
+{
+  uint8_t bits = chain.chips * 8;
+  uint8_t off[MAX_CHIPS];
+  relays595Frame(0, chain.chips, off);
+
+  uint32_t left = 0;
+  for (uint8_t cut = 0; cut <= bits; cut++) {
+    uint8_t frame[MAX_CHIPS];
+    relays595Frame((uint32_t)random(), chain.chips, frame);
+
+    // relaysWatchdogOff(): the write stops after cut bits, the interrupt clocks the
+    // all-off frame by hand and latches, the resumed write only raises the latch
+    Chain595 hung = chain;
+    shiftBits(hung, frame, 0, cut);
+    shiftBits(hung, off, 0, bits);
+    latch(hung);
+    bool on = relaysOn(hung) != 0;
+    latch(hung);
+    left += on || relaysOn(hung) != 0;
+
+    // relaysAllOff() over SPI: the resumed write shifts the rest of its frame and latches
+    Chain595 spi = chain;
+    shiftBits(spi, frame, 0, cut);
+    shiftBits(spi, off, 0, bits);
+    latch(spi);
+    shiftBits(spi, frame, cut, bits);
+    latch(spi);
+    spiPath += relaysOn(spi) != 0;
+  }
+  return left;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t updates = 100000;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--updates")) {
+      updates = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--updates N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  uint32_t failures = 0;
+
+  for (uint8_t chips = 1; chips <= MAX_CHIPS; chips *= 2) {
+    uint8_t relays = chips * 8;
+    Chain595 chain;
+    chain.chips = chips;
+    for (uint8_t chip = 0; chip < chips; chip++) {
+      chain.shift[chip] = chain.storage[chip] = (uint8_t)random(); // powers up random
+    }
+
+    uint32_t state = 0, glitches = 0, wrong = 0;
+    for (uint32_t update = 0; update <= updates; update++) {
+      // relaysBegin() clears the chain first, then each update flips 1..3 relays
+      if (update > 0) {
+        for (uint32_t flips = 1 + random() % 3; flips > 0; flips--) {
+          state ^= 1UL << (random() % relays);
+        }
+      }
+
+      uint8_t frame[MAX_CHIPS];
+      uint8_t count = relays595Frame(state, chips, frame);
+      uint32_t before = relaysOn(chain);
+      for (uint8_t i = 0; i < count; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+          clockBit(chain, frame[i] >> bit & 1);
+          glitches += update > 0 && relaysOn(chain) != before;
+        }
+      }
+      latch(chain);
+      wrong += relaysOn(chain) != state;
+    }
+
+    double wireUs = chips * 8 / SPI_HZ * 1e6;
+    printf("%2u relays: %u updates, %u wrong, %u glitches | %2u bits per update, %4.1f us on the wire"
+           " (%5.1f us as %u digitalWrite)\n",
+           relays, updates, wrong, glitches, chips * 8, wireUs, relays * DIGITAL_WRITE_US, relays);
+    if (wrong || glitches) {
+      printf("FAIL %u relays: the chain does not hold the requested state\n", relays);
+      failures++;
+    }
+
+    uint32_t spiPath = 0;
+    uint32_t left = watchdogCuts(chain, random, spiPath);
+    printf("          watchdog mid-frame: %u stop points, %u with a relay left on (%u over SPI)\n",
+           relays + 1, left, spiPath);
+    if (left) {
+      printf("FAIL %u relays: relaysWatchdogOff() leaves a relay on\n", relays);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/**
+  Report-by-exception replay: runs recorded telemetry through the firmware's exception
+  filter (src/report.cpp) and measures how many messages it saves and how stale the
+  cloud's copy of each zone gets.
+
+  Input (stdin) is the frame log the ingest tool reads, one frame per line with the time
+  it was received in ms: [1700000000000 ]{"node":3,"sensor1Value":"512.00",...}
+  Every frame stream (node and firstZone) gets its own heartbeat, like a board sending
+  its frames. A zone's pump state is taken from "pumps" when the frame has it, otherwise
+  a pump runs while its "pumpSec" counter grows. A change of "pumpFault" sends the
+  whole frame, as the firmware does.
+
+  Staleness is measured per sample against the raw recorded reading: the age of the
+  value the cloud holds, the error between the two, and the longest time the error
+  stayed beyond the deadband (sensor noise and filter lag).
+
+  Record a trace with the fleet simulator, or use frames logged by a gateway:
+    g++ -O2 -std=c++17 -Isrc tools/report_sim/report_sim.cpp src/report.cpp -o report_sim
+    ./fleet_sim --devices 100 --minutes 1440 --threads 1 --frame-log frames.log
+    ./report_sim --deadband 6 --heartbeat-ms 900000 < frames.log
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config.h"
+#include "report.h"
+
+#define MAX_FRAME_ZONES 8
+
+struct ZoneTrace {
+  ZoneReport report;
+  double cloudValue;     // what the cloud holds for the zone
+  int64_t cloudAt;       // when it got it, ms
+  int64_t offBandSince;  // the raw reading left the deadband around cloudValue, -1 while inside
+  uint32_t pumpSec;      // last counters seen, to tell a running pump without "pumps"
+  uint32_t pumpRuns;
+  bool pumpReported;
+  bool seen;
+};
+
+struct Stream {
+  int64_t lastHeartbeat;
+  long pumpFault;
+  bool started;
+  std::map<uint32_t, ZoneTrace> zones;
+};
+
+struct ReplayStats {
+  uint64_t frames = 0;        // every frame, what the firmware sends without the filter
+  uint64_t frameBytes = 0;
+  uint64_t messages = 0;      // heartbeats and single zones
+  uint64_t messageBytes = 0;
+  uint64_t heartbeats = 0;
+  uint64_t zoneMessages = 0;
+  uint64_t pumpMessages = 0;  // zones sent because their pump switched
+  uint64_t samples = 0;
+  int64_t firstAt = INT64_MAX;
+  int64_t lastAt = INT64_MIN;
+  int64_t maxAgeMs = 0;
+  int64_t maxOffBandMs = 0;
+  double errorSum = 0;
+  double errorMax = 0;
+  std::vector<float> errors;
+};
+
+static uint8_t deadband = REPORT_DEADBAND;
+static uint32_t heartbeatMs = REPORT_HEARTBEAT_MS;
+
+/**
+ * @param json
+ * @param key with quotes and colon, like "\"node\":"
+ * @param fallback
+ * @return the integer after key, or fallback
+ */
+static long findNumber(std::string_view json, const char *key, long fallback)
+{
+  size_t at = json.find(key);
+  return at == std::string_view::npos ? fallback : strtol(json.data() + at + strlen(key), nullptr, 10);
+}
+
+/**
+ * @param json
+ * @param key with quotes, colon and bracket, like "\"pumpSec\":["
+ * @param values filled with the array elements
+ * @return number of elements
+ */
+static int findArray(std::string_view json, const char *key, uint32_t *values)
+{
+  size_t at = json.find(key);
+  if (at == std::string_view::npos) {
+    return 0;
+  }
+  const char *p = json.data() + at + strlen(key);
+  int count = 0;
+  while (count < MAX_FRAME_ZONES && *p && *p != ']') {
+    char *end;
+    values[count++] = strtoul(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    p = *end == ',' ? end + 1 : end;
+  }
+  return count;
+}
+
+/**
+ * Size of the single-zone frame prepareZoneForWiFi() would send
+ */
+static int zoneFrameLength(uint32_t zone, float value, uint32_t pumpSec)
+{
+  return snprintf(nullptr, 0, "{\"sensor%uValue\":\"%.2f\",\"firstZone\":%u,\"pumpSec\":[%u],\"pumpRuns\":[0],"
+                  "\"pumpMl\":[%u],\"pumps\":0,\"pumpFault\":0}",
+                  zone, value, zone, pumpSec, pumpSec * PUMP_FLOW_ML_PER_MIN / 60);
+}
+
+/**
+ * Track the cloud's copy of a zone after a sample and whatever was sent for it
+ */
+static void measure(ZoneTrace &trace, double reading, int64_t time, ReplayStats &stats)
+{
+  double error = fabs(reading - trace.cloudValue);
+  stats.samples++;
+  stats.errorSum += error;
+  stats.errorMax = std::max(stats.errorMax, error);
+  stats.errors.push_back((float)error);
+  stats.maxAgeMs = std::max(stats.maxAgeMs, time - trace.cloudAt);
+
+  if (error <= deadband) {
+    trace.offBandSince = -1;
+  } else if (trace.offBandSince < 0) {
+    trace.offBandSince = time;
+  } else {
+    stats.maxOffBandMs = std::max(stats.maxOffBandMs, time - trace.offBandSince);
+  }
+}
+
+/**
+ * Replay one recorded frame
+ */
+static void replayLine(std::map<std::string, Stream> &streams, std::string_view line, ReplayStats &stats)
+{
+  size_t brace = line.find('{');
+  if (brace == std::string_view::npos || brace == 0 || line[0] < '0' || line[0] > '9') {
+    return;
+  }
+  int64_t time = strtoll(line.data(), nullptr, 10);
+  std::string_view json = line.substr(brace);
+  while (!json.empty() && (json.back() == '\n' || json.back() == '\r')) {
+    json.remove_suffix(1);
+  }
+
+  long node = findNumber(json, "\"node\":", 0);
+  long firstZone = findNumber(json, "\"firstZone\":", 1);
+  long pumps = findNumber(json, "\"pumps\":", -1);
+  long pumpFault = findNumber(json, "\"pumpFault\":", 0);
+  uint32_t pumpSec[MAX_FRAME_ZONES] = {};
+  uint32_t pumpRuns[MAX_FRAME_ZONES] = {};
+  findArray(json, "\"pumpSec\":[", pumpSec);
+  findArray(json, "\"pumpRuns\":[", pumpRuns);
+
+  Stream &stream = streams[std::to_string(node) + ":" + std::to_string(firstZone)];
+  bool heartbeat = !stream.started || time - stream.lastHeartbeat >= (int64_t)heartbeatMs || pumpFault != stream.pumpFault;
+
+  stats.frames++;
+  stats.frameBytes += json.size();
+  stats.firstAt = std::min(stats.firstAt, time);
+  stats.lastAt = std::max(stats.lastAt, time);
+
+  for (size_t pos = json.find("\"sensor"); pos != std::string_view::npos; pos = json.find("\"sensor", pos + 1)) {
+    char *end;
+    uint32_t zone = strtoul(json.data() + pos + 7, &end, 10);
+    if (end == json.data() + pos + 7 || strncmp(end, "Value\":\"", 8)) {
+      continue;
+    }
+    double reading = strtod(end + 8, nullptr);
+    uint32_t index = zone >= (uint32_t)firstZone ? zone - firstZone : 0;
+    uint32_t seconds = index < MAX_FRAME_ZONES ? pumpSec[index] : 0;
+    uint32_t runs = index < MAX_FRAME_ZONES ? pumpRuns[index] : 0;
+
+    ZoneTrace &trace = stream.zones[zone];
+    if (!trace.seen) {
+      reportInit(trace.report, deadband);
+      trace.pumpSec = seconds;
+      trace.pumpRuns = runs;
+      trace.pumpReported = false;
+      trace.offBandSince = -1;
+      trace.seen = true;
+    }
+    bool pumpOn = pumps >= 0 ? (pumps >> (zone - 1) & 1) : seconds > trace.pumpSec || runs > trace.pumpRuns;
+    trace.pumpSec = seconds;
+    trace.pumpRuns = runs;
+
+    bool due = reportUpdate(trace.report, (float)reading, pumpOn);
+    if (heartbeat || due) {
+      reportSent(trace.report);
+      trace.cloudValue = reportValue(trace.report);
+      trace.cloudAt = time;
+    }
+    if (due && !heartbeat) {
+      stats.messages++;
+      stats.zoneMessages++;
+      stats.pumpMessages += pumpOn != trace.pumpReported;
+      stats.messageBytes += zoneFrameLength(zone, reportValue(trace.report), seconds);
+    }
+    if (heartbeat || due) {
+      trace.pumpReported = pumpOn;
+    }
+    measure(trace, reading, time, stats);
+  }
+
+  if (heartbeat) {
+    stats.messages++;
+    stats.heartbeats++;
+    stats.messageBytes += json.size();
+    stream.lastHeartbeat = time;
+    stream.pumpFault = pumpFault;
+    stream.started = true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (hasValue && !strcmp(argv[i], "--deadband")) {
+      deadband = atoi(argv[++i]);
+    } else if (hasValue && !strcmp(argv[i], "--heartbeat-ms")) {
+      heartbeatMs = strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--deadband COUNTS] [--heartbeat-ms MS] < frames.log\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::map<std::string, Stream> streams;
+  ReplayStats stats;
+  char *line = nullptr;
+  size_t capacity = 0;
+  ssize_t length;
+
+  while ((length = getline(&line, &capacity, stdin)) > 0) {
+    replayLine(streams, std::string_view(line, length), stats);
+  }
+  free(line);
+
+  if (!stats.frames) {
+    fprintf(stderr, "no timestamped frames on stdin\n");
+    return 1;
+  }
+
+  size_t p99 = std::min(stats.errors.size() - 1, (size_t)(0.99 * stats.errors.size()));
+  std::nth_element(stats.errors.begin(), stats.errors.begin() + p99, stats.errors.end());
+  double hours = (stats.lastAt - stats.firstAt) / 3600000.0;
+
+  printf("deadband           %u counts, heartbeat %u s\n", deadband, heartbeatMs / 1000);
+  printf("trace              %llu frames, %zu streams, %.1f h\n", (unsigned long long)stats.frames, streams.size(), hours);
+  printf("messages           %llu -> %llu, -%.1f %%\n", (unsigned long long)stats.frames,
+         (unsigned long long)stats.messages, 100.0 - 100.0 * stats.messages / stats.frames);
+  printf("                   %llu heartbeats, %llu zones (%llu for a pump switch)\n",
+         (unsigned long long)stats.heartbeats, (unsigned long long)stats.zoneMessages,
+         (unsigned long long)stats.pumpMessages);
+  printf("payload bytes      %llu -> %llu, -%.1f %%\n", (unsigned long long)stats.frameBytes,
+         (unsigned long long)stats.messageBytes, 100.0 - 100.0 * stats.messageBytes / stats.frameBytes);
+  if (hours > 0) {
+    printf("per stream         %.0f -> %.1f messages/h\n", stats.frames / hours / streams.size(),
+           stats.messages / hours / streams.size());
+  }
+  printf("value age          max %.0f s\n", stats.maxAgeMs / 1000.0);
+  printf("reading error      mean %.2f, p99 %.2f, max %.2f counts\n", stats.errorSum / stats.samples,
+         stats.errors[p99], stats.errorMax);
+  printf("beyond deadband    longest %.0f s\n", stats.maxOffBandMs / 1000.0);
+  return 0;
+}
@@ -0,0 +1,336 @@
+/**
+  Reservoir interlock and forecast simulation: the real level filter, debounce and
+  forecast (src/reservoir.cpp) and pump arbiter (src/arbiter.cpp) against a simulated
+  reservoir that four dry zones pump empty at PUMP_FLOW_ML_PER_MIN.
+
+  interlock   each trial starts 0.5..2 L above RESERVOIR_LOW_ML with every zone asking
+              for water, and runs applyPumpGrants() at the cadence loop() services it
+              (every 1..20 ms, stalls of 260 ms now and then). A starting pump sloshes
+              the surface at the sensor (0..400 mL, 0.8..1.6 Hz, decaying over ~2 s)
+              and keeps a small ripple on it while it runs.
+                analog  readings through the RESERVOIR_EMPTY/FULL_COUNTS map with 2 counts
+                        of noise
+                float   the switch opens while the rippled surface is below the mark
+              Output: time from the true level passing RESERVOIR_LOW_ML to the last pump
+              switching off (negative: slosh tripped it early), the water pumped below
+              the mark, and interlocks released again before a refill.
+  boot        the board starts with the reservoir 0.1..1.5 L below RESERVOIR_LOW_ML and
+              every zone asking for water, reservoirBegin() taking the first reading.
+              Output: trials in which a pump ran at all, and for how long at most.
+  forecast    ten days of watering: each zone asks for its daily water (400..1200 mL,
+              times a daily weather factor of 0.5..1.5) in two runs at random hours.
+              Every hour from the second day the hours reservoirHoursLeft() predicts
+              are compared with the hours it really took to reach the low mark.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/reservoir_sim/reservoir_sim.cpp src/reservoir.cpp src/arbiter.cpp -o reservoir_sim
+    ./reservoir_sim --trials 2000
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "reservoir.h"
+#include "arbiter.h"
+
+#define ALL_ZONES ((ZoneMask)((1UL << ZONE_COUNT) - 1))
+#define FLOW_ML_PER_MS (PUMP_FLOW_ML_PER_MIN / 60000.0)
+
+/**
+ * The firmware's analog map, reservoirRead() without the ADC
+ */
+static uint32_t countsToMillilitres(int counts)
+{
+  if (counts <= RESERVOIR_EMPTY_COUNTS) {
+    return 0;
+  }
+  if (counts >= RESERVOIR_FULL_COUNTS) {
+    return RESERVOIR_CAPACITY_ML;
+  }
+  return (uint32_t)(counts - RESERVOIR_EMPTY_COUNTS) * RESERVOIR_CAPACITY_ML / (RESERVOIR_FULL_COUNTS - RESERVOIR_EMPTY_COUNTS);
+}
+
+struct Slosh {
+  double amplitude, hz, startedAt; // mL at the sensor, Hz, ms
+};
+
+struct InterlockResult {
+  double latencyMs;   // from the true crossing to every pump off
+  double belowMl;     // pumped below the mark
+  bool released;      // the interlock let go before a refill
+};
+
+static InterlockResult interlockTrial(bool floatSwitch, std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> noise(0, 2);
+  std::uniform_int_distribution<int> gap(1, 20);
+
+  double level = RESERVOIR_LOW_ML + 500 + 1500 * uniform(random);
+  double crossedAt = -1, offAt = -1, belowMl = 0;
+  bool released = false;
+  Slosh slosh = { 0, 1, 0 };
+  double ripplePhase = uniform(random) * 2 * M_PI;
+
+  auto surface = [&](double now, bool running) {
+    double t = (now - slosh.startedAt) / 1000;
+    double wave = slosh.amplitude * exp(-t / 2) * sin(2 * M_PI * slosh.hz * t);
+    return level + wave + (running ? 40 * sin(2 * M_PI * 3 * now / 1000 + ripplePhase) : 0);
+  };
+  auto read = [&](double now, bool running) -> uint32_t {
+    double counts = RESERVOIR_EMPTY_COUNTS +
+                    surface(now, running) * (RESERVOIR_FULL_COUNTS - RESERVOIR_EMPTY_COUNTS) / RESERVOIR_CAPACITY_ML;
+    return countsToMillilitres((int)lround(counts + noise(random)));
+  };
+
+  PumpArbiter arbiter;
+  arbiterInit(arbiter);
+  Reservoir reservoir;
+  uint32_t now = 1000 + (uint32_t)(uniform(random) * 1000);
+  uint32_t first = read(now, false);
+  reservoirInit(reservoir, first, floatSwitch ? surface(now, false) < RESERVOIR_LOW_ML : first < RESERVOIR_LOW_ML, now);
+  uint32_t lastSample = now;
+  ZoneMask granted = 0;
+
+  while (now < 600000) {
+    uint32_t step = uniform(random) < 0.01 ? 260 : gap(random);
+    bool running = granted != 0;
+
+    // The pump ran through the whole step
+    if (running) {
+      double pumped = std::min(level, step * FLOW_ML_PER_MS);
+      if (level - pumped < RESERVOIR_LOW_ML) {
+        belowMl += std::min(pumped, RESERVOIR_LOW_ML - (level - pumped));
+        if (crossedAt < 0) {
+          crossedAt = now + (level - RESERVOIR_LOW_ML) / FLOW_ML_PER_MS;
+        }
+      }
+      level -= pumped;
+    }
+    now += step;
+
+    // applyPumpGrants(): reservoirService() every RESERVOIR_SAMPLE_MS, then the arbiter
+    bool interlocked = reservoir.interlocked;
+    if (now - lastSample >= RESERVOIR_SAMPLE_MS) {
+      lastSample = now;
+      if (floatSwitch) {
+        interlocked = reservoirLow(reservoir, surface(now, running) < RESERVOIR_LOW_ML, now);
+      } else {
+        reservoirLevel(reservoir, read(now, running), now);
+        uint32_t mark = reservoir.interlocked ? RESERVOIR_RESUME_ML : RESERVOIR_LOW_ML;
+        interlocked = reservoirLow(reservoir, reservoirMillilitres(reservoir) < mark, now);
+      }
+    }
+    if (offAt >= 0 && !interlocked) {
+      released = true;
+    }
+
+    ZoneMask before = granted;
+    granted = arbiterUpdate(arbiter, interlocked ? 0 : ALL_ZONES, now);
+    if (granted & ~before) {
+      slosh = { 400 * uniform(random), 0.8 + 0.8 * uniform(random), (double)now };
+    }
+    if (interlocked && !granted && offAt < 0) {
+      offAt = now;
+    }
+    if (offAt >= 0 && now - offAt > 30000) {
+      break;
+    }
+  }
+
+  if (crossedAt < 0) {
+    crossedAt = now; // tripped before the level ever got there
+  }
+  return { offAt - crossedAt, belowMl, released };
+}
+
+static void interlock(bool floatSwitch, uint32_t trials, std::mt19937 &random)
+{
+  std::vector<double> latencies, below;
+  uint32_t released = 0, early = 0;
+
+  for (uint32_t n = 0; n < trials; n++) {
+    InterlockResult result = interlockTrial(floatSwitch, random);
+    latencies.push_back(result.latencyMs);
+    below.push_back(result.belowMl);
+    released += result.released;
+    early += result.latencyMs < 0;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  std::sort(below.begin(), below.end());
+
+  printf("%-7s latency min %6.0f  median %6.0f  p99 %6.0f  max %6.0f ms | below the mark median %4.0f  max %4.0f mL"
+         " | early %u  released %u\n",
+         floatSwitch ? "float" : "analog", latencies.front(), latencies[trials / 2], latencies[trials * 99 / 100],
+         latencies.back(), below[trials / 2], below.back(), early, released);
+}
+
+/**
+ * @return ms a pump ran after a boot with the reservoir below the mark
+ */
+static uint32_t bootTrial(bool floatSwitch, std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> noise(0, 2);
+  std::uniform_int_distribution<int> gap(1, 20);
+
+  double level = RESERVOIR_LOW_ML - 100 - 1400 * uniform(random);
+  auto read = [&]() -> uint32_t {
+    double counts = RESERVOIR_EMPTY_COUNTS + level * (RESERVOIR_FULL_COUNTS - RESERVOIR_EMPTY_COUNTS) / RESERVOIR_CAPACITY_ML;
+    return countsToMillilitres((int)lround(counts + noise(random)));
+  };
+
+  // reservoirBegin(): every pump off, the float or the first reading decides
+  PumpArbiter arbiter;
+  arbiterInit(arbiter);
+  Reservoir reservoir;
+  uint32_t now = 1000 + (uint32_t)(uniform(random) * 1000);
+  uint32_t first = read();
+  reservoirInit(reservoir, first, floatSwitch || first < RESERVOIR_LOW_ML, now);
+  uint32_t lastSample = now, ranMs = 0;
+  ZoneMask granted = 0;
+
+  while (now < 30000) {
+    uint32_t step = uniform(random) < 0.01 ? 260 : gap(random);
+    if (granted) {
+      ranMs += step;
+      level -= step * FLOW_ML_PER_MS;
+    }
+    now += step;
+
+    bool interlocked = reservoir.interlocked;
+    if (now - lastSample >= RESERVOIR_SAMPLE_MS) {
+      lastSample = now;
+      if (floatSwitch) {
+        interlocked = reservoirLow(reservoir, true, now);
+      } else {
+        reservoirLevel(reservoir, read(), now);
+        uint32_t mark = reservoir.interlocked ? RESERVOIR_RESUME_ML : RESERVOIR_LOW_ML;
+        interlocked = reservoirLow(reservoir, reservoirMillilitres(reservoir) < mark, now);
+      }
+    }
+    granted = arbiterUpdate(arbiter, interlocked ? 0 : ALL_ZONES, now);
+  }
+  return ranMs;
+}
+
+static void boot(bool floatSwitch, uint32_t trials, std::mt19937 &random)
+{
+  uint32_t ran = 0, longest = 0;
+
+  for (uint32_t n = 0; n < trials; n++) {
+    uint32_t ranMs = bootTrial(floatSwitch, random);
+    ran += ranMs > 0;
+    longest = std::max(longest, ranMs);
+  }
+  printf("%-7s boot below the mark: a pump ran in %u of %u trials, for at most %u ms\n", floatSwitch ? "float" : "analog",
+         ran, trials, longest);
+}
+
+static void forecast(std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const uint32_t days = 10, stepMs = RESERVOIR_SAMPLE_MS;
+  const uint64_t end = (uint64_t)days * 86400000;
+
+  // Watering runs: zone, start, length
+  struct Run {
+    uint64_t start, length;
+  };
+  std::vector<Run> runs;
+  for (uint32_t day = 0; day < days; day++) {
+    double weather = 0.5 + uniform(random);
+    for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+      double need = (400 + 800 * uniform(random)) * weather;
+      for (int half = 0; half < 2; half++) {
+        uint64_t start = (uint64_t)day * 86400000 + (uint64_t)(uniform(random) * 86400000);
+        runs.push_back({ start, (uint64_t)(need / 2 / FLOW_ML_PER_MS) });
+      }
+    }
+  }
+  std::sort(runs.begin(), runs.end(), [](const Run &a, const Run &b) { return a.start < b.start; });
+
+  // One pump at a time: a run waits for the one before it
+  uint64_t free = 0;
+  for (Run &run : runs) {
+    run.start = std::max(run.start, free);
+    free = run.start + run.length;
+  }
+
+  double level = RESERVOIR_CAPACITY_ML;
+  Reservoir reservoir;
+  reservoirInit(reservoir, (uint32_t)level, false, 0);
+  std::vector<std::pair<double, uint16_t>> predictions; // hour, predicted hours left
+  double lowAt = -1;
+  size_t run = 0;
+
+  for (uint64_t now = stepMs; now < end && lowAt < 0; now += stepMs) {
+    while (run < runs.size() && runs[run].start + runs[run].length <= now - stepMs) {
+      run++;
+    }
+    for (size_t r = run; r < runs.size() && runs[r].start < now; r++) {
+      uint64_t from = std::max(runs[r].start, now - stepMs);
+      uint64_t to = std::min(runs[r].start + runs[r].length, now);
+      if (to > from) {
+        level -= (to - from) * FLOW_ML_PER_MS;
+      }
+    }
+    reservoirLevel(reservoir, (uint32_t)std::max(0.0, level), (uint32_t)now);
+    if (level < RESERVOIR_LOW_ML) {
+      lowAt = now / 3600000.0;
+    }
+    if (now % 3600000 == 0 && now >= 86400000) {
+      predictions.push_back({ now / 3600000.0, reservoirHoursLeft(reservoir) });
+    }
+  }
+
+  if (lowAt < 0) {
+    printf("forecast: the reservoir did not run low in %u days\n", days);
+    return;
+  }
+  std::vector<double> errors, relative;
+  for (auto &prediction : predictions) {
+    double actual = lowAt - prediction.first;
+    if (actual <= 0 || prediction.second == RESERVOIR_HOURS_UNKNOWN) {
+      continue;
+    }
+    errors.push_back(fabs(prediction.second - actual));
+    relative.push_back(fabs(prediction.second - actual) / actual);
+  }
+  std::sort(errors.begin(), errors.end());
+  std::sort(relative.begin(), relative.end());
+  printf("forecast: low after %.1f h, %zu hourly predictions, error median %.1f h (%.0f %%), p90 %.1f h (%.0f %%)\n",
+         lowAt, errors.size(), errors[errors.size() / 2], 100 * relative[relative.size() / 2],
+         errors[errors.size() * 9 / 10], 100 * relative[relative.size() * 9 / 10]);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t trials = 2000;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--trials")) {
+      trials = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--trials N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  interlock(false, trials, random);
+  interlock(true, trials, random);
+  boot(false, trials, random);
+  boot(true, trials, random);
+  for (int seed = 1; seed <= 5; seed++) {
+    random.seed(seed);
+    forecast(random);
+  }
+  return 0;
+}
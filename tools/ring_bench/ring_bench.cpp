@@ -0,0 +1,227 @@
+/**
+  Two-thread stress run and benchmark for src/ring.h.
+
+  stress  a producer thread writes a numbered stream and a consumer thread checks
+          every item arrives once and in order. Both sides pick push/pop, the bulk
+          write()/read() or the reserve()/commit() and peek()/consume() spans at random.
+          It runs an 8-bit counter ring (64 slots), a 16-bit one (256) and a 2-slot ring
+          that is full or empty nearly all the time. A lost, duplicated or reordered item
+          fails the run.
+  bench   single-thread ns per item for each operation, one item at a time and in bulk.
+          The AVR cycle counts come from the uno_bench build (tools/avr_bench, ring ops).
+
+  Build and run:
+    g++ -O2 -std=c++17 -pthread -Isrc tools/ring_bench/ring_bench.cpp -o ring_bench
+    ./ring_bench stress --items 50000000
+  On a single core the two threads only interleave at preemption and yields; the
+  ThreadSanitizer build (-O1 -g -fsanitize=thread) checks the ordering either way.
+    ./ring_bench bench
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "ring.h"
+
+typedef std::chrono::steady_clock Clock;
+
+#define BENCH_ITEMS 100000000u
+
+/**
+ * Producer: items 0, 1, 2... truncated to the item type
+ */
+template <typename T, uint16_t Size>
+static void produce(Ring<T, Size> &ring, uint64_t items, uint32_t seed)
+{
+  std::mt19937 random(seed);
+  uint64_t next = 0;
+
+  while (next < items) {
+    uint64_t before = next;
+    uint32_t choice = random();
+    uint32_t want = 1 + (choice >> 8) % 40;
+    if (want > items - next) {
+      want = items - next;
+    }
+
+    if (choice % 3 == 0) {
+      if (ring.push((T)next)) {
+        next++;
+      }
+    } else if (choice % 3 == 1) {
+      T batch[40];
+      for (uint32_t i = 0; i < want; i++) {
+        batch[i] = (T)(next + i);
+      }
+      next += ring.write(batch, want);
+    } else {
+      T *span;
+      uint32_t room = ring.reserve(span);
+      uint32_t count = room < want ? room : want;
+      for (uint32_t i = 0; i < count; i++) {
+        span[i] = (T)(next + i);
+      }
+      ring.commit(count);
+      next += count;
+    }
+    if (next == before) {
+      std::this_thread::yield(); // full, let the consumer run on a single core
+    }
+  }
+}
+
+/**
+ * Consumer: checks the stream
+ * @return items out of order
+ */
+template <typename T, uint16_t Size>
+static uint64_t consume(Ring<T, Size> &ring, uint64_t items, uint32_t seed)
+{
+  std::mt19937 random(seed);
+  uint64_t expected = 0, wrong = 0;
+
+  while (expected < items) {
+    uint64_t before = expected;
+    uint32_t choice = random();
+    uint32_t want = 1 + (choice >> 8) % 40;
+
+    if (choice % 3 == 0) {
+      T item;
+      if (ring.pop(item)) {
+        wrong += item != (T)expected;
+        expected++;
+      }
+    } else if (choice % 3 == 1) {
+      T batch[40];
+      uint32_t count = ring.read(batch, want);
+      for (uint32_t i = 0; i < count; i++) {
+        wrong += batch[i] != (T)(expected + i);
+      }
+      expected += count;
+    } else {
+      const T *span;
+      uint32_t waiting = ring.peek(span);
+      uint32_t count = waiting < want ? waiting : want;
+      for (uint32_t i = 0; i < count; i++) {
+        wrong += span[i] != (T)(expected + i);
+      }
+      ring.consume(count);
+      expected += count;
+    }
+    if (expected == before) {
+      std::this_thread::yield();
+    }
+  }
+  wrong += ring.available() != 0;
+  return wrong;
+}
+
+template <typename T, uint16_t Size>
+static bool stressRing(const char *name, uint64_t items)
+{
+  static Ring<T, Size> ring;
+  uint64_t wrong = 0;
+
+  Clock::time_point started = Clock::now();
+  std::thread producer(produce<T, Size>, std::ref(ring), items, 1);
+  std::thread consumer([&] { wrong = consume<T, Size>(ring, items, 2); });
+  producer.join();
+  consumer.join();
+  double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+  printf("%-28s %llu items, %llu wrong, %.1f M items/s\n", name, (unsigned long long)items,
+         (unsigned long long)wrong, items / seconds / 1e6);
+  return wrong == 0;
+}
+
+static int stress(uint64_t items)
+{
+  bool ok = stressRing<uint8_t, 64>("uint8_t x 64 (8-bit index)", items);
+  ok &= stressRing<uint16_t, 256>("uint16_t x 256 (16-bit index)", items);
+  ok &= stressRing<uint32_t, 2>("uint32_t x 2", items / 10);
+  return ok ? 0 : 1;
+}
+
+/**
+ * @param name
+ * @param started
+ * @param items
+ */
+static void report(const char *name, Clock::time_point started, uint64_t items)
+{
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+  printf("%-20s %.2f ns per item\n", name, ns / items);
+}
+
+static int bench()
+{
+  static Ring<uint8_t, 64> ring;
+  uint8_t batch[32];
+  volatile uint8_t sink = 0;
+  memset(batch, 1, sizeof(batch));
+
+  Clock::time_point started = Clock::now();
+  for (uint32_t n = 0; n < BENCH_ITEMS / 32; n++) {
+    for (uint8_t i = 0; i < 32; i++) {
+      ring.push(i);
+    }
+    for (uint8_t i = 0; i < 32; i++) {
+      uint8_t item = 0;
+      ring.pop(item);
+      sink = sink + item;
+    }
+  }
+  report("push + pop", started, BENCH_ITEMS);
+
+  started = Clock::now();
+  for (uint32_t n = 0; n < BENCH_ITEMS / 32; n++) {
+    ring.write(batch, 32);
+    ring.read(batch, 32);
+    sink = sink + batch[n & 31];
+  }
+  report("write + read", started, BENCH_ITEMS);
+
+  started = Clock::now();
+  for (uint32_t n = 0; n < BENCH_ITEMS / 32; n++) {
+    uint8_t *slots;
+    uint8_t room = ring.reserve(slots);
+    uint8_t count = room < 32 ? room : 32;
+    for (uint8_t i = 0; i < count; i++) {
+      slots[i] = i;
+    }
+    ring.commit(count);
+
+    const uint8_t *span;
+    uint8_t waiting = ring.peek(span);
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < waiting; i++) {
+      sum += span[i];
+    }
+    ring.consume(waiting);
+    sink = sink + sum;
+  }
+  report("reserve + peek", started, BENCH_ITEMS);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2 && !strcmp(argv[1], "stress")) {
+    uint64_t items = 50000000;
+    if (argc >= 4 && !strcmp(argv[2], "--items")) {
+      items = strtoull(argv[3], nullptr, 10);
+    }
+    return stress(items);
+  }
+  if (argc >= 2 && !strcmp(argv[1], "bench")) {
+    return bench();
+  }
+
+  fprintf(stderr, "usage: %s stress [--items N]\n       %s bench\n", argv[0], argv[0]);
+  return 1;
+}
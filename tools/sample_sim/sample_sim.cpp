@@ -0,0 +1,301 @@
+/**
+  Sample timing simulation: when do the moisture samples really happen, with the loop
+  reading the sensors as it used to and with the Timer1 paced sampling of
+  SAMPLE_TIMER_ENABLED, while the ESP keeps the SoftwareSerial link busy.
+
+  The loop is modelled as the firmware runs it: the ESP drain window when the ESP has
+  talked, the scan, the log lines, every telemetry frame printed at 9600 baud and its
+  response window, and the 2 s pacing. Its interrupt load is scheduled cycle by cycle on
+  one non-preemptive CPU with the ATmega328P vector priorities:
+    SoftwareSerial TX   interrupts off for each byte sent (10 bits)
+    SoftwareSerial RX   PCINT2 handler for each byte received (start edge to stop bit)
+    TIMER1_COMPA        the sampling compare match, reads TCNT1 and starts the ADC
+    TIMER0_OVF          millis(), every 1024 us
+    USART_UDRE          hardware Serial log, one byte per interrupt
+    ADC                 result into the ring, next zone selected
+  A pending interrupt waits for whatever handler or interrupts-off section is running,
+  then the highest priority one goes first. Short ATOMIC_BLOCKs (trace, relays) are left
+  out, they are tens of cycles against SoftwareSerial's thousands.
+
+  Output: the loop's sample period as it used to sample (zone 1, time between scans), and
+  for timed sampling the exact delay from each compare match to its conversion start,
+  the same delay as the firmware reports it (TCNT1 counts in "sampleLateUs"), and how far
+  the period between two conversions of a zone strayed from nominal.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/sample_sim/sample_sim.cpp -o sample_sim
+    ./sample_sim --hours 24 --load heavy
+    ./sample_sim --hours 24 --load idle --period-ms 200
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "config.h"
+
+#define CPU_HZ        16000000ULL
+#define CYCLES_PER_US (CPU_HZ / 1000000ULL)
+#define CYCLES_PER_MS (CPU_HZ / 1000ULL)
+#define BIT_CYCLES    (CPU_HZ / 9600ULL) // SoftwareSerial and Serial both run at 9600 baud
+
+// ATmega328P vector numbers, lower runs first; the main context comes after all of them
+#define PRIORITY_PCINT2 5
+#define PRIORITY_TIMER1 11
+#define PRIORITY_TIMER0 16
+#define PRIORITY_UDRE   19
+#define PRIORITY_ADC    21
+#define PRIORITY_MAIN   100
+
+#define RX_ISR_CYCLES     (BIT_CYCLES * 37 / 4 + 100) // centring, 8 bits, 3/4 stop bit, prologue
+#define TX_BYTE_CYCLES    (BIT_CYCLES * 10 + 40)      // cli from start bit to stop bit
+#define TX_GAP_CYCLES     120                         // print() loop between bytes, interrupts on
+#define TIMER0_ISR_CYCLES 90
+#define UDRE_ISR_CYCLES   70
+#define ADC_ISR_CYCLES    180
+#define ADC_CONVERSION    (13 * 128 + 128)            // 13 ADC clocks plus start synchronisation
+#define COMPARE_CYCLES    45
+#define COMPARE_READ      24                          // response and prologue up to reading TCNT1
+#define ANALOG_READ       (ADC_CONVERSION + 60)       // analogRead() busy-waits one conversion
+
+enum JobKind { JOB_TX, JOB_RX, JOB_TIMER0, JOB_UDRE, JOB_COMPARE, JOB_ADC };
+
+struct Job {
+  uint64_t release;
+  uint32_t duration;
+  uint8_t priority;
+  uint8_t kind;
+  uint8_t zone;
+};
+
+struct LoadProfile {
+  double chatter;       // chance the ESP sent something unprompted before a loop
+  uint32_t chatterMin;  // bytes
+  uint32_t chatterMax;
+  uint32_t responseMin; // bytes the ESP answers each frame with
+  uint32_t responseMax;
+};
+
+static const LoadProfile loadIdle = { 0.0, 0, 0, 0, 0 };
+static const LoadProfile loadNormal = { 0.2, 20, 80, 10, 40 };
+static const LoadProfile loadHeavy = { 0.6, 200, 600, 150, 500 };
+
+struct Percentiles {
+  std::vector<double> values;
+
+  void add(double value) { values.push_back(value); }
+
+  double at(double fraction)
+  {
+    if (values.empty()) {
+      return 0;
+    }
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+  }
+
+  double mean() const
+  {
+    double sum = 0;
+    for (double value : values) {
+      sum += value;
+    }
+    return values.empty() ? 0 : sum / values.size();
+  }
+};
+
+/**
+ * Append byte jobs for a SoftwareSerial transmission
+ * @return when the last byte is out
+ */
+static uint64_t sendBytes(std::vector<Job> &jobs, uint64_t at, uint32_t bytes)
+{
+  for (uint32_t i = 0; i < bytes; i++) {
+    jobs.push_back({ at, TX_BYTE_CYCLES, PRIORITY_MAIN, JOB_TX, 0 });
+    at += TX_BYTE_CYCLES + TX_GAP_CYCLES;
+  }
+  return at;
+}
+
+/**
+ * Append receive interrupts for bytes the ESP sends back to back
+ */
+static void receiveBytes(std::vector<Job> &jobs, uint64_t at, uint32_t bytes, uint64_t until)
+{
+  for (uint32_t i = 0; i < bytes && at < until; i++) {
+    jobs.push_back({ at, RX_ISR_CYCLES, PRIORITY_PCINT2, JOB_RX, 0 });
+    at += BIT_CYCLES * 10;
+  }
+}
+
+/**
+ * Append the hardware Serial interrupts of a log burst
+ */
+static void logBytes(std::vector<Job> &jobs, uint64_t at, uint32_t bytes)
+{
+  for (uint32_t i = 0; i < bytes; i++) {
+    jobs.push_back({ at, UDRE_ISR_CYCLES, PRIORITY_UDRE, JOB_UDRE, 0 });
+    at += BIT_CYCLES * 10;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  double hours = 24;
+  uint32_t periodMs = SAMPLE_TIMER_PERIOD_MS;
+  uint32_t zones = ZONE_COUNT;
+  LoadProfile load = loadHeavy;
+  const char *loadName = "heavy";
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--hours")) {
+      hours = atof(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--period-ms")) {
+      periodMs = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--zones")) {
+      zones = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--load")) {
+      loadName = argv[i + 1];
+      load = !strcmp(loadName, "idle") ? loadIdle : (!strcmp(loadName, "normal") ? loadNormal : loadHeavy);
+    } else {
+      fprintf(stderr, "usage: %s [--hours H] [--period-ms MS] [--zones N] [--load idle|normal|heavy]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Timer1 prescaler as sensors.cpp picks it
+  uint64_t tickUs = (uint64_t)periodMs * 1000 / zones;
+  uint32_t prescale = tickUs <= 32768 ? 8 : (tickUs <= 262144 ? 64 : (tickUs <= 1048576 ? 256 : 1024));
+  uint64_t tickCycles = tickUs * CYCLES_PER_US / prescale * prescale;
+  uint64_t end = (uint64_t)(hours * 3600 * CPU_HZ);
+
+  std::mt19937 random(1);
+  uint32_t frames = (zones + TELEMETRY_ZONES_PER_FRAME - 1) / TELEMETRY_ZONES_PER_FRAME;
+  std::vector<uint64_t> scans;
+
+  // One loop pass at a time: its interrupt jobs, sorted, and where the next pass starts
+  std::vector<Job> loopJobs;
+  size_t loopNext = 0;
+  uint64_t loopAt = 0;
+  auto runLoop = [&]() {
+    loopJobs.clear();
+    loopNext = 0;
+    if (std::uniform_real_distribution<double>(0, 1)(random) < load.chatter) {
+      uint32_t bytes = load.chatterMin + random() % (load.chatterMax - load.chatterMin + 1);
+      receiveBytes(loopJobs, loopAt, bytes, loopAt + 1000 * CYCLES_PER_MS);
+      loopAt += 1000 * CYCLES_PER_MS;
+    }
+
+    scans.push_back(loopAt);
+    loopAt += zones * ANALOG_READ;
+    logBytes(loopJobs, loopAt, zones * 34);
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+      loopAt += 3 * CYCLES_PER_MS; // encoding
+      loopAt = sendBytes(loopJobs, loopAt, 230);
+      uint64_t wait = (frame + 1 == frames ? 1000 : 250) * CYCLES_PER_MS;
+      if (load.responseMax) {
+        uint32_t bytes = load.responseMin + random() % (load.responseMax - load.responseMin + 1);
+        receiveBytes(loopJobs, loopAt + (20 + random() % 80) * CYCLES_PER_MS, bytes, loopAt + wait);
+      }
+      loopAt += wait;
+    }
+    loopAt += 2000 * CYCLES_PER_MS;
+    std::sort(loopJobs.begin(), loopJobs.end(), [](const Job &a, const Job &b) { return a.release < b.release; });
+  };
+
+  // The other sources are periodic, the ADC follows each compare match
+  uint64_t timer0At = 0, compareAt = tickCycles;
+  uint8_t compareZone = 0;
+  auto laterRelease = [](const Job &a, const Job &b) { return a.release > b.release; };
+  std::priority_queue<Job, std::vector<Job>, decltype(laterRelease)> conversions(laterRelease);
+
+  auto nextRelease = [&]() {
+    while (loopNext == loopJobs.size() && loopAt < end) {
+      runLoop();
+    }
+    uint64_t loopRelease = loopNext < loopJobs.size() ? loopJobs[loopNext].release : UINT64_MAX;
+    uint64_t adcRelease = conversions.empty() ? UINT64_MAX : conversions.top().release;
+    uint64_t first = std::min({ loopRelease, adcRelease, timer0At, compareAt });
+    return first < end ? first : UINT64_MAX;
+  };
+  auto takeJob = [&](uint64_t first) {
+    Job job;
+    if (first == compareAt) {
+      job = { compareAt, COMPARE_CYCLES, PRIORITY_TIMER1, JOB_COMPARE, compareZone };
+      compareAt += tickCycles;
+      compareZone = (compareZone + 1) % zones;
+    } else if (first == timer0At) {
+      job = { timer0At, TIMER0_ISR_CYCLES, PRIORITY_TIMER0, JOB_TIMER0, 0 };
+      timer0At += 1024 * CYCLES_PER_US;
+    } else if (!conversions.empty() && first == conversions.top().release) {
+      job = conversions.top();
+      conversions.pop();
+    } else {
+      job = loopJobs[loopNext++];
+    }
+    return job;
+  };
+
+  // One CPU, handlers run to completion, the highest priority pending one next
+  auto later = [](const Job &a, const Job &b) {
+    return a.priority != b.priority ? a.priority > b.priority : a.release > b.release;
+  };
+  std::priority_queue<Job, std::vector<Job>, decltype(later)> pending(later);
+  std::vector<uint64_t> lastStart(zones, 0);
+  Percentiles late, reported, periodError;
+  uint64_t now = 0, compares = 0, overruns = 0;
+
+  for (uint64_t release = nextRelease(); release != UINT64_MAX || !pending.empty(); release = nextRelease()) {
+    if (pending.empty() && now < release) {
+      now = release;
+    }
+    for (; release <= now; release = nextRelease()) {
+      pending.push(takeJob(release));
+    }
+
+    Job job = pending.top();
+    pending.pop();
+
+    if (job.kind == JOB_COMPARE) {
+      uint64_t start = now + COMPARE_READ + random() % 4; // the instruction under way finishes first
+      uint64_t delay = start - job.release;
+      late.add(delay / (double)CYCLES_PER_US);
+      reported.add((double)(delay / prescale) * prescale / CYCLES_PER_US);
+      overruns += delay >= tickCycles;
+      if (lastStart[job.zone]) {
+        double period = (start - lastStart[job.zone]) / (double)CYCLES_PER_US;
+        periodError.add(fabs(period - tickCycles * zones / (double)CYCLES_PER_US));
+      }
+      lastStart[job.zone] = start;
+      compares++;
+      conversions.push({ start + ADC_CONVERSION, ADC_ISR_CYCLES, PRIORITY_ADC, JOB_ADC, job.zone });
+    }
+    now += job.duration;
+  }
+
+  Percentiles loopPeriod;
+  for (size_t i = 1; i < scans.size(); i++) {
+    loopPeriod.add((scans[i] - scans[i - 1]) / (double)CYCLES_PER_MS);
+  }
+
+  printf("load               %s, %.0f h, %u zones, %u frame(s) per loop\n", loadName, hours, zones, frames);
+  printf("loop sampling      period mean %.0f ms, min %.0f, max %.0f, p99 %.0f\n", loopPeriod.mean(),
+         loopPeriod.at(0), loopPeriod.at(1.0), loopPeriod.at(0.99));
+  printf("timed sampling     every %u ms per zone, tick %.1f ms, Timer1 /%u (%.1f us per count)\n",
+         (unsigned)(tickCycles * zones / CYCLES_PER_MS), tickCycles / (double)CYCLES_PER_MS, prescale,
+         prescale / (double)CYCLES_PER_US);
+  printf("  conversion late  mean %.1f us, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f (%llu samples)\n", late.mean(),
+         late.at(0.5), late.at(0.99), late.at(0.999), late.at(1.0), (unsigned long long)compares);
+  printf("  as reported      min %.0f us, max %.0f us (TCNT1 counts)\n", reported.at(0), reported.at(1.0));
+  printf("  period error     p99 %.1f us, max %.1f us, %llu conversions started after the next match\n",
+         periodError.at(0.99), periodError.at(1.0), (unsigned long long)overruns);
+  return 0;
+}
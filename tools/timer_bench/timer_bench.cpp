@@ -0,0 +1,276 @@
+/**
+  Timebase check and benchmark for src/uptime.cpp and src/timerwheel.cpp.
+
+  wrap   runs the old `long int time = millis(); while ((time + timeout) > millis())` wait,
+         with AVR's 32-bit long and unsigned long, next to a timer wheel wait. Both start
+         at every offset around the 49.7 day wrap of millis() and the tool prints how
+         long each one really waited.
+  bench  keeps 64 timers active with the firmware's mix of timeouts (ESP waits, loop
+         pacing, pump slices and soaks, heartbeat, checkpoint, lockout retry). The
+         simulated millis() starts just before the wrap, and the wheel is serviced at
+         random gaps like serviceBackground(). Every expired timer is re-armed. The tool
+         checks that every timer expired at the first advance at or after its expiry
+         time, then reports the cost of a restart and of a whole service pass (advance,
+         poll, re-arm), next to a linear scan over 64 deadlines on the same schedule.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/timer_bench/timer_bench.cpp src/uptime.cpp src/timerwheel.cpp -o timer_bench
+    ./timer_bench wrap
+    ./timer_bench bench --hours 24
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "uptime.h"
+#include "timerwheel.h"
+
+#define BENCH_TIMERS 64
+#define WRAP_START   0xFFFFF000u // millis() 4096 ms before it wraps
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * The old wait on an AVR: long and unsigned long are 32 bits, the sum is compared unsigned
+ * @param start millis() when the wait began
+ * @param timeout
+ * @return ms it waited, capped at 10 x timeout for a wait that never ends
+ */
+static uint32_t oldWait(uint32_t start, int timeout)
+{
+  int32_t time = (int32_t)start;
+  uint32_t millis = start;
+  while ((uint32_t)(int32_t)((uint32_t)time + timeout) > millis) {
+    millis++;
+    if (millis - start > 10u * timeout) {
+      break;
+    }
+  }
+  return millis - start;
+}
+
+/**
+ * The same wait on the timer wheel, serviced every ms like the firmware's wait loops
+ * @param start millis() when the wait began
+ * @param timeout
+ * @return ms it waited
+ */
+static uint32_t wheelWait(uint32_t start, int timeout)
+{
+  Uptime uptime;
+  uptimeInit(uptime, start - 1000); // booted a while ago
+  TimerWheel wheel;
+  timerWheelInit(wheel, uptimeExtend(uptime, start - 1000));
+
+  uint32_t millis = start;
+  Timer timer;
+  timerInit(timer);
+  timerStart(wheel, timer, uptimeExtend(uptime, millis), timeout);
+  while (timerPending(timer)) {
+    millis++;
+    timerWheelAdvance(wheel, uptimeExtend(uptime, millis));
+  }
+  return millis - start;
+}
+
+static int wrap()
+{
+  const int timeout = 1000;
+  uint32_t oldSkipped = 0, oldShort = 0, oldLong = 0, wheelWrong = 0, starts = 0;
+
+  printf("start (ms before wrap)  old wait  wheel wait\n");
+  for (int64_t before = 3000; before >= -1000; before -= 1) {
+    uint32_t start = (uint32_t)(0x100000000LL - before);
+    uint32_t waitedOld = oldWait(start, timeout);
+    uint32_t waitedWheel = wheelWait(start, timeout);
+    starts++;
+    oldSkipped += waitedOld == 0;
+    oldShort += waitedOld > 0 && waitedOld < (uint32_t)timeout;
+    oldLong += waitedOld > (uint32_t)timeout;
+    wheelWrong += waitedWheel != (uint32_t)timeout;
+    if (before % 250 == 0) {
+      printf("%22lld  %5u ms  %7u ms\n", (long long)before, waitedOld, waitedWheel);
+    }
+  }
+  printf("%u waits of %d ms around the wrap: old skipped %u, cut short %u, overran %u; wheel off in %u\n",
+         starts, timeout, oldSkipped, oldShort, oldLong, wheelWrong);
+
+  // A signed long also turns negative halfway, at 24.9 days
+  uint32_t half = 0x80000000u;
+  printf("old wait started 500 ms before 2^31: %u ms, wheel %u ms\n", oldWait(half - 500, timeout),
+         wheelWait(half - 500, timeout));
+  return wheelWrong ? 1 : 0;
+}
+
+// Timeouts the firmware arms, each timer keeps one role: ESP waits, loop pacing, pump
+// staggers, bursts, slices and soaks, heartbeat, checkpoint, lockout retry
+static const uint32_t roles[] = { 100, 250, 1000, 2000, 250, 10000, 60000, 60000, 900000, 3600000, 21600000 };
+
+struct BenchRun {
+  uint64_t advances = 0;
+  uint64_t starts = 0;
+  uint64_t expired = 0;
+  uint64_t wrong = 0; // pending past their expiry, or expired early
+  uint32_t wraps = 0;
+  double seconds = 0;
+};
+
+/**
+ * Run the schedule once
+ * @param hours simulated
+ * @param check verify every timer after each advance, left out of the timed run
+ * @return counts and wall time
+ */
+static BenchRun simulate(uint32_t hours, bool check)
+{
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint32_t> gap(1, 20); // ms between serviceBackground() passes
+  std::vector<Timer> timers(BENCH_TIMERS);
+  BenchRun run;
+
+  Uptime uptime;
+  uptimeInit(uptime, WRAP_START);
+  uint64_t previous = uptimeExtend(uptime, WRAP_START);
+  TimerWheel wheel;
+  timerWheelInit(wheel, previous);
+  for (int i = 0; i < BENCH_TIMERS; i++) {
+    timerInit(timers[i]);
+    timerStart(wheel, timers[i], previous, roles[i % (sizeof(roles) / sizeof(roles[0]))]);
+  }
+
+  uint64_t end = previous + (uint64_t)hours * 3600000;
+  uint32_t millis = WRAP_START;
+  Clock::time_point started = Clock::now();
+
+  while (previous < end) {
+    millis += gap(random);
+    uint64_t now = uptimeExtend(uptime, millis);
+    timerWheelAdvance(wheel, now);
+    run.advances++;
+
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+      if (timerPending(timers[i])) {
+        if (check) {
+          run.wrong += timers[i].expires <= now;
+        }
+        continue;
+      }
+      if (check) {
+        run.wrong += timers[i].expires <= previous || timers[i].expires > now;
+      }
+      run.expired++;
+      uint32_t timeout = roles[i % (sizeof(roles) / sizeof(roles[0]))];
+      timerStart(wheel, timers[i], now, timeout + random() % (timeout / 10 + 1));
+      run.starts++;
+    }
+    previous = now;
+  }
+
+  run.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+  run.wraps = uptime.wraps;
+  return run;
+}
+
+/**
+ * Restart random timers among BENCH_TIMERS active ones, the cost of a start (with the
+ * stop it implies) alone
+ * @param count restarts
+ * @return ns per restart
+ */
+static double restartCost(uint32_t count)
+{
+  std::mt19937 random(2);
+  std::vector<Timer> timers(BENCH_TIMERS);
+  std::vector<uint32_t> picks(4096);
+  for (uint32_t &pick : picks) {
+    pick = random();
+  }
+
+  TimerWheel wheel;
+  timerWheelInit(wheel, WRAP_START);
+  for (int i = 0; i < BENCH_TIMERS; i++) {
+    timerInit(timers[i]);
+    timerStart(wheel, timers[i], WRAP_START, roles[i % (sizeof(roles) / sizeof(roles[0]))]);
+  }
+
+  Clock::time_point started = Clock::now();
+  for (uint32_t n = 0; n < count; n++) {
+    uint32_t pick = picks[n & 4095];
+    timerStart(wheel, timers[pick % BENCH_TIMERS], WRAP_START, roles[(pick >> 8) % (sizeof(roles) / sizeof(roles[0]))]);
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - started).count() / count;
+}
+
+/**
+ * The same schedule as a scan over every deadline, what the firmware's per-module
+ * millis() comparisons add up to
+ * @param hours simulated
+ * @return ns per pass
+ */
+static double scanCost(uint32_t hours)
+{
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint32_t> gap(1, 20);
+  uint64_t deadlines[BENCH_TIMERS];
+  uint64_t now = WRAP_START, end = now + (uint64_t)hours * 3600000, passes = 0, expired = 0;
+  for (int i = 0; i < BENCH_TIMERS; i++) {
+    deadlines[i] = now + roles[i % (sizeof(roles) / sizeof(roles[0]))];
+  }
+
+  Clock::time_point started = Clock::now();
+  while (now < end) {
+    now += gap(random);
+    passes++;
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+      if (deadlines[i] <= now) {
+        uint32_t timeout = roles[i % (sizeof(roles) / sizeof(roles[0]))];
+        deadlines[i] = now + timeout + random() % (timeout / 10 + 1);
+        expired++;
+      }
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+  return expired ? ns / passes : 0;
+}
+
+static int bench(uint32_t hours)
+{
+  BenchRun checked = simulate(hours, true);
+  BenchRun timed = simulate(hours, false);
+
+  printf("simulated          %u h from millis() 0x%08X, %u wrap(s), %llu service passes\n", hours, WRAP_START,
+         checked.wraps, (unsigned long long)checked.advances);
+  printf("active timers      %d\n", BENCH_TIMERS);
+  printf("expirations        %llu, %llu off their expiry tick\n", (unsigned long long)checked.expired,
+         (unsigned long long)checked.wrong);
+  printf("timerStart         %.1f ns (restart among %d active)\n", restartCost(20000000), BENCH_TIMERS);
+  printf("service pass       %.1f ns (advance, poll %d timers, re-arm the expired)\n",
+         timed.seconds * 1e9 / timed.advances, BENCH_TIMERS);
+  printf("linear scan        %.1f ns per pass over %d deadlines\n", scanCost(hours), BENCH_TIMERS);
+  return checked.wrong ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2 && !strcmp(argv[1], "wrap")) {
+    return wrap();
+  }
+  if (argc >= 2 && !strcmp(argv[1], "bench")) {
+    uint32_t hours = 24;
+    for (int i = 2; i + 1 < argc; i += 2) {
+      if (!strcmp(argv[i], "--hours")) {
+        hours = std::max(1, atoi(argv[i + 1]));
+      }
+    }
+    return bench(hours);
+  }
+
+  fprintf(stderr, "usage: %s wrap\n       %s bench [--hours 24]\n", argv[0], argv[0]);
+  return 1;
+}
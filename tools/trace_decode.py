@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+Decode the binary event trace streamed by the Uno (TRACE_ENABLED in src/config.h)
+into a human readable timeline.
+
+    python3 tools/trace_decode.py /dev/ttyACM0          # live, needs pyserial
+    python3 tools/trace_decode.py capture.bin           # raw capture file
+
+Bytes outside a valid packet (text log lines, line noise) are skipped.
+"""
+
+import sys
+
+SYNC1 = 0xA5
+SYNC2 = 0x5A
+
+EVENT_CLOCK = 0
+EVENT_OVERFLOW = 1
+EVENT_BOOT = 2
+EVENT_LOOP = 3
+EVENT_SENSOR = 4
+EVENT_RELAY = 5
+EVENT_ESP_TX = 6
+EVENT_ESP_RX = 7
+EVENT_PUMP_FAULT = 8
+EVENT_RESERVOIR = 9
+
+# Low byte of EVENT_PUMP_FAULT, PumpFaultReason in src/pumpmonitor.h
+PUMP_FAULT_REASONS = {
+    0: "retry",
+    1: "locked out, no moisture response",
+    2: "locked out, no flow",
+    3: "locked out, running dry (current)",
+    4: "locked out, stalled (current)",
+}
+
+
+def describe(event_id, payload):
+    if event_id == EVENT_OVERFLOW:
+        return "overflow   %d events lost" % payload
+    if event_id == EVENT_BOOT:
+        return "boot       reset cause 0x%02x" % payload
+    if event_id == EVENT_LOOP:
+        return "loop"
+    if event_id == EVENT_SENSOR:
+        return "sensor     zone %d = %d" % (payload >> 10, payload & 0x3FF)
+    if event_id == EVENT_RELAY:
+        return "relay      zone %d %s" % (payload >> 8, "ON" if payload & 1 else "off")
+    if event_id == EVENT_ESP_TX:
+        return "esp tx     %d bytes" % payload
+    if event_id == EVENT_ESP_RX:
+        return "esp rx     %d bytes" % payload
+    if event_id == EVENT_PUMP_FAULT:
+        reason = PUMP_FAULT_REASONS.get(payload & 0xFF, "reason %d" % (payload & 0xFF))
+        return "pump fault zone %d %s" % (payload >> 8, reason)
+    if event_id == EVENT_RESERVOIR:
+        return "reservoir  %.1f L, %s" % ((payload & 0x7FFF) / 10, "pumps interlocked" if payload >> 15 else "refilled")
+    return "unknown    id %d payload 0x%04x" % (event_id, payload)
+
+
+def packets(stream):
+    """Yield the event list of every packet whose checksum matches"""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(64)
+        if not chunk:
+            return
+        buffer.extend(chunk)
+
+        while True:
+            start = buffer.find(bytes([SYNC1, SYNC2]))
+            if start < 0:
+                del buffer[:-1]
+                break
+            if len(buffer) < start + 3:
+                del buffer[:start]
+                break
+
+            count = buffer[start + 2]
+            end = start + 3 + count * 4 + 1
+            if len(buffer) < end:
+                del buffer[:start]
+                break
+
+            body = buffer[start + 2:end - 1]
+            if count == 0 or sum(body) & 0xFF != buffer[end - 1]:
+                del buffer[:start + 1]
+                continue
+
+            events = []
+            for i in range(count):
+                raw = body[1 + i * 4:5 + i * 4]
+                events.append((raw[0], raw[1], raw[2] | raw[3] << 8))
+            del buffer[:end]
+            yield events
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip())
+        return 1
+
+    path = sys.argv[1]
+    if path.startswith("/dev/"):
+        import serial
+        stream = serial.Serial(path, 9600)
+    else:
+        stream = open(path, "rb")
+
+    now = 0
+    for events in packets(stream):
+        for event_id, dt, payload in events:
+            if event_id == EVENT_CLOCK:
+                now += dt << 16 | payload
+                continue
+            now += dt
+            if event_id == EVENT_BOOT:
+                now = 0
+            print("%10.3f s  %s" % (now / 1000.0, describe(event_id, payload)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
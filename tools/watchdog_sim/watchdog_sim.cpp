@@ -0,0 +1,159 @@
+/**
+  Hung-task recovery check: the real task bookkeeping, watchdog interrupt and boot decode
+  of src/watchdog.cpp against a simulated 8 s watchdog, loop() and reset.
+
+  Every trial runs the three tasks of loop() (ESP drain, sensors, telemetry, 0.5..2.5 s
+  each), then wedges one of them at a random point. The simulated watchdog counts from the
+  last feed; at 8 s it runs the interrupt (watchdogExpired(), the relays go off here) and
+  resets the board 15 ms later. The reboot keeps .noinit like the AVR does, clears the
+  rest and calls watchdogBoot() with the flags each boot path leaves:
+    no bootloader   MCUSR still holds WDRF
+    optiboot >= 4.5 MCUSR cleared, WDRF passed on in r2
+    optiboot 4.4    MCUSR cleared, r2 left holding whatever it held
+  Checked per trial: the watchdog never fires while the tasks run, it fires within 8 s of
+  the last feed once one is wedged, and the next boot reports RESET_CAUSE_HUNG_TASK with
+  the wedged task as breadcrumb and one more reset, then a power-on clears it all.
+  Any failed check is printed and makes the exit status non-zero.
+
+  Build and run:
+    g++ -O2 -std=c++17 -Isrc tools/watchdog_sim/watchdog_sim.cpp src/watchdog.cpp -o watchdog_sim
+    ./watchdog_sim --trials 2000
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "watchdog.h"
+
+#define WATCHDOG_PERIOD_MS 8000
+#define WDRF_FLAGS RESET_CAUSE_WATCHDOG
+
+enum BootPath {
+  BOOT_NONE,
+  BOOT_OPTIBOOT_R2,
+  BOOT_OPTIBOOT_OLD,
+  BOOT_PATHS
+};
+
+static const char *bootPathNames[BOOT_PATHS] = { "no bootloader", "optiboot >= 4.5", "optiboot 4.4" };
+
+static uint32_t failures = 0;
+
+static void check(bool ok, const char *what, uint32_t trial, BootPath path)
+{
+  if (!ok) {
+    failures++;
+    if (failures <= 20) {
+      printf("FAIL trial %u (%s): %s\n", trial, bootPathNames[path], what);
+    }
+  }
+}
+
+/**
+ * Flags watchdogBoot() sees after a reset with these MCUSR flags on this boot path
+ */
+static uint8_t bootFlags(BootPath path, uint8_t mcusr, std::mt19937 &random)
+{
+  switch (path) {
+  case BOOT_NONE:
+    return watchdogResetFlags(mcusr, (uint8_t)random());
+  case BOOT_OPTIBOOT_R2:
+    return watchdogResetFlags(0, mcusr);
+  default:
+    return watchdogResetFlags(0, (uint8_t)random());
+  }
+}
+
+struct TrialResult {
+  uint32_t detectMs; // last feed to the watchdog interrupt
+  bool unknownCause; // the boot could not tell the reset flags apart
+};
+
+static TrialResult trial(uint32_t n, BootPath path, std::mt19937 &random)
+{
+  std::uniform_int_distribution<uint32_t> taskMs(500, 2500);
+  std::uniform_int_distribution<uint32_t> cycles(1, 20);
+
+  watchdogBoot(bootFlags(path, RESET_CAUSE_POWER_ON, random));
+  uint16_t resetsBefore = watchdogResetCount();
+
+  uint32_t now = 0, lastFeed = 0, fired = 0;
+  uint32_t stallCycle = cycles(random);
+  uint8_t stallTask = random() % TASK_COUNT;
+  bool hung = false;
+
+  for (uint32_t cycle = 0; !fired; cycle++) {
+    for (uint8_t task = 0; task < TASK_COUNT && !fired; task++) {
+      watchdogEnter(task);
+      uint32_t runMs = taskMs(random);
+      hung = cycle == stallCycle && task == stallTask;
+
+      // Time passes in 1 ms steps, the watchdog fires 8 s after the last feed
+      for (uint32_t ms = 0; hung || ms < runMs; ms++) {
+        now++;
+        if (now - lastFeed >= WATCHDOG_PERIOD_MS) {
+          watchdogExpired();
+          fired = now;
+          break;
+        }
+      }
+      if (!fired && watchdogCheckIn(task)) {
+        lastFeed = now;
+      }
+    }
+  }
+  check(hung, "the watchdog fired while every task was running", n, path);
+
+  // Reset: .noinit survives, the rest starts over
+  watchdogBoot(bootFlags(path, WDRF_FLAGS, random));
+  uint8_t cause = watchdogResetCause();
+  check(cause & RESET_CAUSE_HUNG_TASK, "no RESET_CAUSE_HUNG_TASK after the stall", n, path);
+  check(cause & RESET_CAUSE_WATCHDOG, "no RESET_CAUSE_WATCHDOG after the stall", n, path);
+  check(watchdogBreadcrumb() == stallTask, "breadcrumb is not the wedged task", n, path);
+  check(watchdogResetCount() == resetsBefore + 1, "reset count did not go up by one", n, path);
+
+  // The next watchdog-free reset reports no hung task
+  watchdogBoot(bootFlags(path, RESET_CAUSE_EXTERNAL, random));
+  check(!(watchdogResetCause() & RESET_CAUSE_HUNG_TASK), "hung task reported twice", n, path);
+  check(watchdogBreadcrumb() == WATCHDOG_NO_TASK, "breadcrumb outlived its reset", n, path);
+
+  // A power-on the boot path can see clears the count
+  uint8_t powerOn = bootFlags(path, RESET_CAUSE_POWER_ON, random);
+  watchdogBoot(powerOn);
+  if (powerOn & RESET_CAUSE_POWER_ON) {
+    check(watchdogResetCount() == 0, "power-on did not clear the reset count", n, path);
+  }
+
+  return { fired - lastFeed, !(powerOn & RESET_CAUSE_POWER_ON) };
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t trials = 2000;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--trials")) {
+      trials = strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--trials N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 random(1);
+  for (int path = 0; path < BOOT_PATHS; path++) {
+    uint32_t failedBefore = failures, slowest = 0, unknown = 0;
+    for (uint32_t n = 0; n < trials; n++) {
+      TrialResult result = trial(n, (BootPath)path, random);
+      slowest = result.detectMs > slowest ? result.detectMs : slowest;
+      unknown += result.unknownCause;
+    }
+    printf("%-16s %u trials, %u failed checks, interrupt at most %u ms after the last feed,"
+           " power-on unknown %u\n",
+           bootPathNames[path], trials, failures - failedBefore, slowest, unknown);
+  }
+  return failures ? 1 : 0;
+}